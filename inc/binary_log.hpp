@@ -0,0 +1,236 @@
+// @file BinaryLog.hpp
+// @brief Deferred binary logger for hot paths, formatting runs in a low-priority task
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifndef BLOG_MAX_ARGS
+#define BLOG_MAX_ARGS 8 // Arguments per record, each one a 32-bit word
+#endif
+
+#ifndef BLOG_TEXT_LEN
+#define BLOG_TEXT_LEN 32 // Bytes per record for copies of string arguments
+#endif
+
+#ifndef BLOG_LINE_LEN
+#define BLOG_LINE_LEN 160 // Longest formatted line
+#endif
+
+#ifndef BLOG_MAX_LEVEL
+#ifdef CONFIG_LOG_MAXIMUM_LEVEL
+#define BLOG_MAX_LEVEL CONFIG_LOG_MAXIMUM_LEVEL // Records above this level are compiled out
+#else
+#define BLOG_MAX_LEVEL ESP_LOG_VERBOSE
+#endif
+#endif
+
+#define BLOG_LEVEL(level, tag, format, ...) do { \
+        if ((level) <= BLOG_MAX_LEVEL) { \
+            ESP32_LOG::BinaryLog::getInstance().write((level), (tag), (format), ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define BLOG_E(tag, format, ...) BLOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define BLOG_W(tag, format, ...) BLOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define BLOG_I(tag, format, ...) BLOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define BLOG_D(tag, format, ...) BLOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+namespace ESP32_LOG {
+
+    /**
+     * @brief One log call, captured without formatting
+     *
+     * The format pointer doubles as the format id: it points into the
+     * firmware image, so a host tool can resolve it against the ELF file.
+     */
+    struct BinaryLogRecord {
+        uint32_t    timestamp_ms;
+        const char* tag;
+        const char* format;
+        uint8_t     level;
+        uint8_t     argc;
+        uint8_t     text_len;                // Bytes of text in use
+        uint32_t    args[BLOG_MAX_ARGS];     // Integers, float bits, or text offsets for %s
+        char        text[BLOG_TEXT_LEN];     // NUL-terminated copies of string arguments
+    };
+
+    /**
+     * @brief Logger settings
+     */
+    struct BinaryLogConfig {
+        size_t      slots         = 128;    // Records buffered, rounded up to a power of two
+        uint32_t    drain_ms      = 50;     // Formatting task wake-up period
+        uint32_t    task_stack    = 3072;
+        UBaseType_t task_priority = 1;
+        BaseType_t  task_core     = tskNO_AFFINITY;
+    };
+
+    /**
+     * @brief Logger counters
+     */
+    struct BinaryLogStats {
+        uint32_t written;    // Records queued
+        uint32_t dropped;    // Records lost to a full ring
+        uint32_t pending;    // Records waiting for the formatting task
+    };
+
+    /**
+     * @brief Callback receiving raw records instead of formatted lines
+     * @param record Captured log call
+     * @param user_data User provided data pointer
+     */
+    typedef void (*BinaryLogSink)(const BinaryLogRecord& record, void* user_data);
+
+    /**
+     * @brief Logger whose callers only copy a small record into a lock-free ring
+     *
+     * write() captures the format pointer and up to BLOG_MAX_ARGS arguments
+     * into a bounded multi-producer multi-consumer ring and returns. A
+     * low-priority task formats the records and hands them to esp_log, or to
+     * a sink that can ship them to a host tool. A full ring drops the new
+     * record and counts it, writers never block.
+     *
+     * Arguments are 32-bit integers, enums, floats or strings. Strings are
+     * copied into the record and truncated to BLOG_TEXT_LEN bytes in total,
+     * so %s is safe with buffers that are gone by the time the line is
+     * formatted. Length modifiers in the format are ignored and 64-bit
+     * values are not supported.
+     *
+     * Before start() and after stop(), records are formatted in the calling
+     * task, like ESP_LOGx.
+     *
+     * Use it from tasks and timer callbacks, not from ISRs.
+     */
+    class BinaryLog {
+    public:
+        /**
+         * @brief Get singleton instance
+         */
+        static BinaryLog& getInstance();
+
+        /**
+         * @brief Allocate the ring and start the formatting task
+         * @param config Logger settings
+         * @return true if successful
+         * @note The ring is allocated by the first start() and kept, so writers
+         *       never race a free. Later calls keep its size.
+         */
+        bool start(const BinaryLogConfig& config = BinaryLogConfig());
+
+        /**
+         * @brief Format what is queued and stop the formatting task
+         */
+        void stop();
+
+        /**
+         * @brief Set the most verbose level recorded
+         * @param level Log level
+         */
+        void setLevel(esp_log_level_t level);
+
+        /**
+         * @brief Send raw records to a callback instead of esp_log
+         * @param sink Callback, nullptr to format through esp_log
+         * @param user_data User data pointer
+         * @note Set before start(), the sink runs in the formatting task
+         */
+        void setSink(BinaryLogSink sink, void* user_data = nullptr);
+
+        /**
+         * @brief Record a log call
+         * @param level  Log level
+         * @param tag    Tag, must outlive the record (a string literal)
+         * @param fmt    printf format, must outlive the record (a string literal)
+         * @param args   Arguments, see the class description
+         */
+        template <typename... Args>
+        void write(esp_log_level_t level, const char* tag, const char* fmt, const Args&... args) {
+            static_assert(sizeof...(Args) <= BLOG_MAX_ARGS, "Too many arguments for a binary log record");
+            if (level > _level.load(std::memory_order_relaxed)) return;
+            BinaryLogRecord record = {};
+            record.timestamp_ms = esp_log_timestamp();
+            record.tag = tag;
+            record.format = fmt;
+            record.level = static_cast<uint8_t>(level);
+            (capture(record, args), ...);
+            submit(record);
+        }
+
+        /**
+         * @brief Format a record
+         * @param record Captured log call
+         * @param out    Output buffer
+         * @param size   Output buffer size
+         * @return Characters written, without the terminating NUL
+         */
+        static size_t format(const BinaryLogRecord& record, char* out, size_t size);
+
+        /**
+         * @brief Get the logger counters
+         */
+        BinaryLogStats getStats() const;
+
+    private:
+        BinaryLog();
+        ~BinaryLog();
+        BinaryLog(const BinaryLog&) = delete;
+        BinaryLog& operator=(const BinaryLog&) = delete;
+
+        struct Cell {
+            std::atomic<uint32_t> sequence;
+            BinaryLogRecord       record;
+        };
+
+        template <typename T>
+        static void capture(BinaryLogRecord& record, const T& value) {
+            using V = std::decay_t<T>;
+            uint32_t& arg = record.args[record.argc++];
+            if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>) {
+                arg = addText(record, value ? std::string_view(value) : std::string_view("(null)"));
+            } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+                arg = addText(record, std::string_view(value));
+            } else if constexpr (std::is_enum_v<V>) {
+                static_assert(sizeof(V) <= sizeof(uint32_t), "Binary log arguments are 32-bit words");
+                arg = static_cast<uint32_t>(value);
+            } else if constexpr (std::is_integral_v<V>) {
+                static_assert(sizeof(V) <= sizeof(uint32_t), "Binary log arguments are 32-bit words");
+                arg = static_cast<uint32_t>(value);
+            } else if constexpr (std::is_floating_point_v<V>) {
+                const float f = static_cast<float>(value);
+                memcpy(&arg, &f, sizeof(arg));
+            } else {
+                static_assert(std::is_integral_v<V>, "Unsupported binary log argument type");
+            }
+        }
+
+        static uint32_t addText(BinaryLogRecord& record, std::string_view text);
+        static void formatterTask(void* arg);
+        void submit(const BinaryLogRecord& record);
+        bool push(const BinaryLogRecord& record);
+        bool pop(BinaryLogRecord& record);
+        void drain();
+        void emit(const BinaryLogRecord& record);
+
+        BinaryLogConfig              _config;
+        Cell*                        _cells;
+        uint32_t                     _mask;
+        std::atomic<uint32_t>        _enqueue;
+        std::atomic<uint32_t>        _dequeue;
+        std::atomic<int>             _level;
+        BinaryLogSink                _sink;
+        void*                        _sinkData;
+        TaskHandle_t                 _task;
+        std::atomic<bool>            _running;
+        std::atomic<bool>            _alive;
+        std::atomic<uint32_t>        _written;
+        std::atomic<uint32_t>        _dropped;
+    };
+
+} // namespace ESP32_LOG
@@ -0,0 +1,268 @@
+// @file Cbor.hpp
+// @brief Allocation-free CBOR encoder and decoder for telemetry payloads
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+namespace ESP32_MQTT {
+
+    /**
+     * @brief Bump allocator over a caller-provided buffer
+     *
+     * Hands out consecutive regions of one buffer and frees them all at
+     * once with reset(), typically once per publish cycle.
+     */
+    class CborArena {
+    public:
+        /**
+         * @brief Wrap a buffer
+         * @param buffer Backing storage
+         * @param size   Buffer size in bytes
+         */
+        CborArena(void* buffer, size_t size);
+
+        /**
+         * @brief Take a region from the arena
+         * @param size  Bytes needed
+         * @param align Alignment, a power of two
+         * @return Region, or nullptr if the arena is exhausted
+         */
+        uint8_t* allocate(size_t size, size_t align = 1);
+
+        /**
+         * @brief Release every region
+         */
+        void reset();
+
+        /**
+         * @brief Get the bytes handed out so far
+         */
+        size_t used() const;
+
+        /**
+         * @brief Get the arena size
+         */
+        size_t capacity() const;
+
+    private:
+        uint8_t* _buffer;
+        size_t   _size;
+        size_t   _used;
+    };
+
+    /**
+     * @brief CBOR (RFC 8949) encoder writing into a fixed buffer
+     *
+     * Calls chain and never allocate. Running out of room sets a sticky
+     * error, later calls are ignored and ok() returns false, so a record can
+     * be written in full and checked once. Floating-point values are stored
+     * in the shortest of half, single or double precision that keeps them
+     * exact.
+     *
+     * The result publishes through the binary MqttClient::publish overload:
+     * client.publish(topic, writer.span(), qos, retain).
+     */
+    class CborWriter {
+    public:
+        /**
+         * @brief Encode into a buffer
+         * @param buffer Output buffer
+         * @param size   Buffer size in bytes
+         */
+        CborWriter(uint8_t* buffer, size_t size);
+
+        /**
+         * @brief Encode into a region taken from an arena
+         * @param arena Arena to take the region from
+         * @param size  Region size in bytes
+         */
+        CborWriter(CborArena& arena, size_t size);
+
+        CborWriter& unsignedInt(uint64_t value);
+        CborWriter& integer(int64_t value);
+        CborWriter& boolean(bool value);
+        CborWriter& null();
+        CborWriter& floating(double value);
+        CborWriter& text(std::string_view value);
+        CborWriter& bytes(std::span<const uint8_t> value);
+        CborWriter& tag(uint64_t tag);
+
+        /**
+         * @brief Start an array
+         * @param count Number of items, or SIZE_MAX for an indefinite array closed by end()
+         */
+        CborWriter& beginArray(size_t count = SIZE_MAX);
+
+        /**
+         * @brief Start a map
+         * @param pairs Number of key/value pairs, or SIZE_MAX for an indefinite map closed by end()
+         */
+        CborWriter& beginMap(size_t pairs = SIZE_MAX);
+
+        /**
+         * @brief Close an indefinite array or map
+         */
+        CborWriter& end();
+
+        /**
+         * @brief Encode a value, the CBOR type follows the C++ type
+         * @param value Integer, bool, floating-point, string or byte span
+         */
+        template <typename T>
+        CborWriter& value(const T& value) {
+            if constexpr (std::is_same_v<T, bool>) {
+                return boolean(value);
+            } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+                return integer(value);
+            } else if constexpr (std::is_integral_v<T>) {
+                return unsignedInt(value);
+            } else if constexpr (std::is_floating_point_v<T>) {
+                return floating(value);
+            } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+                return text(value);
+            } else {
+                return bytes(std::span<const uint8_t>(value));
+            }
+        }
+
+        /**
+         * @brief Encode a text key followed by its value, for map entries
+         * @param key   Field name
+         * @param value Field value
+         */
+        template <typename T>
+        CborWriter& field(std::string_view key, const T& value) {
+            text(key);
+            return this->value(value);
+        }
+
+        /**
+         * @brief Check that everything written so far fitted
+         */
+        bool ok() const;
+
+        /**
+         * @brief Get the encoded bytes
+         */
+        std::span<const uint8_t> span() const;
+
+        const uint8_t* data() const;
+        size_t size() const;
+
+        /**
+         * @brief Discard the encoded bytes and clear the error
+         */
+        void reset();
+
+    private:
+        void head(uint8_t major, uint64_t value);
+        void put(const void* data, size_t len);
+
+        uint8_t* _buffer;
+        size_t   _size;
+        size_t   _len;
+        bool     _overflow;
+    };
+
+    /**
+     * @brief CBOR data item types
+     */
+    enum class CborType {
+        UNSIGNED,
+        NEGATIVE,
+        BYTES,
+        TEXT,
+        ARRAY,
+        MAP,
+        TAG,
+        BOOL,
+        NUL,
+        UNDEFINED,
+        FLOAT,
+        BREAK,      // End of an indefinite array or map
+        INVALID
+    };
+
+    /**
+     * @brief One decoded CBOR data item
+     */
+    struct CborItem {
+        CborType                 type = CborType::INVALID;
+        uint64_t                 value = 0;          // Integer, container count, tag or length
+        double                   number = 0;         // FLOAT value
+        bool                     indefinite = false; // Container or string with no count
+        std::span<const uint8_t> bytes;              // BYTES and TEXT contents
+    };
+
+    /**
+     * @brief Pull decoder over an encoded buffer
+     *
+     * Reads one item at a time without copying, strings are views into the
+     * input. Containers are not entered automatically: after an ARRAY or MAP
+     * item, its members follow. Meant for tests and host-side tools, and for
+     * small configuration payloads on the device. Indefinite-length strings
+     * are not supported.
+     */
+    class CborReader {
+    public:
+        /**
+         * @brief Decode a buffer
+         * @param data Encoded bytes
+         */
+        explicit CborReader(std::span<const uint8_t> data);
+
+        /**
+         * @brief Read the next item
+         * @param item Set to the decoded item
+         * @return false at the end of the input or on malformed data
+         */
+        bool next(CborItem& item);
+
+        /**
+         * @brief Skip the next item, including everything a container holds
+         * @return false on malformed data
+         */
+        bool skip();
+
+        /**
+         * @brief Read an integer that fits int64_t
+         */
+        bool readInt(int64_t& value);
+
+        /**
+         * @brief Read an unsigned integer
+         */
+        bool readUint(uint64_t& value);
+
+        /**
+         * @brief Read a floating-point value, integers are converted
+         */
+        bool readDouble(double& value);
+
+        bool readBool(bool& value);
+        bool readText(std::string_view& value);
+        bool readBytes(std::span<const uint8_t>& value);
+
+        /**
+         * @brief Check that all input was consumed
+         */
+        bool atEnd() const;
+
+        /**
+         * @brief Get the read position
+         */
+        size_t offset() const;
+
+    private:
+        bool argument(uint8_t info, uint64_t& value);
+        bool skipContents(const CborItem& item, int depth);
+
+        std::span<const uint8_t> _data;
+        size_t                   _pos;
+    };
+
+} // namespace ESP32_MQTT
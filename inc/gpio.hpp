@@ -2,12 +2,28 @@
 // @brief GPIO manager for ESP32 using C++ OOP approach
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <functional>
-#include "driver/gpio.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "gpio_backend.hpp"
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+#include "driver/gpio_filter.h"
+#endif
 
-#define GPIO_NUM_MAX 40 // Maximum GPIO number for ESP32
+#ifndef GPIO_DEBOUNCE_TICK_MS
+#define GPIO_DEBOUNCE_TICK_MS 5 // Resolution of the shared debounce timer wheel
+#endif
+
+#ifndef GPIO_EVENT_QUEUE_LEN
+#define GPIO_EVENT_QUEUE_LEN 32 // Wake pin edges kept until the next batch delivery
+#endif
+
+#ifndef GPIO_DEBOUNCE_WHEEL_SLOTS
+#define GPIO_DEBOUNCE_WHEEL_SLOTS 32 // Buckets in the debounce timer wheel
+#endif
 
 namespace ESP32_GPIO {
 
@@ -50,6 +66,93 @@ namespace ESP32_GPIO {
      */
     using GpioCallback = std::function<void(int gpio_num, int level)>;
 
+    /**
+     * @brief Plain interrupt handler, called straight from the ISR
+     * @param gpio_num The GPIO pin number generating the interrupt
+     * @param level    The logic level of the pin at interrupt
+     * @param arg      User argument given at attach time
+     */
+    using GpioIsrFn = void (*)(int gpio_num, int level, void* arg);
+
+    /**
+     * @brief Declarative description of one pin for batch configuration
+     */
+    struct PinSpec {
+        int              pin;
+        PinMode          mode;
+        bool             pull_up    = false;
+        bool             pull_down  = false;
+        InterruptTrigger intr       = InterruptTrigger::NONE;
+        GpioCallback     callback   = nullptr;
+        bool             open_drain = false;
+        DriveStrength    drive      = DriveStrength::DEFAULT;
+    };
+
+    /**
+     * @brief Interrupt storm protection settings
+     */
+    struct StormGuardConfig {
+        uint32_t max_per_window = 1000;  // Interrupts allowed per pin per window, 0 only measures
+        uint32_t window_ms      = 100;   // Rate measurement window
+        uint32_t cooldown_ms    = 1000;  // Time a masked pin stays masked before it is re-armed
+    };
+
+    /**
+     * @brief Interrupt metrics of one pin
+     */
+    struct PinIrqStats {
+        uint32_t total;         // Interrupts since the counters were reset
+        uint32_t rate_hz;       // Rate over the last window
+        uint32_t peak_rate_hz;  // Highest rate seen
+        uint32_t mask_events;   // Times the storm guard masked the pin
+        bool     masked;        // Interrupt is currently masked
+    };
+
+    /**
+     * @brief Events reported by the debounce service
+     */
+    enum class ButtonEvent {
+        PRESS,
+        RELEASE,
+        LONG_PRESS
+    };
+
+    /**
+     * @brief Callback signature for debounced inputs
+     * @param gpio_num The GPIO pin number of the input
+     * @param event    The debounced event
+     * @note Runs in the esp_timer task, never in ISR context
+     */
+    using ButtonCallback = std::function<void(int gpio_num, ButtonEvent event)>;
+
+    /**
+     * @brief Per-pin debounce settings
+     */
+    struct DebounceConfig {
+        uint32_t stable_ms     = 20;    // Level must be stable this long before it is reported
+        uint32_t long_press_ms = 0;     // Hold time for LONG_PRESS, 0 disables it
+        bool     active_low    = true;  // Pressed level is 0 (button to GND)
+        bool     pull          = true;  // Enable the internal pull toward the released level
+        bool     glitch_filter = true;  // Use the hardware glitch filter when the target has one
+    };
+
+    /**
+     * @brief Edge on a wake pin, queued for batch delivery
+     */
+    struct GpioEvent {
+        int     pin;
+        int     level;    // Level after the edge
+        int64_t time_us;  // Time the edge was seen, from the backend clock
+    };
+
+    /**
+     * @brief Callback receiving queued wake pin edges
+     * @param events Edges in the order they were seen
+     * @param count  Number of edges
+     * @note Runs in the task calling lightSleep() or flushEvents()
+     */
+    using GpioBatchCallback = std::function<void(const GpioEvent* events, size_t count)>;
+
     /**
      * @brief Singleton class to manage GPIO configuration and interrupts
      */
@@ -66,6 +169,18 @@ namespace ESP32_GPIO {
          */
         bool init();
 
+        /**
+         * @brief Replace the hardware backend
+         * @param backend Backend to use, nullptr restores the default one
+         * @note Must be called before init() and before any pin is configured
+         */
+        void setBackend(GpioBackend* backend);
+
+        /**
+         * @brief Get the hardware backend in use
+         */
+        GpioBackend& backend() const;
+
         /**
          * @brief Configure a GPIO pin
          * @param pin         GPIO number
@@ -87,6 +202,27 @@ namespace ESP32_GPIO {
             DriveStrength drive = DriveStrength::DEFAULT
         );
 
+        /**
+         * @brief Configure many pins from a declarative table
+         * @param specs Table of pin descriptions
+         * @param count Number of entries in the table
+         * @return true if all pins were configured
+         * @note Pins with identical settings share one gpio_config call.
+         *       A pin listed twice fails the whole table.
+         *       Drive strength is only set on output pins whose drive is not DEFAULT.
+         */
+        bool configurePins(const PinSpec* specs, size_t count);
+
+        /**
+         * @brief Configure many pins from a declarative table
+         * @param specs Table of pin descriptions
+         * @return true if all pins were configured
+         */
+        template <size_t N>
+        bool configurePins(const PinSpec (&specs)[N]) {
+            return configurePins(specs, N);
+        }
+
         /**
          * @brief Write output level
          * @param pin   GPIO number
@@ -107,6 +243,19 @@ namespace ESP32_GPIO {
          */
         void toggle(int pin);
 
+        /**
+         * @brief Read the input levels of all pins at once
+         * @return Bit n holds the level of GPIO n
+         */
+        uint64_t readPort() const;
+
+        /**
+         * @brief Drive several output pins at once
+         * @param set_mask   Pins driven high
+         * @param clear_mask Pins driven low
+         */
+        void writePort(uint64_t set_mask, uint64_t clear_mask);
+
         /**
          * @brief Reset GPIO pin to default state
          * @param pin GPIO number
@@ -142,6 +291,142 @@ namespace ESP32_GPIO {
          */
         esp_err_t set_isr_handler(void (*fn)(void*), void *arg, int intr_alloc_flags, gpio_isr_handle_t *handle);
 
+        /**
+         * @brief Attach a plain interrupt handler to a pin
+         * @param pin GPIO number, already configured with an interrupt trigger
+         * @param fn  Handler called from the ISR
+         * @param arg User argument passed to the handler
+         * @return true if successful
+         * @note Preferred over GpioCallback in hot paths, no std::function is involved
+         * @note Safe while the pin interrupt is live, the ISR sees either the old
+         *       or the new handler. Returns after the old handler can no longer
+         *       be running, so its argument may be freed. Not callable from an ISR.
+         */
+        bool attachHandler(int pin, GpioIsrFn fn, void* arg);
+
+        /**
+         * @brief Detach the interrupt handler of a pin
+         * @param pin GPIO number
+         * @note Returns after the handler can no longer be running
+         */
+        void detachHandler(int pin);
+
+        /**
+         * @brief Register a debounced input on the shared timer wheel
+         * @param pin      GPIO number
+         * @param config   Debounce settings
+         * @param callback Callback invoked with PRESS, RELEASE and LONG_PRESS events
+         * @return true if successful
+         * @note All debounced pins share a single backend timer
+         */
+        bool addDebouncedPin(int pin, const DebounceConfig& config, ButtonCallback callback);
+
+        /**
+         * @brief Change the stable and long-press times of a debounced input
+         * @param pin           GPIO number
+         * @param stable_ms     Stable time in milliseconds
+         * @param long_press_ms Long-press time in milliseconds, 0 disables it
+         * @return true if the pin is debounced
+         */
+        bool setDebounceTime(int pin, uint32_t stable_ms, uint32_t long_press_ms);
+
+        /**
+         * @brief Remove a debounced input and detach its interrupt
+         * @param pin GPIO number
+         * @return true if the pin was debounced
+         */
+        bool removeDebouncedPin(int pin);
+
+        /**
+         * @brief Get the debounced state of an input
+         * @param pin GPIO number
+         * @return true if the input is currently pressed
+         */
+        bool isPressed(int pin) const;
+
+        /**
+         * @brief Start per-pin interrupt rate measurement and storm protection
+         * @param config Budget, window and cooldown settings
+         * @return true if successful
+         * @note A pin exceeding its budget within one window has its interrupt
+         *       masked and re-armed after the cooldown
+         */
+        bool enableStormGuard(const StormGuardConfig& config);
+
+        /**
+         * @brief Stop storm protection and re-arm every masked pin
+         */
+        void disableStormGuard();
+
+        /**
+         * @brief Override the interrupt budget of one pin
+         * @param pin            GPIO number
+         * @param max_per_window Interrupts allowed per window, 0 uses the default
+         *                       and UINT32_MAX exempts the pin
+         */
+        void setInterruptBudget(int pin, uint32_t max_per_window);
+
+        /**
+         * @brief Get the interrupt metrics of a pin
+         * @param pin   GPIO number
+         * @param stats Output metrics
+         * @return true if the pin number is valid
+         */
+        bool getIrqStats(int pin, PinIrqStats& stats) const;
+
+        /**
+         * @brief Reset the interrupt metrics of a pin
+         * @param pin GPIO number
+         */
+        void resetIrqStats(int pin);
+
+        /**
+         * @brief Register an input as a light-sleep wake source
+         * @param pin       GPIO number
+         * @param pull_up   Enable pull-up
+         * @param pull_down Enable pull-down
+         * @param callback  Called with each queued edge of this pin when the queue is delivered
+         * @return true if successful, false if the pin already has another interrupt handler
+         * @note Edges on wake pins are queued, not delivered one by one
+         */
+        bool enableWakePin(int pin, bool pull_up = false, bool pull_down = false, GpioCallback callback = nullptr);
+
+        /**
+         * @brief Stop using a pin as a wake source and detach its interrupt
+         * @param pin GPIO number
+         */
+        void disableWakePin(int pin);
+
+        /**
+         * @brief Set the callback receiving batches of wake pin edges
+         * @param callback Batch callback, nullptr discards the edges
+         */
+        void setEventBatchCallback(GpioBatchCallback callback);
+
+        /**
+         * @brief Enter light sleep until a wake pin changes or the timeout expires
+         * @param timeout_us Timer wake-up in microseconds, 0 wakes on pins only
+         * @return ESP_OK if the chip slept, error code otherwise
+         * @note Wake levels are armed opposite to the current level of each
+         *       pin. Edges missed while arming or asleep are recovered from
+         *       the levels after wake and everything queued is delivered
+         *       before returning. Pins masked by the storm guard stay masked.
+         */
+        esp_err_t lightSleep(uint64_t timeout_us = 0);
+
+        /**
+         * @brief Deliver the queued wake pin edges
+         * @return Number of edges delivered
+         * @note The batch callback gets the whole queue first, then each pin
+         *       callback gets its own edges in order
+         */
+        size_t flushEvents();
+
+        /**
+         * @brief Get the number of edges dropped because the queue was full
+         */
+        uint32_t getDroppedEvents() const;
+
     private:
         GpioManager();
         ~GpioManager();
@@ -149,17 +434,117 @@ namespace ESP32_GPIO {
         GpioManager& operator=(const GpioManager&) = delete;
 
         static void isrHandler(void* arg);
+        static void callbackTrampoline(int gpio_num, int level, void* arg);
+        static void debounceIsr(int gpio_num, int level, void* arg);
+        static void debounceTimerCb(void* arg);
+        static void monitorTimerCb(void* arg);
+        static void wakeIsr(int gpio_num, int level, void* arg);
+        static gpio_config_t makeConfig(
+            PinMode mode,
+            bool pull_up,
+            bool pull_down,
+            InterruptTrigger intr,
+            bool open_drain
+        );
+
+        /**
+         * Debounce state of one pin, allocated only for debounced pins
+         */
+        struct DebounceState {
+            ButtonCallback cb;
+            uint32_t stable_ticks;
+            uint32_t long_ticks;
+            uint32_t deadline;    // Wheel tick at which the pin is evaluated next
+            uint32_t press_tick;  // Wheel tick at which the press was reported
+            bool     active_low;
+            bool     pressed;
+            bool     long_fired;
+        };
 
-        struct PinConfig {
-            GpioCallback cb;
+        /**
+         * Interrupt counters of one pin, updated from the ISR
+         */
+        struct IrqCounters {
+            std::atomic<uint32_t> total{0};
+            std::atomic<uint32_t> window{0};   // Interrupts in the current window
+            std::atomic<uint32_t> budget{0};   // Per-pin budget, 0 uses the default
+            std::atomic<uint32_t> mask_events{0};
+            std::atomic<bool>     masked{false};
+            uint32_t              rate_hz = 0;
+            uint32_t              peak_rate_hz = 0;
+            int64_t               rearm_at_us = 0;
+        };
+
+        /**
+         * Handler published to the ISR, never modified while published
+         */
+        struct HandlerRecord {
+            GpioIsrFn      fn = nullptr;
+            void*          arg = nullptr;
+            GpioCallback*  owned = nullptr;     // std::function behind callbackTrampoline
         };
 
         /**
-         * Array to store callbacks per pin number
-         * GPIO_NUM_MAX is at least 40
+         * Per-pin slot, allocated the first time a handler is attached.
+         * The ISR receives the slot itself as its argument, so dispatch
+         * is one atomic load and one indirect call through a plain
+         * function pointer. Writers fill the unpublished record, swap the
+         * pointer and wait out a grace period before reusing the old one.
+         */
+        struct PinSlot {
+            std::atomic<HandlerRecord*> handler{nullptr};
+            HandlerRecord  records[2];
+            bool           registered = false;  // Backend ISR handler installed for this pin
+            DebounceState* debounce = nullptr;
+            IrqCounters    irq;
+            int            pin = -1;
+            int            wake_level = -1;     // Last level queued for a wake pin, -1 otherwise
+            GpioCallback   wake_cb;             // Receives the queued edges of a wake pin
+        };
+
+        PinSlot* slotFor(int pin);
+        PinSlot* slotAt(int pin) const;
+        bool swapHandler(int pin, GpioIsrFn fn, void* arg, GpioCallback* owned);
+        void waitForIsrReaders() const;
+        DebounceState* debounceOf(int pin) const;
+        void debounceEdge(int pin);
+        void scheduleDebounce(int pin, uint32_t deadline);
+        void debounceTick();
+        void monitorTick();
+        void pushEvent(int pin, int level);
+
+        /**
+         * Sparse slot table sized for the target, unused pins cost one pointer.
+         * A slot is installed once by slotFor() and lives until the manager goes.
          */
-        PinConfig _configs[GPIO_NUM_MAX];
+        std::atomic<PinSlot*> _slots[SOC_GPIO_PIN_COUNT];
+        GpioBackend* _backend;
         bool _initialized;
+
+        SemaphoreHandle_t     _handlerMutex;                    // Serializes handler swaps
+        std::atomic<uint32_t> _isrEpoch[portNUM_PROCESSORS];    // Odd while a core dispatches a handler
+
+        uint64_t           _wheel[GPIO_DEBOUNCE_WHEEL_SLOTS]; // Pin bitmask per bucket
+        uint32_t           _wheelTick;
+        size_t             _debouncedPins;
+        GpioTimerHandle    _debounceTimer;
+        SemaphoreHandle_t  _debounceMutex;
+        portMUX_TYPE       _debounceLock;
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+        gpio_glitch_filter_handle_t _glitchFilters[SOC_GPIO_PIN_COUNT];
+#endif
+
+        StormGuardConfig   _stormConfig;
+        std::atomic<bool>  _stormGuard;
+        GpioTimerHandle    _monitorTimer;
+
+        GpioEvent          _events[GPIO_EVENT_QUEUE_LEN]; // Ring of queued wake pin edges
+        size_t             _eventHead;
+        size_t             _eventCount;
+        uint32_t           _eventsDropped;
+        portMUX_TYPE       _eventLock;
+        uint64_t           _wakePins;
+        GpioBatchCallback  _batchCallback;
     };
 
     // C wrappers for C compatibility or interfacing with C code
@@ -173,6 +558,24 @@ namespace ESP32_GPIO {
             bool pull_down,
             int intr_type
         );
+
+        /**
+         * @brief C view of PinSpec for table-driven configuration
+         */
+        typedef struct {
+            int  pin;
+            int  mode;
+            bool pull_up;
+            bool pull_down;
+            int  intr_type;
+            bool open_drain;
+            int  drive;
+        } gpio_mgr_pin_spec_t;
+
+        int gpio_mgr_configure_table(
+            const gpio_mgr_pin_spec_t* specs,
+            size_t count
+        );
         void gpio_mgr_set_level(
             int pin, 
             int level
@@ -192,6 +595,66 @@ namespace ESP32_GPIO {
             int intr_alloc_flags, 
             gpio_isr_handle_t *handle
         );
+
+        /**
+         * @brief C callback for debounced inputs
+         * @param pin   GPIO number
+         * @param event 0 = press, 1 = release, 2 = long press
+         * @param arg   User argument
+         */
+        typedef void (*gpio_mgr_button_cb_t)(int pin, int event, void* arg);
+
+        int gpio_mgr_add_debounce(
+            int pin,
+            uint32_t stable_ms,
+            uint32_t long_press_ms,
+            bool active_low,
+            gpio_mgr_button_cb_t cb,
+            void* arg
+        );
+        int gpio_mgr_remove_debounce(int pin);
+        int gpio_mgr_enable_storm_guard(
+            uint32_t max_per_window,
+            uint32_t window_ms,
+            uint32_t cooldown_ms
+        );
+        void gpio_mgr_disable_storm_guard(void);
+        int gpio_mgr_get_irq_stats(
+            int pin,
+            uint32_t* total,
+            uint32_t* rate_hz,
+            uint32_t* mask_events
+        );
+
+        /**
+         * @brief C view of GpioEvent
+         */
+        typedef struct {
+            int     pin;
+            int     level;
+            int64_t time_us;
+        } gpio_mgr_event_t;
+
+        /**
+         * @brief C callback receiving batches of wake pin edges
+         * @param events Edges in the order they were seen
+         * @param count  Number of edges
+         * @param arg    User argument
+         */
+        typedef void (*gpio_mgr_batch_cb_t)(const gpio_mgr_event_t* events, size_t count, void* arg);
+
+        int gpio_mgr_enable_wake_pin(
+            int pin,
+            bool pull_up,
+            bool pull_down
+        );
+        void gpio_mgr_disable_wake_pin(int pin);
+        void gpio_mgr_set_batch_cb(
+            gpio_mgr_batch_cb_t cb,
+            void* arg
+        );
+        int gpio_mgr_light_sleep(uint64_t timeout_us);
+        size_t gpio_mgr_flush_events(void);
     }
 
 } // namespace ESP32_GPIO
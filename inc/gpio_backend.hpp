@@ -0,0 +1,159 @@
+// @file GpioBackend.hpp
+// @brief Hardware backend interface used by GpioManager
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+// Host builds have no GPIO driver, mirror the driver types used by GpioManager
+#ifndef SOC_GPIO_PIN_COUNT
+#define SOC_GPIO_PIN_COUNT 64
+#endif
+
+typedef enum {
+    GPIO_MODE_DISABLE         = 0,
+    GPIO_MODE_INPUT           = 1,
+    GPIO_MODE_OUTPUT          = 2,
+    GPIO_MODE_OUTPUT_OD       = 6,
+    GPIO_MODE_INPUT_OUTPUT_OD = 7,
+    GPIO_MODE_INPUT_OUTPUT    = 3
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE    = 0,
+    GPIO_INTR_POSEDGE    = 1,
+    GPIO_INTR_NEGEDGE    = 2,
+    GPIO_INTR_ANYEDGE    = 3,
+    GPIO_INTR_LOW_LEVEL  = 4,
+    GPIO_INTR_HIGH_LEVEL = 5
+} gpio_int_type_t;
+
+typedef enum { GPIO_PULLUP_DISABLE = 0, GPIO_PULLUP_ENABLE = 1 } gpio_pullup_t;
+typedef enum { GPIO_PULLDOWN_DISABLE = 0, GPIO_PULLDOWN_ENABLE = 1 } gpio_pulldown_t;
+
+typedef enum {
+    GPIO_DRIVE_CAP_0       = 0,
+    GPIO_DRIVE_CAP_1       = 1,
+    GPIO_DRIVE_CAP_2       = 2,
+    GPIO_DRIVE_CAP_DEFAULT = 2,
+    GPIO_DRIVE_CAP_3       = 3
+} gpio_drive_cap_t;
+
+typedef int gpio_num_t;
+
+typedef struct {
+    uint64_t        pin_bit_mask;
+    gpio_mode_t     mode;
+    gpio_pullup_t   pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void* arg);
+typedef struct gpio_isr_handle_host* gpio_isr_handle_t;
+#else
+#include "driver/gpio.h"
+#include "soc/soc_caps.h"
+#endif
+
+namespace ESP32_GPIO {
+
+    /**
+     * @brief Opaque timer handle returned by a backend
+     */
+    using GpioTimerHandle = void*;
+
+    /**
+     * @brief Timer callback signature
+     * @param arg User argument given at creation time
+     */
+    using GpioTimerFn = void (*)(void* arg);
+
+    /**
+     * @brief Everything GpioManager and the GPIO services need from the hardware
+     *
+     * The default backend forwards to the ESP-IDF GPIO driver and esp_timer.
+     * Host builds use HostGpioBackend, which simulates pins and time.
+     */
+    class GpioBackend {
+    public:
+        virtual ~GpioBackend() = default;
+
+        // Pins
+        virtual esp_err_t configure(const gpio_config_t& config) = 0;
+        virtual esp_err_t resetPin(int pin) = 0;
+        virtual esp_err_t setLevel(int pin, uint32_t level) = 0;
+        virtual int       getLevel(int pin) = 0;
+        virtual esp_err_t setDriveStrength(int pin, gpio_drive_cap_t strength) = 0;
+        virtual uint64_t  readPort() = 0;
+        virtual void      writePort(uint64_t set_mask, uint64_t clear_mask) = 0;
+
+        // Interrupts
+        virtual esp_err_t installIsrService(int intr_alloc_flags) = 0;
+        virtual void      uninstallIsrService() = 0;
+        virtual esp_err_t addIsrHandler(int pin, gpio_isr_t fn, void* arg) = 0;
+        virtual esp_err_t removeIsrHandler(int pin) = 0;
+        virtual esp_err_t setIntrType(int pin, gpio_int_type_t type) = 0;
+        virtual esp_err_t enableIntr(int pin) = 0;
+        virtual esp_err_t disableIntr(int pin) = 0;
+
+        // Light sleep, wake levels are GPIO_INTR_LOW_LEVEL or GPIO_INTR_HIGH_LEVEL
+        virtual esp_err_t enableWakeup(int pin, gpio_int_type_t level) = 0;
+        virtual esp_err_t disableWakeup(int pin) = 0;
+        virtual esp_err_t lightSleep(uint64_t timeout_us) = 0;
+
+        // Time and timers, callbacks run in task context
+        virtual int64_t   nowUs() = 0;
+        virtual esp_err_t createTimer(GpioTimerFn fn, void* arg, const char* name, GpioTimerHandle* out) = 0;
+        virtual esp_err_t startTimerPeriodic(GpioTimerHandle timer, uint64_t period_us) = 0;
+        virtual esp_err_t startTimerOnce(GpioTimerHandle timer, uint64_t timeout_us) = 0;
+        virtual esp_err_t stopTimer(GpioTimerHandle timer) = 0;
+        virtual esp_err_t deleteTimer(GpioTimerHandle timer) = 0;
+        virtual bool      isTimerActive(GpioTimerHandle timer) = 0;
+    };
+
+    /**
+     * @brief Backend used by GpioManager until another one is installed
+     * @return Esp32GpioBackend on targets, HostGpioBackend on Linux hosts
+     */
+    GpioBackend& defaultGpioBackend();
+
+#if !CONFIG_IDF_TARGET_LINUX
+    /**
+     * @brief Backend forwarding to the ESP-IDF GPIO driver and esp_timer
+     */
+    class Esp32GpioBackend : public GpioBackend {
+    public:
+        esp_err_t configure(const gpio_config_t& config) override;
+        esp_err_t resetPin(int pin) override;
+        esp_err_t setLevel(int pin, uint32_t level) override;
+        int       getLevel(int pin) override;
+        esp_err_t setDriveStrength(int pin, gpio_drive_cap_t strength) override;
+        uint64_t  readPort() override;
+        void      writePort(uint64_t set_mask, uint64_t clear_mask) override;
+
+        esp_err_t installIsrService(int intr_alloc_flags) override;
+        void      uninstallIsrService() override;
+        esp_err_t addIsrHandler(int pin, gpio_isr_t fn, void* arg) override;
+        esp_err_t removeIsrHandler(int pin) override;
+        esp_err_t setIntrType(int pin, gpio_int_type_t type) override;
+        esp_err_t enableIntr(int pin) override;
+        esp_err_t disableIntr(int pin) override;
+
+        esp_err_t enableWakeup(int pin, gpio_int_type_t level) override;
+        esp_err_t disableWakeup(int pin) override;
+        esp_err_t lightSleep(uint64_t timeout_us) override;
+
+        int64_t   nowUs() override;
+        esp_err_t createTimer(GpioTimerFn fn, void* arg, const char* name, GpioTimerHandle* out) override;
+        esp_err_t startTimerPeriodic(GpioTimerHandle timer, uint64_t period_us) override;
+        esp_err_t startTimerOnce(GpioTimerHandle timer, uint64_t timeout_us) override;
+        esp_err_t stopTimer(GpioTimerHandle timer) override;
+        esp_err_t deleteTimer(GpioTimerHandle timer) override;
+        bool      isTimerActive(GpioTimerHandle timer) override;
+    };
+#endif
+
+} // namespace ESP32_GPIO
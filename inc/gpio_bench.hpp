@@ -0,0 +1,120 @@
+// @file GpioLatencyBench.hpp
+// @brief GPIO interrupt latency benchmark using a loopback pin pair
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "gpio.hpp"
+
+namespace ESP32_GPIO {
+
+    /**
+     * @brief Background load applied while the benchmark runs
+     */
+    struct BenchLoadConfig {
+        uint8_t     cpu_tasks     = 0;             // Busy-loop tasks, spread over both cores
+        uint8_t     cpu_duty_pct  = 50;            // Busy share of every 10 ms period
+        UBaseType_t cpu_priority  = 5;             // Priority of the busy-loop tasks
+        uint32_t    mqtt_rate_hz  = 0;             // Background MQTT publishes per second, 0 disables
+        size_t      mqtt_payload  = 128;           // Payload size of each background publish
+        const char* mqtt_topic    = "bench/load";  // Topic of the background publishes
+    };
+
+    /**
+     * @brief Benchmark settings
+     */
+    struct BenchConfig {
+        int             out_pin;                  // Output pin driving the edge
+        int             in_pin;                   // Input pin wired back to out_pin
+        uint32_t        samples       = 1000;     // Edges measured per dispatch path
+        uint32_t        interval_ms   = 10;       // Gap between two edges
+        UBaseType_t     task_priority = configMAX_PRIORITIES - 2; // Deferred dispatch task priority
+        BenchLoadConfig load;
+    };
+
+    /**
+     * @brief Latency distribution of one dispatch path
+     */
+    struct LatencyStats {
+        uint32_t samples;   // Edges measured
+        uint32_t lost;      // Edges without a timestamp (timeout or other core)
+        float    min_us;
+        float    p50_us;
+        float    p90_us;
+        float    p99_us;
+        float    p999_us;
+        float    max_us;
+    };
+
+    /**
+     * @brief Results of a benchmark run
+     */
+    struct BenchResult {
+        LatencyStats edge_to_isr;       // Edge to the GPIO ISR service handler
+        LatencyStats edge_to_callback;  // Edge to a GpioManager handler (direct dispatch)
+        LatencyStats edge_to_task;      // Edge to a task woken from a GpioManager handler
+    };
+
+    /**
+     * @brief Measures edge-to-ISR and edge-to-callback latency on a loopback pair
+     *
+     * Timestamps are CPU cycle counts, which are per core. run() must be called
+     * from a task pinned to the core on which GpioManager::init() installed the
+     * ISR service; samples taken on the other core are counted as lost.
+     */
+    class GpioLatencyBench {
+    public:
+        explicit GpioLatencyBench(const BenchConfig& config);
+        ~GpioLatencyBench();
+
+        /**
+         * @brief Run all dispatch paths under the configured load
+         * @param result Output latency distributions
+         * @return true if the pins could be configured
+         */
+        bool run(BenchResult& result);
+
+        /**
+         * @brief Log a percentile table of a result
+         * @param result Benchmark result
+         */
+        static void printTable(const BenchResult& result);
+
+    private:
+        GpioLatencyBench(const GpioLatencyBench&) = delete;
+        GpioLatencyBench& operator=(const GpioLatencyBench&) = delete;
+
+        enum class Path {
+            RAW_ISR,
+            DIRECT,
+            DEFERRED
+        };
+
+        bool measure(Path path, LatencyStats& stats);
+        void startLoad();
+        void stopLoad();
+        void stamp();
+        static LatencyStats summarize(std::vector<uint32_t>& cycles, uint32_t lost);
+
+        static void rawIsr(void* arg);
+        static void directIsr(int gpio_num, int level, void* arg);
+        static void deferredIsr(int gpio_num, int level, void* arg);
+        static void deferredTask(void* arg);
+        static void cpuLoadTask(void* arg);
+        static void mqttLoadTask(void* arg);
+
+        BenchConfig               _config;
+        TaskHandle_t              _waiter;        // Task waiting for the current edge
+        TaskHandle_t              _deferred;
+        QueueHandle_t             _queue;         // Edge notifications for the deferred path
+        volatile uint32_t         _stampCycles;
+        volatile int              _stampCore;
+        std::atomic<bool>         _loadRunning;
+        std::atomic<uint32_t>     _loadAlive;     // Load tasks that have not exited yet
+    };
+
+} // namespace ESP32_GPIO
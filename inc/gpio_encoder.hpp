@@ -0,0 +1,186 @@
+// @file QuadratureEncoder.hpp
+// @brief Quadrature encoder decoder built on GpioManager
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "gpio.hpp"
+#if SOC_PCNT_SUPPORTED
+#include "driver/pulse_cnt.h"
+#endif
+
+namespace ESP32_GPIO {
+
+    /**
+     * @brief Quadrature encoder settings
+     */
+    struct EncoderConfig {
+        int      pin_a;
+        int      pin_b;
+        bool     pull_up            = true;   // Enable internal pull-ups on both channels
+        bool     use_pcnt           = true;   // Use PCNT when the target has one
+        uint32_t glitch_ns          = 1000;   // PCNT glitch filter width, 0 disables it
+        uint32_t velocity_period_ms = 10;     // Velocity sampling period, 0 disables velocity
+        float    velocity_smoothing = 0.25f;  // Weight of the newest velocity sample (0..1]
+    };
+
+    /**
+     * @brief 64-bit counter with a single writer and lock-free readers
+     *
+     * The writer bumps the sequence to an odd value, updates both halves and
+     * bumps it back to even. Readers retry until they observe a stable even
+     * sequence, so a torn value is never returned.
+     */
+    class SeqCounter64 {
+    public:
+        int64_t load() const {
+            uint32_t seq0, seq1, lo, hi;
+            do {
+                seq0 = _seq.load(std::memory_order_acquire);
+                lo = _lo.load(std::memory_order_relaxed);
+                hi = _hi.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                seq1 = _seq.load(std::memory_order_relaxed);
+            } while ((seq0 & 1) || seq0 != seq1);
+            return static_cast<int64_t>((static_cast<uint64_t>(hi) << 32) | lo);
+        }
+
+        void store(int64_t value) {
+            begin();
+            commit(value);
+        }
+
+        void add(int64_t delta) {
+            store(static_cast<int64_t>(static_cast<uint64_t>(raw()) + static_cast<uint64_t>(delta)));
+        }
+
+        /**
+         * Open a write, readers retry until commit(). State kept next to
+         * the counter may be changed in between and read under sequence().
+         */
+        void begin() {
+            _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        void commit(int64_t value) {
+            _lo.store(static_cast<uint32_t>(value), std::memory_order_relaxed);
+            _hi.store(static_cast<uint32_t>(static_cast<uint64_t>(value) >> 32), std::memory_order_relaxed);
+            _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /**
+         * Current value, for the writer only
+         */
+        int64_t raw() const {
+            return static_cast<int64_t>((static_cast<uint64_t>(_hi.load(std::memory_order_relaxed)) << 32)
+                                        | _lo.load(std::memory_order_relaxed));
+        }
+
+        /**
+         * Write sequence, odd while a write is open
+         */
+        uint32_t sequence() const {
+            return _seq.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::atomic<uint32_t> _seq{0};
+        std::atomic<uint32_t> _lo{0};
+        std::atomic<uint32_t> _hi{0};
+    };
+
+    /**
+     * @brief 4x quadrature decoder with 64-bit position and velocity estimate
+     *
+     * Counting is done by PCNT where available. The driver accumulates the
+     * 16-bit hardware counter across its limits (accum_count) into a 32-bit
+     * sum, and every limit event folds that sum into the 64-bit position.
+     * Reads add the change of the sum since the last fold, so the position
+     * stays right while a fold is pending and across the 32-bit wrap.
+     * Otherwise both channels are decoded in the GpioManager ISR with a
+     * transition table.
+     * getPosition() and getVelocity() are lock-free and may be called from
+     * any task.
+     */
+    class QuadratureEncoder {
+    public:
+        QuadratureEncoder();
+        ~QuadratureEncoder();
+
+        /**
+         * @brief Configure the channels and start counting
+         * @param config Encoder settings
+         * @return true if successful
+         */
+        bool init(const EncoderConfig& config);
+
+        /**
+         * @brief Stop counting and release the channels
+         */
+        void deinit();
+
+        /**
+         * @brief Get the current position
+         * @return Position in quadrature counts (4 per encoder line)
+         */
+        int64_t getPosition() const;
+
+        /**
+         * @brief Get the smoothed velocity
+         * @return Velocity in counts per second
+         */
+        float getVelocity() const;
+
+        /**
+         * @brief Set the current position
+         * @param position New position in counts
+         */
+        void setPosition(int64_t position = 0);
+
+        /**
+         * @brief Get the number of invalid transitions seen by the ISR decoder
+         * @return Transitions where both channels changed at once
+         */
+        uint32_t getErrorCount() const;
+
+        /**
+         * @brief Check which counting backend is in use
+         * @return true if PCNT counts the channels
+         */
+        bool usesPcnt() const;
+
+    private:
+        QuadratureEncoder(const QuadratureEncoder&) = delete;
+        QuadratureEncoder& operator=(const QuadratureEncoder&) = delete;
+
+        bool initPcnt();
+        bool initIsr();
+        void decodeEdge();
+        static void edgeIsr(int gpio_num, int level, void* arg);
+        static void velocityTimerCb(void* arg);
+#if SOC_PCNT_SUPPORTED
+        static bool pcntReachCb(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t* edata, void* user_ctx);
+#endif
+
+        EncoderConfig         _config;
+        SeqCounter64          _base;        // PCNT: position at the last fold, ISR: full position
+        std::atomic<uint32_t> _foldedCount; // PCNT: driver sum at the last fold, written under _base's sequence
+        std::atomic<float>    _velocity;
+        std::atomic<uint32_t> _errors;
+        uint8_t               _state;       // Last A/B levels seen by the ISR decoder
+        int64_t               _lastPosition;
+        int64_t               _lastSampleUs;
+        GpioTimerHandle       _velocityTimer;
+        portMUX_TYPE          _lock;
+        bool                  _running;
+        bool                  _usePcnt;
+#if SOC_PCNT_SUPPORTED
+        pcnt_unit_handle_t    _unit;
+        pcnt_channel_handle_t _chanA;
+        pcnt_channel_handle_t _chanB;
+#endif
+    };
+
+} // namespace ESP32_GPIO
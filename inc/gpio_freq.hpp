@@ -0,0 +1,150 @@
+// @file FrequencyCounter.hpp
+// @brief Frequency and tachometer measurement on GPIO inputs
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "gpio.hpp"
+#if SOC_PCNT_SUPPORTED
+#include "driver/pulse_cnt.h"
+#endif
+
+#ifndef GPIO_FREQ_MAX_CHANNELS
+#define GPIO_FREQ_MAX_CHANNELS 8 // Pins measured by one FrequencyCounter
+#endif
+
+namespace ESP32_GPIO {
+
+    /**
+     * @brief Measurement method of a channel
+     */
+    enum class FreqMethod {
+        COUNT,   // Edges counted by PCNT over the gate time, no interrupts
+        PERIOD   // Edges timestamped in the ISR, frequency from the mean period
+    };
+
+    /**
+     * @brief Frequency counter settings
+     *
+     * Counting resolves one edge per gate, so it is accurate at high rates.
+     * Timing periods resolves one microsecond per period, so it is accurate
+     * at low rates but costs one interrupt per edge. Channels switch between
+     * the two with hysteresis on the number of edges seen per gate.
+     */
+    struct FreqConfig {
+        uint32_t gate_ms      = 100;   // Gate time, one reading per channel per gate
+        uint32_t timeout_ms   = 1000;  // No edge for this long reads as 0 Hz
+        uint32_t period_below = 100;   // Edges per gate under which PERIOD is used
+        uint32_t count_above  = 1000;  // Edges per gate over which COUNT is used again
+        uint32_t glitch_ns    = 0;     // PCNT glitch filter width, 0 disables it
+        bool     use_pcnt     = true;  // Use PCNT when the target has a free unit
+    };
+
+    /**
+     * @brief Latest reading of a channel
+     */
+    struct FreqReading {
+        float      hz;
+        FreqMethod method;
+        uint32_t   edges;    // Edges seen in the last gate
+    };
+
+    /**
+     * @brief Multi-pin frequency counter driven by one gate timer
+     *
+     * Pins without a PCNT unit always use the PERIOD method.
+     */
+    class FrequencyCounter {
+    public:
+        FrequencyCounter();
+        ~FrequencyCounter();
+
+        /**
+         * @brief Start the gate timer
+         * @param config Counter settings
+         * @return true if successful
+         */
+        bool start(const FreqConfig& config = FreqConfig());
+
+        /**
+         * @brief Stop the gate timer and release every pin
+         */
+        void stop();
+
+        /**
+         * @brief Start measuring a pin
+         * @param pin       GPIO number
+         * @param pull_up   Enable pull-up
+         * @param pull_down Enable pull-down
+         * @return true if successful
+         */
+        bool addPin(int pin, bool pull_up = false, bool pull_down = false);
+
+        /**
+         * @brief Stop measuring a pin
+         * @param pin GPIO number
+         */
+        void removePin(int pin);
+
+        /**
+         * @brief Get the frequency of a pin
+         * @param pin GPIO number
+         * @return Frequency in Hz, 0 if the pin is not measured
+         */
+        float getFrequency(int pin) const;
+
+        /**
+         * @brief Get the latest reading of a pin
+         * @param pin     GPIO number
+         * @param reading Output reading
+         * @return true if the pin is measured
+         */
+        bool getReading(int pin, FreqReading& reading) const;
+
+    private:
+        FrequencyCounter(const FrequencyCounter&) = delete;
+        FrequencyCounter& operator=(const FrequencyCounter&) = delete;
+
+        struct Channel {
+            int                 pin = -1;
+            FreqMethod          method = FreqMethod::PERIOD;
+            bool                has_pcnt = false;
+            uint32_t            last_count = 0;    // PCNT sum at the previous gate, wraps at 32 bits
+            int64_t             last_gate_us = 0;
+            int64_t             ref_us = -1;       // Edge the next PERIOD span starts from, -1 if none
+            // Updated from the edge ISR, guarded by lock
+            portMUX_TYPE        lock;
+            uint32_t            edges = 0;         // Edges timestamped in this gate
+            int64_t             first_us = 0;
+            int64_t             last_us = 0;       // Last edge ever seen
+            // Published reading
+            std::atomic<float>  hz{0.0f};
+            std::atomic<uint32_t> gate_edges{0};
+            std::atomic<uint8_t>  reported{0};
+#if SOC_PCNT_SUPPORTED
+            pcnt_unit_handle_t    unit = nullptr;
+            pcnt_channel_handle_t chan = nullptr;
+#endif
+        };
+
+        static void gateTimerCb(void* arg);
+        static void edgeIsr(int gpio_num, int level, void* arg);
+#if SOC_PCNT_SUPPORTED
+        bool initPcnt(Channel& ch);
+        uint32_t readPcnt(Channel& ch);
+#endif
+        void gate();
+        void measure(Channel& ch, int64_t now);
+        void setMethod(Channel& ch, FreqMethod method);
+        void release(Channel& ch);
+        Channel* find(int pin) const;
+
+        Channel           _channels[GPIO_FREQ_MAX_CHANNELS];
+        FreqConfig        _config;
+        GpioTimerHandle   _timer;
+        SemaphoreHandle_t _mutex;
+    };
+
+} // namespace ESP32_GPIO
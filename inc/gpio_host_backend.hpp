@@ -0,0 +1,184 @@
+// @file HostGpioBackend.hpp
+// @brief Simulated GPIO backend for Linux host builds
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "gpio_backend.hpp"
+
+namespace ESP32_GPIO {
+
+    /**
+     * @brief One recorded backend call or injected edge
+     */
+    struct HostGpioRecord {
+        enum class Op : uint8_t {
+            SET_LEVEL,
+            GET_LEVEL,
+            EDGE,       // Level change injected from a trace or injectEdge()
+            PORT_READ,
+            PORT_SET,   // writePort() set mask, always followed by PORT_CLEAR
+            PORT_CLEAR, // writePort() clear mask
+            SLEEP,      // Light sleep entered, value is the requested timeout
+            WAKE        // Light sleep left, pin is the wake pin or -1 for the timeout
+        };
+
+        int64_t  time_us;
+        Op       op;
+        int      pin;     // -1 for port operations
+        uint64_t value;   // Level, or the port mask
+    };
+
+    /**
+     * @brief GPIO backend simulating pins, interrupts and time on a Linux host
+     *
+     * Time is virtual and only advances in runUntil()/runAll(), which deliver
+     * traced edges and timer callbacks in timestamp order on the calling
+     * thread. Interrupt handlers run synchronously when a pin level changes
+     * and the configured trigger matches. Every setLevel/getLevel and port
+     * call is recorded with its virtual timestamp.
+     *
+     * lightSleep() skips virtual time to the first queued edge that meets a
+     * wake level, or to the timeout, without running timers in between.
+     *
+     * Trace files hold one "time_us pin level" triple per line, lines
+     * starting with '#' are ignored.
+     */
+    class HostGpioBackend : public GpioBackend {
+    public:
+        HostGpioBackend();
+        ~HostGpioBackend() override;
+
+        /**
+         * @brief Queue the edges of a trace file
+         * @param path      Trace file path
+         * @param offset_us Added to every timestamp, to replay a trace from the current time
+         * @return Number of edges queued, -1 if the file could not be read
+         */
+        int loadTrace(const std::string& path, int64_t offset_us = 0);
+
+        /**
+         * @brief Queue a single level change
+         * @param time_us Virtual time of the change
+         * @param pin     GPIO number
+         * @param level   New level
+         */
+        void injectEdge(int64_t time_us, int pin, int level);
+
+        /**
+         * @brief Deliver edges and timers up to a point in virtual time
+         * @param time_us Virtual time to advance to
+         */
+        void runUntil(int64_t time_us);
+
+        /**
+         * @brief Advance virtual time by an interval
+         * @param delta_us Interval in microseconds
+         */
+        void advance(int64_t delta_us);
+
+        /**
+         * @brief Deliver every queued edge, timers run up to the last one
+         */
+        void runAll();
+
+        /**
+         * @brief Wire an output pin to an input pin
+         * @param out Output pin
+         * @param in  Input pin following the level of out
+         */
+        void loopback(int out, int in);
+
+        /**
+         * @brief Get the recorded calls
+         */
+        std::vector<HostGpioRecord> records() const;
+
+        /**
+         * @brief Drop all recorded calls
+         */
+        void clearRecords();
+
+        /**
+         * @brief Write the recorded calls as "time_us OP pin value" lines
+         * @param path Output file path
+         * @return true if the file was written
+         */
+        bool saveRecords(const std::string& path) const;
+
+        esp_err_t configure(const gpio_config_t& config) override;
+        esp_err_t resetPin(int pin) override;
+        esp_err_t setLevel(int pin, uint32_t level) override;
+        int       getLevel(int pin) override;
+        esp_err_t setDriveStrength(int pin, gpio_drive_cap_t strength) override;
+        uint64_t  readPort() override;
+        void      writePort(uint64_t set_mask, uint64_t clear_mask) override;
+
+        esp_err_t installIsrService(int intr_alloc_flags) override;
+        void      uninstallIsrService() override;
+        esp_err_t addIsrHandler(int pin, gpio_isr_t fn, void* arg) override;
+        esp_err_t removeIsrHandler(int pin) override;
+        esp_err_t setIntrType(int pin, gpio_int_type_t type) override;
+        esp_err_t enableIntr(int pin) override;
+        esp_err_t disableIntr(int pin) override;
+
+        esp_err_t enableWakeup(int pin, gpio_int_type_t level) override;
+        esp_err_t disableWakeup(int pin) override;
+        esp_err_t lightSleep(uint64_t timeout_us) override;
+
+        int64_t   nowUs() override;
+        esp_err_t createTimer(GpioTimerFn fn, void* arg, const char* name, GpioTimerHandle* out) override;
+        esp_err_t startTimerPeriodic(GpioTimerHandle timer, uint64_t period_us) override;
+        esp_err_t startTimerOnce(GpioTimerHandle timer, uint64_t timeout_us) override;
+        esp_err_t stopTimer(GpioTimerHandle timer) override;
+        esp_err_t deleteTimer(GpioTimerHandle timer) override;
+        bool      isTimerActive(GpioTimerHandle timer) override;
+
+    private:
+        HostGpioBackend(const HostGpioBackend&) = delete;
+        HostGpioBackend& operator=(const HostGpioBackend&) = delete;
+
+        struct Pin {
+            gpio_mode_t     mode = GPIO_MODE_DISABLE;
+            gpio_int_type_t intr = GPIO_INTR_DISABLE;
+            gpio_isr_t      fn = nullptr;
+            void*           arg = nullptr;
+            int             level = 0;
+            gpio_int_type_t wake = GPIO_INTR_DISABLE;
+            int             loopback = -1;   // Input pin following this one
+            bool            intr_enabled = false;
+        };
+
+        struct Edge {
+            int64_t time_us;
+            int     pin;
+            int     level;
+        };
+
+        struct Timer {
+            GpioTimerFn fn;
+            void*       arg;
+            const char* name;
+            uint64_t    period_us;   // 0 for one-shot
+            int64_t     due_us;
+            bool        active;
+        };
+
+        bool validPin(int pin) const;
+        void record(HostGpioRecord::Op op, int pin, uint64_t value);
+        void changeLevel(int pin, int level, std::unique_lock<std::recursive_mutex>& lock);
+        bool nextDue(int64_t limit, int64_t& due);
+
+        mutable std::recursive_mutex _mutex;
+        Pin                          _pins[SOC_GPIO_PIN_COUNT];
+        std::list<Edge>              _edges;    // Pending edges ordered by time
+        std::list<Timer>             _timers;
+        std::vector<HostGpioRecord>  _records;
+        int64_t                      _now;
+        bool                         _isrService;
+    };
+
+} // namespace ESP32_GPIO
@@ -0,0 +1,136 @@
+// @file KeypadScanner.hpp
+// @brief Timer-driven matrix keypad scanner using whole-port GPIO access
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "gpio.hpp"
+
+#ifndef GPIO_KEYPAD_MAX_ROWS
+#define GPIO_KEYPAD_MAX_ROWS 16 // Driven lines of the matrix
+#endif
+
+#ifndef GPIO_KEYPAD_MAX_COLS
+#define GPIO_KEYPAD_MAX_COLS 32 // Sensed lines of the matrix, one bit each in a row word
+#endif
+
+namespace ESP32_GPIO {
+
+    /**
+     * @brief Key matrix settings
+     *
+     * Rows are open-drain outputs pulled low one at a time, columns are
+     * inputs with pull-ups, so a pressed key reads low on its column.
+     */
+    struct KeypadConfig {
+        const int* row_pins;
+        size_t     num_rows;
+        const int* col_pins;
+        size_t     num_cols;
+        uint32_t   scan_period_ms = 5;      // Time between two full scans
+        uint8_t    debounce_scans = 3;      // Scans a row must read the same before it is reported
+        uint32_t   settle_us      = 2;      // Wait between driving a row and reading the columns
+        bool       diodes         = false;  // Matrix has a diode per key, ghosting cannot occur
+        size_t     queue_len      = 16;     // Depth of the key event queue
+    };
+
+    /**
+     * @brief Key state change reported by the scanner
+     */
+    struct KeyEvent {
+        uint8_t row;
+        uint8_t col;
+        bool    pressed;
+        int64_t time_us;
+    };
+
+    /**
+     * @brief Scan statistics
+     */
+    struct KeypadStats {
+        uint32_t scans;          // Full scans performed
+        uint32_t ghost_scans;    // Scans in which ghosting suppressed at least one key
+        uint32_t dropped_events; // Events lost because the queue was full
+    };
+
+    /**
+     * @brief N-key rollover matrix scanner with ghost detection
+     *
+     * Every scan drives each row with one port write and samples all
+     * columns with one port read, from a single periodic backend timer.
+     * Without diodes, a key that completes a rectangle of pressed keys
+     * cannot be told apart from a ghost; such keys are not reported as
+     * pressed until the ambiguity clears.
+     */
+    class KeypadScanner {
+    public:
+        KeypadScanner();
+        ~KeypadScanner();
+
+        /**
+         * @brief Configure the matrix pins and start scanning
+         * @param config Matrix settings
+         * @return true if successful
+         */
+        bool start(const KeypadConfig& config);
+
+        /**
+         * @brief Stop scanning and release the pins
+         */
+        void stop();
+
+        /**
+         * @brief Wait for the next key event
+         * @param event   Output event
+         * @param timeout Maximum wait in ticks
+         * @return true if an event was received
+         */
+        bool waitEvent(KeyEvent& event, TickType_t timeout = portMAX_DELAY);
+
+        /**
+         * @brief Get the event queue for use with queue sets
+         * @return Queue of KeyEvent items, nullptr when stopped
+         */
+        QueueHandle_t events() const;
+
+        /**
+         * @brief Check the debounced state of a key
+         * @param row Row index
+         * @param col Column index
+         * @return true if the key is pressed
+         */
+        bool isPressed(size_t row, size_t col) const;
+
+        /**
+         * @brief Get the scan statistics
+         */
+        KeypadStats getStats() const;
+
+    private:
+        KeypadScanner(const KeypadScanner&) = delete;
+        KeypadScanner& operator=(const KeypadScanner&) = delete;
+
+        static void scanTimerCb(void* arg);
+        void scan();
+        uint32_t readColumns(uint64_t port) const;
+        uint32_t ghostMask(size_t row, const uint32_t* raw) const;
+        void report(size_t row, uint32_t changed, uint32_t state, int64_t now);
+
+        std::vector<int>        _rows;
+        std::vector<int>        _cols;
+        uint64_t                _rowMask;      // Port bits of all row pins
+        KeypadConfig            _config;
+        GpioTimerHandle         _timer;
+        QueueHandle_t           _queue;
+        uint32_t                _raw[GPIO_KEYPAD_MAX_ROWS];     // Last sample, bit per column
+        uint8_t                 _stableFor[GPIO_KEYPAD_MAX_ROWS];
+        std::atomic<uint32_t>   _state[GPIO_KEYPAD_MAX_ROWS];   // Debounced state
+        std::atomic<uint32_t>   _scans;
+        std::atomic<uint32_t>   _ghostScans;
+        std::atomic<uint32_t>   _dropped;
+    };
+
+} // namespace ESP32_GPIO
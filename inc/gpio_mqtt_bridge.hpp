@@ -0,0 +1,118 @@
+// @file GpioMqttBridge.hpp
+// @brief Coalescing GPIO change-of-state forwarder to MQTT
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "gpio.hpp"
+
+#ifndef GPIO_BRIDGE_MAX_PINS
+#define GPIO_BRIDGE_MAX_PINS 64 // Pins in one bridge, one bit each in the snapshot
+#endif
+
+namespace ESP32_GPIO {
+
+    /**
+     * @brief Bridge settings
+     */
+    struct GpioBridgeConfig {
+        const int*  pins;
+        size_t      num_pins;
+        const char* topic;
+        uint32_t    window_ms     = 50;     // Edges within this time of the first one share a message
+        int         qos           = 0;
+        bool        retain        = false;
+        bool        pull_up       = false;
+        bool        pull_down     = false;
+        uint32_t    task_stack    = 3072;
+        UBaseType_t task_priority = 5;
+    };
+
+    /**
+     * @brief Bridge statistics
+     */
+    struct GpioBridgeStats {
+        uint32_t edges;      // Interrupts seen on bridged pins
+        uint32_t messages;   // Deltas published
+        uint32_t failed;     // Publish attempts the client rejected, retried next window
+    };
+
+    /**
+     * @brief Publishes coalesced GPIO state changes from a task
+     *
+     * The ISR only marks the pin as changed and wakes the bridge task. The
+     * task waits out the coalescing window, reads all pins with one port
+     * read and publishes a single delta. A chattering contact costs one
+     * message per window instead of one per edge.
+     *
+     * Bit i of every mask refers to pins[i] of the configuration, masks are
+     * W = (num_pins + 7) / 8 bytes, least significant byte first. Payload:
+     *
+     *   seq     2 bytes, little endian, incremented per message
+     *   changed W bytes, pins whose level differs from the previous message
+     *   levels  W bytes, level of every pin at the snapshot
+     *   pulsed  W bytes, pins that toggled but are back at their previous level
+     *
+     * Since levels is complete, a lost message never leaves the receiver
+     * with a wrong state after the next one.
+     */
+    class GpioMqttBridge {
+    public:
+        GpioMqttBridge();
+        ~GpioMqttBridge();
+
+        /**
+         * @brief Configure the pins and start the bridge task
+         * @param config Bridge settings
+         * @return true if successful
+         */
+        bool start(const GpioBridgeConfig& config);
+
+        /**
+         * @brief Stop the bridge task and release the pins
+         */
+        void stop();
+
+        /**
+         * @brief Publish the full state on the next window even without a change
+         */
+        void requestSnapshot();
+
+        /**
+         * @brief Get the bridge statistics
+         */
+        GpioBridgeStats getStats() const;
+
+    private:
+        GpioMqttBridge(const GpioMqttBridge&) = delete;
+        GpioMqttBridge& operator=(const GpioMqttBridge&) = delete;
+
+        static void edgeIsr(int gpio_num, int level, void* arg);
+        static void bridgeTask(void* arg);
+        void run();
+        uint64_t snapshot() const;
+        bool publish(uint64_t changed, uint64_t levels, uint64_t pulsed);
+        void wake();
+
+        GpioBridgeConfig      _config;
+        std::string           _topic;
+        int                   _pins[GPIO_BRIDGE_MAX_PINS];
+        size_t                _numPins;
+        int8_t                _index[SOC_GPIO_PIN_COUNT];  // Bit of each GPIO in the snapshot, -1 if not bridged
+        TaskHandle_t          _task;
+        portMUX_TYPE          _lock;
+        uint64_t              _marked;       // Pins with an edge since the last snapshot, guarded by _lock
+        uint64_t              _published;    // Levels in the last published message
+        uint16_t              _seq;
+        std::atomic<bool>     _running;
+        std::atomic<bool>     _alive;        // Bridge task has not exited yet
+        std::atomic<bool>     _forceSnapshot;
+        std::atomic<uint32_t> _edges;
+        std::atomic<uint32_t> _messages;
+        std::atomic<uint32_t> _failed;
+    };
+
+} // namespace ESP32_GPIO
@@ -0,0 +1,164 @@
+// @file WaveformEngine.hpp
+// @brief Buffered waveform output for bit-banged protocols
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "gpio.hpp"
+#if SOC_RMT_SUPPORTED
+#include "driver/rmt_tx.h"
+#endif
+#if SOC_DEDICATED_GPIO_SUPPORTED
+#include "driver/dedic_gpio.h"
+#endif
+
+#ifndef GPIO_WAVEFORM_MAX_BLOCKING_US
+#define GPIO_WAVEFORM_MAX_BLOCKING_US 200 // Longest waveform the CPU loops may play with interrupts masked
+#endif
+
+namespace ESP32_GPIO {
+
+    /**
+     * @brief One waveform step
+     *
+     * Pins in mask are driven to the matching bit of level, then held for
+     * duration_ns before the next step. Pins outside mask keep their level.
+     */
+    struct WaveStep {
+        uint64_t mask;
+        uint64_t level;
+        uint32_t duration_ns;
+    };
+
+    /**
+     * @brief Playback method of a waveform
+     */
+    enum class WaveformMode {
+        AUTO,       // RMT, then dedicated GPIO, then the IRAM loop
+        RMT,        // Hardware playback, one channel per pin, the CPU is free while it plays.
+                    // The first step must drive every pin, AUTO skips RMT otherwise
+        DEDICATED,  // CPU loop writing a dedicated GPIO bundle
+        IRAM_LOOP   // CPU loop writing the GPIO set/clear registers
+    };
+
+    /**
+     * @brief Waveform engine settings
+     */
+    struct WaveformConfig {
+        WaveformMode mode              = WaveformMode::AUTO;
+        uint32_t     rmt_resolution_hz = 10000000;                       // RMT tick rate, 100 ns per tick
+        uint32_t     max_blocking_us   = GPIO_WAVEFORM_MAX_BLOCKING_US;  // Limit for the CPU loops
+    };
+
+    /**
+     * @brief Plays a precompiled buffer of pin steps with deterministic timing
+     *
+     * load() compiles the steps once for the chosen method so play() only
+     * streams precomputed words. RMT playback runs in hardware and can be
+     * left running in the background. A multi-pin waveform gets one RMT
+     * channel per pin, started together by a sync manager, on targets that
+     * support it (SOC_RMT_SUPPORT_TX_SYNCHRO) and have enough TX channels.
+     * Otherwise the CPU loops run it from IRAM with interrupts masked on the
+     * calling core, so they are limited to max_blocking_us per waveform.
+     */
+    class WaveformEngine {
+    public:
+        WaveformEngine();
+        ~WaveformEngine();
+
+        /**
+         * @brief Compile a waveform and claim its pins
+         * @param steps  Waveform steps
+         * @param count  Number of steps
+         * @param config Engine settings
+         * @return true if the waveform can be played with the requested method
+         */
+        bool load(const WaveStep* steps, size_t count, const WaveformConfig& config = WaveformConfig());
+
+        /**
+         * @brief Play the loaded waveform
+         * @param wait Block until the waveform has been played
+         * @return true if playback started (and finished when wait is set)
+         * @note The CPU loops always block, wait only matters for RMT
+         */
+        bool play(bool wait = true);
+
+        /**
+         * @brief Wait for an RMT playback to finish
+         * @param timeout_ms Maximum wait, -1 waits forever
+         * @return true if the waveform has finished
+         */
+        bool waitDone(int timeout_ms = -1);
+
+        /**
+         * @brief Release the pins and peripherals claimed by load()
+         */
+        void release();
+
+        /**
+         * @brief Get the method used for the loaded waveform
+         */
+        WaveformMode mode() const;
+
+        /**
+         * @brief Get the total duration of the loaded waveform
+         * @return Duration in nanoseconds
+         */
+        uint64_t durationNs() const;
+
+    private:
+        WaveformEngine(const WaveformEngine&) = delete;
+        WaveformEngine& operator=(const WaveformEngine&) = delete;
+
+        /**
+         * Precomputed step for the CPU loops: register or bundle words
+         * and the step length in CPU cycles
+         */
+        struct CpuStep {
+            uint32_t set_lo;    // IRAM loop: W1TS word, dedicated: bundle mask
+            uint32_t clr_lo;    // IRAM loop: W1TC word, dedicated: bundle value
+            uint32_t set_hi;
+            uint32_t clr_hi;
+            uint32_t cycles;
+        };
+
+#if SOC_RMT_SUPPORTED
+        /**
+         * One RMT channel playing the levels of one pin
+         */
+        struct RmtTrack {
+            int                            pin = -1;
+            bool                           eot_level = false;
+            std::vector<rmt_symbol_word_t> symbols;
+            rmt_channel_handle_t           channel = nullptr;
+            rmt_encoder_handle_t           encoder = nullptr;
+        };
+
+        bool compileRmt(const WaveStep* steps, size_t count, uint64_t pins, uint32_t resolution_hz);
+        static bool compileRmtTrack(const WaveStep* steps, size_t count, RmtTrack& track, uint32_t resolution_hz);
+#endif
+        bool compileDedicated(const WaveStep* steps, size_t count, uint64_t pins);
+        bool compileCpu(const WaveStep* steps, size_t count, uint64_t pins);
+        static void playRegisters(const CpuStep* steps, size_t count);
+        static void playDedicated(const CpuStep* steps, size_t count);
+
+        WaveformMode         _mode;
+        bool                 _loaded;
+        uint64_t             _pins;
+        uint64_t             _durationNs;
+        std::vector<CpuStep> _cpuSteps;
+        portMUX_TYPE         _lock;
+#if SOC_RMT_SUPPORTED
+        std::vector<RmtTrack> _rmtTracks;
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+        rmt_sync_manager_handle_t _rmtSync;
+#endif
+#endif
+#if SOC_DEDICATED_GPIO_SUPPORTED
+        dedic_gpio_bundle_handle_t _bundle;
+#endif
+    };
+
+} // namespace ESP32_GPIO
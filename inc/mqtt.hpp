@@ -2,14 +2,45 @@
 // @brief MQTT client manager for ESP32 using C++ OOP approach
 #pragma once
 
+#include <atomic>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 #include "esp_event.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mqtt_alias.hpp"
 #include "mqtt_client.h"
 
+#ifndef MQTT_TOPIC_STACK_LEN
+#define MQTT_TOPIC_STACK_LEN 128 // Topic views up to this length are published without a heap copy
+#endif
+
+#ifndef MQTT_OUTBOX_TRACK_MAX
+#define MQTT_OUTBOX_TRACK_MAX 64 // Unacknowledged QoS 1/2 publishes accounted against the outbox budget
+#endif
+
+#ifndef MQTT_USER_PROPERTY_MAX
+#define MQTT_USER_PROPERTY_MAX 8 // User properties accepted per publish
+#endif
+
+#ifndef MQTT_LATENCY_CLASS_MAX
+#define MQTT_LATENCY_CLASS_MAX 4 // Topic classes with their own latency histograms, class 0 takes unmatched topics
+#endif
+
+#ifndef MQTT_LATENCY_BUCKETS
+#define MQTT_LATENCY_BUCKETS 16 // Log2 buckets, the last one holds acks of 16 s and more
+#endif
+
 namespace ESP32_MQTT {
 
+    class MessageAssembler;
+    class OfflineStore;
+    class TopicRouter;
+
     /**
      * @brief MQTT connection status
      */
@@ -20,6 +51,52 @@ namespace ESP32_MQTT {
         ERROR
     };
 
+    /**
+     * @brief MQTT protocol version
+     */
+    enum class MqttProtocol {
+        V3_1_1,
+        V5
+    };
+
+    /**
+     * @brief MQTT 5 session settings
+     */
+    struct Mqtt5Options {
+        uint16_t topic_alias_max   = 8;   // Aliases assigned to outgoing topics, the broker may allow fewer
+        uint16_t alias_after       = 2;   // Publishes on a topic before it is given an alias
+        uint16_t receive_alias_max = 0;   // Aliases the broker may use towards the client
+        uint32_t session_expiry_s  = 0;   // Session kept by the broker after a disconnect
+    };
+
+    /**
+     * @brief Connection timing, applied to a running client without reconnecting
+     */
+    struct MqttNetworkOptions {
+        int reconnect_timeout_ms  = 0;   // Wait before reconnecting, 0 for the esp-mqtt default
+        int timeout_ms            = 0;   // Network operation timeout, 0 for the default
+        int retransmit_timeout_ms = 0;   // Resend delay of unacknowledged QoS 1/2 messages, 0 for the default
+    };
+
+    /**
+     * @brief MQTT 5 user property
+     */
+    struct MqttUserProperty {
+        const char* key;
+        const char* value;
+    };
+
+    /**
+     * @brief Per-message MQTT 5 properties, ignored with MQTT 3.1.1
+     */
+    struct MqttPublishOptions {
+        uint32_t                expiry_s            = 0;        // Message expiry interval, 0 for none
+        const char*             content_type        = nullptr;
+        const MqttUserProperty* user_properties     = nullptr;
+        size_t                  user_property_count = 0;        // Up to MQTT_USER_PROPERTY_MAX
+        bool                    alias               = true;     // Allow a topic alias for this message, QoS 0 only
+    };
+
     /**
      * @brief Callback for MQTT events
      * @param event MQTT event handle
@@ -27,8 +104,65 @@ namespace ESP32_MQTT {
      */
     typedef void (*MqttEventCallback)(esp_mqtt_event_handle_t event, void* user_data);
 
+    /**
+     * @brief Callback for outbox backpressure changes
+     * @param throttled true once the high watermark is reached, false once back at the low watermark
+     * @param user_data User provided data pointer
+     */
+    typedef void (*MqttBackpressureCallback)(bool throttled, void* user_data);
+
+    /**
+     * @brief Outbox occupancy of unacknowledged QoS 1/2 publishes
+     */
+    struct MqttOutboxStats {
+        size_t   bytes;              // Estimated bytes held by the outbox
+        size_t   peak_bytes;
+        size_t   budget;             // 0 when unlimited
+        uint32_t inflight[3];        // Unacknowledged messages per QoS, QoS 0 is never held
+        size_t   inflight_bytes[3];
+        uint32_t rejected;           // Publishes refused because of the budget
+        uint32_t untracked;          // Sent without accounting, the tracking table was full and no budget was set
+        bool     throttled;
+    };
+
+    /**
+     * @brief Publish-to-acknowledge latency of one topic class and QoS
+     *
+     * Bucket 0 counts acks within 1 ms, bucket n those within [2^(n-1), 2^n) ms.
+     * QoS 1 ends at PUBACK, QoS 2 at PUBCOMP.
+     */
+    struct MqttLatencyStats {
+        uint32_t buckets[MQTT_LATENCY_BUCKETS];
+        uint32_t count;              // Acknowledged messages
+        uint32_t timeouts;           // Dropped from the outbox without an ack
+        uint32_t retransmitted;      // Acknowledged after at least one resend
+        uint32_t min_ms;
+        uint32_t max_ms;
+        uint64_t total_ms;
+
+        /**
+         * @brief Estimate a percentile from the buckets
+         * @param percent Percentile, 1 to 100
+         * @return Upper bound of the bucket holding it in ms, 0 without samples
+         */
+        uint32_t percentile(unsigned percent) const;
+    };
+
     /**
      * @brief Class for managing MQTT connections on ESP32
+     *
+     * Thread safety: publish(), subscribe(), unsubscribe() and the getters
+     * may be called from any number of tasks on both cores. The publish path
+     * takes no lock of its own: it pins the client handle with an atomic
+     * user count, so concurrent publishers only meet inside esp-mqtt (and on
+     * the MQTT 5 property mutex). configure(), connect() and disconnect()
+     * are serialised with each other and may run while publishers are
+     * active: configure() and recreate() unpublish the old handle and wait
+     * for the publishers still using it before tearing it down. Publishes in that
+     * window fail with -1, or go to the offline store if one is attached.
+     *
+     * Attach the router, store, assembler and callbacks before connecting.
+     * None of the lifecycle calls may be made from an MQTT event callback.
      */
     class MqttClient {
     public:
@@ -43,6 +177,25 @@ namespace ESP32_MQTT {
          */
         bool init();
 
+        /**
+         * @brief Select the protocol version
+         * @param protocol Protocol version
+         * @param options  MQTT 5 settings
+         * @return true if the version is supported by this build
+         * @note Takes effect on the next configure()
+         */
+        bool setProtocol(MqttProtocol protocol, const Mqtt5Options& options = Mqtt5Options());
+
+        /**
+         * @brief Get the selected protocol version
+         */
+        MqttProtocol getProtocol() const;
+
+        /**
+         * @brief Get the MQTT 5 topic alias counters
+         */
+        MqttAliasStats getAliasStats() const;
+
         /**
          * @brief Configure broker connection
          * @param uri Broker URI
@@ -52,6 +205,10 @@ namespace ESP32_MQTT {
          * @param keepalive Keepalive interval in seconds
          * @param cleanSession Clean session flag
          * @return true if configuration successful
+         * @note Safe while other tasks publish. An existing client takes the
+         *       new settings in place and keeps its connection, they are
+         *       sent with the next CONNECT (see reconnect()). The client is
+         *       only replaced if esp-mqtt rejects the settings.
          */
         bool configure(
             const std::string& uri,
@@ -62,6 +219,34 @@ namespace ESP32_MQTT {
             bool cleanSession = true
         );
 
+        /**
+         * @brief Change connection timing
+         * @param options Network options
+         * @return true if a configured client accepted them
+         * @note Applied to the running client, the connection is kept
+         */
+        bool setNetworkOptions(const MqttNetworkOptions& options);
+
+        /**
+         * @brief Reconnect with the current settings, keeping the client
+         * @return true if the reconnect was started
+         * @note Sends DISCONNECT and connects again as soon as the MQTT task
+         *       reports the disconnect, skipping reconnect_timeout_ms. Use it
+         *       to apply a new broker, identity or will without waiting for
+         *       the next network drop.
+         */
+        bool reconnect();
+
+        /**
+         * @brief Replace the esp-mqtt client with a new one built from the current settings
+         * @return true if the new client was created, and started if the old one was
+         * @note Safe while other tasks publish, they get -1 until the new
+         *       client is in place. Messages still in the old client's outbox
+         *       are dropped. Use it to recover a client that stopped making
+         *       progress.
+         */
+        bool recreate();
+
         /**
          * @brief Set Last Will and Testament (LWT)
          * @param topic LWT topic
@@ -89,7 +274,7 @@ namespace ESP32_MQTT {
         bool disconnect();
 
         /**
-         * @brief Publish a message
+         * @brief Publish a text message
          * @param topic Topic string
          * @param payload Payload string
          * @param qos Quality of Service (0, 1, 2)
@@ -97,8 +282,8 @@ namespace ESP32_MQTT {
          * @return message id (>0) or negative on error
          */
         int publish(
-            const std::string& topic,
-            const std::string& payload,
+            std::string_view topic,
+            std::string_view payload,
             int qos = 0,
             bool retain = false
         );
@@ -113,13 +298,77 @@ namespace ESP32_MQTT {
          * @return message id or negative on error
          */
         int publish(
-            const std::string& topic,
+            std::string_view topic,
             const uint8_t* data,
             size_t len,
             int qos = 0,
             bool retain = false
         );
 
+        /**
+         * @brief Publish binary data
+         * @param topic Topic string
+         * @param payload Byte container viewable as std::span<const uint8_t>
+         * @param qos Quality of Service
+         * @param retain Retain flag
+         * @return message id or negative on error
+         * @note Raw arrays go through the pointer overload, so publish(topic, buf, 3)
+         *       stays unambiguous
+         */
+        template <typename Bytes>
+            requires (!std::is_array_v<Bytes> && std::is_convertible_v<const Bytes&, std::span<const uint8_t>>)
+        int publish(
+            std::string_view topic,
+            const Bytes& payload,
+            int qos = 0,
+            bool retain = false
+        ) {
+            std::span<const uint8_t> bytes(payload);
+            return publish(topic, bytes.data(), bytes.size(), qos, retain);
+        }
+
+        /**
+         * @brief Publish without any copy or payload length scan
+         * @param topic NUL-terminated topic string
+         * @param data Payload, may be nullptr when len is 0
+         * @param len Length of data
+         * @param qos Quality of Service
+         * @param retain Retain flag
+         * @return message id or negative on error
+         * @note Topics given as views are terminated in a stack buffer of
+         *       MQTT_TOPIC_STACK_LEN bytes
+         */
+        int publish(
+            const char* topic,
+            const char* data,
+            size_t len,
+            int qos,
+            bool retain
+        );
+
+        /**
+         * @brief Publish with MQTT 5 properties
+         * @param topic NUL-terminated topic string
+         * @param data Payload, may be nullptr when len is 0
+         * @param len Length of data
+         * @param qos Quality of Service
+         * @param retain Retain flag
+         * @param options Message properties
+         * @return message id or negative on error
+         * @note All other publish overloads end here. While not connected,
+         *       messages go to the offline store if one is attached and 0 is
+         *       returned once stored. With MQTT 5, hot QoS 0 topics are
+         *       replaced by topic aliases automatically.
+         */
+        int publish(
+            const char* topic,
+            const char* data,
+            size_t len,
+            int qos,
+            bool retain,
+            const MqttPublishOptions& options
+        );
+
         /**
          * @brief Subscribe to a topic
          * @param topic Topic string
@@ -145,6 +394,110 @@ namespace ESP32_MQTT {
          */
         void setEventCallback(MqttEventCallback callback, void* user_data = nullptr);
 
+        /**
+         * @brief Route received messages through a topic router
+         * @param router Router, nullptr to stop routing
+         * @note The router also resubscribes its filters on every connect
+         */
+        void setRouter(TopicRouter* router);
+
+        /**
+         * @brief Get the attached topic router
+         * @return Router or nullptr
+         */
+        TopicRouter* getRouter() const;
+
+        /**
+         * @brief Join fragmented messages before routing them
+         * @param assembler Started assembler, nullptr to route whole messages only
+         * @note Without an assembler the router skips messages larger than the
+         *       esp-mqtt receive buffer
+         */
+        void setAssembler(MessageAssembler* assembler);
+
+        /**
+         * @brief Get the attached message assembler
+         * @return Assembler or nullptr
+         */
+        MessageAssembler* getAssembler() const;
+
+        /**
+         * @brief Keep publishes made while disconnected in a flash log
+         * @param store Started offline store, nullptr to detach
+         * @note The store replays its records after every connect
+         */
+        void setOfflineStore(OfflineStore* store);
+
+        /**
+         * @brief Get the attached offline store
+         * @return Store or nullptr
+         */
+        OfflineStore* getOfflineStore() const;
+
+        /**
+         * @brief Report a QoS 1/2 publish to the offline store once it is settled
+         * @param msg_id Message id returned by publish()
+         * @return true if the message is in flight, false if it was already
+         *         acknowledged or is not tracked
+         * @note OfflineStore::published() follows on the broker's acknowledgement,
+         *       or when esp-mqtt drops the message
+         */
+        bool watchOutbox(int msg_id);
+
+        /**
+         * @brief Limit the RAM held by unacknowledged QoS 1/2 publishes
+         * @param budget     Outbox byte budget, 0 for unlimited
+         * @param high_water Occupancy that signals backpressure, 0 for 3/4 of the budget
+         * @param low_water  Occupancy that clears backpressure, 0 for 1/2 of the budget
+         * @return true if the watermarks are consistent
+         * @note With a budget, publishes that would exceed it, or that find all
+         *       MQTT_OUTBOX_TRACK_MAX tracking entries in use, fail with -2 like
+         *       a full esp-mqtt outbox. Without one nothing is refused: a
+         *       publish that finds the table full is sent untracked, with no
+         *       latency sample. The esp-mqtt outbox limit follows at once.
+         */
+        bool setOutboxBudget(size_t budget, size_t high_water = 0, size_t low_water = 0);
+
+        /**
+         * @brief Set the backpressure callback
+         * @param callback Function called when the throttled state changes
+         * @param user_data User data pointer
+         * @note Called from the publishing task or the MQTT task, keep it short
+         */
+        void setBackpressureCallback(MqttBackpressureCallback callback, void* user_data = nullptr);
+
+        /**
+         * @brief Check whether producers should slow down
+         * @return true between reaching the high watermark and falling back to the low one
+         */
+        bool isThrottled() const;
+
+        /**
+         * @brief Get the outbox occupancy
+         */
+        MqttOutboxStats getOutboxStats() const;
+
+        /**
+         * @brief Give topics matching a filter their own latency histograms
+         * @param filter Topic filter, wildcards allowed
+         * @return Class (>0), or -1 if the filter is invalid or all classes are taken
+         * @note Call before publishing starts, topics matching no filter fall in class 0
+         */
+        int addLatencyClass(std::string_view filter);
+
+        /**
+         * @brief Get the publish-to-acknowledge latency of a topic class
+         * @param topic_class Class returned by addLatencyClass(), or 0
+         * @param qos         1 or 2
+         * @return Latency histogram, all zero for an unknown class
+         */
+        MqttLatencyStats getLatencyStats(int topic_class, int qos = 1) const;
+
+        /**
+         * @brief Clear every latency histogram, e.g. after exporting them
+         */
+        void resetLatencyStats();
+
         /**
          * @brief Get current client status
          * @return MqttStatus enum value
@@ -179,13 +532,86 @@ namespace ESP32_MQTT {
             void* eventData
         );
 
-        esp_mqtt_client_handle_t       _client = nullptr;
+        struct OutboxEntry {
+            int      msg_id;          // 0 while the publish is in progress, -1 when free
+            uint8_t  qos;
+            uint8_t  topic_class;
+            bool     resent;          // Outstanding across a reconnect
+            bool     sent_connected;  // Put on the wire, false while queued offline
+            bool     stored;          // Replayed from the offline store, which waits for the ack
+            uint32_t bytes;
+            int64_t  sent_us;
+        };
+
+        /**
+         * @brief Pins the client handle for the lifetime of one call
+         */
+        class ClientRef {
+        public:
+            explicit ClientRef(MqttClient& owner);
+            ~ClientRef();
+            esp_mqtt_client_handle_t handle;
+        private:
+            MqttClient& _owner;
+        };
+
+        esp_mqtt_client_handle_t retireClient();
+        bool createClient();
+        void fillConfig();
+        bool applyConfig();
+        void applySession(esp_mqtt_client_handle_t client);
+        int send(esp_mqtt_client_handle_t client, const char* topic, const char* data, size_t len, int qos, bool retain, const MqttPublishOptions& options);
+        int reserveOutbox(int qos, size_t bytes, uint8_t topic_class);
+        void commitOutbox(int slot, int msg_id, bool sent_connected);
+        void releaseOutbox(int msg_id, bool expired);
+        void resetOutbox();
+        void markOutboxResent();
+        uint8_t latencyClass(std::string_view topic) const;
+        void recordLatency(const OutboxEntry& entry, bool expired);
+        bool updateThrottle();
+        void notifyBackpressure(bool throttled);
+
+        std::atomic<esp_mqtt_client_handle_t> _client{nullptr};
+        std::atomic<uint32_t>          _clientUsers{0};      // Calls holding a ClientRef
+        std::atomic<bool>              _reconnectPending{false}; // reconnect() waits for its DISCONNECTED event
+        SemaphoreHandle_t              _configMutex = nullptr;   // Serialises configure, connect and disconnect
+        bool                           _started = false;         // connect() succeeded since the last disconnect()
         esp_mqtt_client_config_t       _config = {};
-        MqttStatus                     _status = MqttStatus::DISCONNECTED;
+        MqttProtocol                   _protocol = MqttProtocol::V3_1_1;
+        Mqtt5Options                   _mqtt5;
+        TopicAliasTable                _aliases;          // Lives as long as the client, the MQTT task may use it at any time
+        SemaphoreHandle_t              _publishMutex = nullptr;   // Keeps publish properties with their publish
+        std::atomic<MqttStatus>        _status{MqttStatus::DISCONNECTED};
         MqttEventCallback              _userCallback = nullptr;
         void*                          _userData = nullptr;
+        TopicRouter*                   _router = nullptr;
+        OfflineStore*                  _store = nullptr;
+        MessageAssembler*              _assembler = nullptr;
+        MqttBackpressureCallback       _backpressureCallback = nullptr;
+        void*                          _backpressureData = nullptr;
+        portMUX_TYPE                   _outboxLock = portMUX_INITIALIZER_UNLOCKED;
+        OutboxEntry                    _outbox[MQTT_OUTBOX_TRACK_MAX];
+        int                            _earlyAcks[4];     // Acks that overtook their publish call
+        size_t                         _earlyAckNext = 0;
+        size_t                         _outboxBytes = 0;
+        size_t                         _outboxPeak = 0;
+        size_t                         _outboxBudget = 0;
+        size_t                         _outboxHigh = 0;
+        size_t                         _outboxLow = 0;
+        uint32_t                       _outboxRejected = 0;
+        uint32_t                       _outboxUntracked = 0;
+        bool                           _throttled = false;
+        std::string                    _latencyFilters[MQTT_LATENCY_CLASS_MAX];   // Entry 0 unused
+        int                            _latencyClasses = 1;
+        MqttLatencyStats               _latency[MQTT_LATENCY_CLASS_MAX][2] = {}; // Per class, QoS 1 and 2
         std::string                    _brokerUri;
         std::string                    _clientId;
+        std::string                    _username;
+        std::string                    _password;
+        int                            _keepalive = 60;
+        bool                           _cleanSession = true;
+        MqttNetworkOptions             _network;
+        std::atomic<uint32_t>          _retransmitMs{0};    // Effective retransmit timeout, read by the MQTT task
         std::string                    _willTopic;
         std::string                    _willPayload;
         int                             _willQos = 0;
@@ -196,6 +622,7 @@ namespace ESP32_MQTT {
     // This allows using the MQTT client from C code as well
     extern "C" {
         int mqtt_init();
+        int mqtt_set_protocol(int version);
         int mqtt_configure(
             const char* uri,
             const char* client_id,
@@ -214,6 +641,7 @@ namespace ESP32_MQTT {
 
         int mqtt_connect();
         int mqtt_disconnect();
+        int mqtt_reconnect();
         int mqtt_publish(
             const char* topic,
             const char* payload,
@@ -230,6 +658,8 @@ namespace ESP32_MQTT {
         int mqtt_subscribe(const char* topic, int qos);
         int mqtt_unsubscribe(const char* topic);
         int mqtt_get_status();
+        int mqtt_set_outbox_budget(size_t budget, size_t high_water, size_t low_water);
+        int mqtt_is_throttled();
         const char* mqtt_get_broker_uri();
         const char* mqtt_get_client_id();
     }
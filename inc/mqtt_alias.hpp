@@ -0,0 +1,143 @@
+// @file TopicAliasTable.hpp
+// @brief Automatic MQTT 5 topic alias assignment for frequently used topics
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+#ifndef MQTT_TOPIC_ALIAS_LEN
+#define MQTT_TOPIC_ALIAS_LEN 128 // Longest topic that can be given an alias
+#endif
+
+namespace ESP32_MQTT {
+
+    /**
+     * @brief Topic alias counters
+     */
+    struct MqttAliasStats {
+        uint16_t assigned;      // Aliases currently mapped to a topic
+        uint16_t limit;         // Aliases usable, lowered when the broker allows fewer
+        uint32_t aliased;       // Publishes sent with the topic replaced by its alias
+        uint32_t bytes_saved;   // Topic bytes not sent thanks to aliases
+    };
+
+    /**
+     * @brief Maps hot publish topics to MQTT 5 topic aliases
+     *
+     * Every topic looked up is counted in a small candidate list. Once a
+     * topic has been published often enough it is given a free alias, or
+     * takes over the least used one. Use counts are halved regularly, so
+     * aliases follow the topics that are hot right now.
+     *
+     * Aliases only live as long as a network connection. An alias is sent
+     * together with its topic once per connection, later publishes can
+     * leave the topic empty.
+     *
+     * Only QoS 0 publishes are looked up. esp-mqtt resends unacknowledged
+     * QoS 1/2 packets unchanged after a reconnect, so an alias carried by one
+     * would map the alias back to its old topic on the broker if it had been
+     * given to another topic since.
+     *
+     * Not thread safe, MqttClient serialises access. The exception is
+     * reconnected(), which only bumps an atomic and may run at any time,
+     * also during resize().
+     */
+    class TopicAliasTable {
+    public:
+        /**
+         * @brief Create an empty table, no alias is assigned until resize()
+         */
+        TopicAliasTable();
+
+        /**
+         * @brief Allocate the table
+         * @param max_aliases   Aliases assigned at most
+         * @param promote_after Publishes on a topic before it gets an alias
+         */
+        TopicAliasTable(uint16_t max_aliases, uint16_t promote_after);
+        ~TopicAliasTable();
+
+        /**
+         * @brief Drop every alias and counter and reallocate the table
+         * @param max_aliases   Aliases assigned at most, 0 frees the storage
+         * @param promote_after Publishes on a topic before it gets an alias
+         * @return true if the table can assign aliases afterwards
+         * @note The storage is kept when max_aliases does not change
+         */
+        bool resize(uint16_t max_aliases, uint16_t promote_after);
+
+        /**
+         * @brief Check that the table was allocated
+         */
+        bool valid() const;
+
+        /**
+         * @brief Count a publish and get the topic's alias
+         * @param topic       Topic name
+         * @param established Set to true if the alias was already sent with
+         *                    its topic on the current connection
+         * @return Alias (>0), or 0 if the topic has none
+         */
+        uint16_t lookup(std::string_view topic, bool& established);
+
+        /**
+         * @brief Record that an alias was sent
+         * @param alias     Alias returned by lookup()
+         * @param topic_len Topic length, for the savings count
+         * @param elided    true if the topic was left out
+         */
+        void sent(uint16_t alias, size_t topic_len, bool elided);
+
+        /**
+         * @brief Start a new connection, aliases must be sent with their topic again
+         */
+        void reconnected();
+
+        /**
+         * @brief Stop using aliases above a value
+         * @param max Highest alias the broker accepts, 0 disables aliases
+         */
+        void limit(uint16_t max);
+
+        /**
+         * @brief Get the alias counters
+         */
+        MqttAliasStats getStats() const;
+
+    private:
+        TopicAliasTable(const TopicAliasTable&) = delete;
+        TopicAliasTable& operator=(const TopicAliasTable&) = delete;
+
+        struct Alias {
+            uint32_t hash;
+            uint16_t len;          // 0 while unassigned
+            uint16_t uses;
+            uint32_t connection;   // Connection the alias was last sent on with its topic
+            char*    topic;
+        };
+
+        struct Candidate {
+            uint32_t hash;
+            uint16_t count;
+        };
+
+        static constexpr size_t CANDIDATES = 16;
+
+        static uint32_t hash(std::string_view topic);
+        uint16_t promote(std::string_view topic, uint32_t h, uint16_t count);
+        void decay();
+
+        Alias*                _aliases;
+        char*                 _topics;      // Storage of every alias topic
+        Candidate             _candidates[CANDIDATES];
+        uint16_t              _max;
+        uint16_t              _limit;
+        uint16_t              _promoteAfter;
+        uint32_t              _lookups;
+        std::atomic<uint32_t> _connection;  // Bumped on every connect, 0 is never used
+        uint32_t              _aliased;
+        uint32_t              _bytesSaved;
+    };
+
+} // namespace ESP32_MQTT
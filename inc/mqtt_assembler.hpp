@@ -0,0 +1,150 @@
+// @file MessageAssembler.hpp
+// @brief Reassembly of fragmented MQTT messages into pooled buffers
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mqtt.hpp"
+
+namespace ESP32_MQTT {
+
+    /**
+     * @brief Message assembler settings
+     */
+    struct AssemblerConfig {
+        size_t buffers     = 2;      // Pool buffers, one per message being assembled or kept
+        size_t buffer_size = 8192;   // Topic plus payload bytes held by one buffer
+    };
+
+    /**
+     * @brief Message assembler counters
+     */
+    struct AssemblerStats {
+        uint32_t whole;        // Single-fragment messages delivered in place
+        uint32_t reassembled;  // Fragmented messages delivered from a pool buffer
+        uint32_t oversize;     // Messages above their topic limit, skipped
+        uint32_t no_buffer;    // Messages skipped because every buffer was in use
+        uint32_t incomplete;   // Messages abandoned with fragments missing
+    };
+
+    /**
+     * @brief Complete message held in a pool buffer
+     */
+    struct PooledMessage {
+        std::string_view         topic;
+        std::span<const uint8_t> payload;
+    };
+
+    /**
+     * @brief Joins MQTT_EVENT_DATA fragments into whole messages
+     *
+     * esp-mqtt hands over messages larger than its receive buffer as a run
+     * of DATA events, only the first one carrying the topic. The assembler
+     * copies such runs into buffers from a fixed pool allocated at start, so
+     * no heap is used per message. Messages that arrive in one event are
+     * delivered straight from the event without any copy.
+     *
+     * Each message size is checked against its topic limit on the first
+     * fragment, an oversized message is skipped without copying anything.
+     *
+     * When attached with MqttClient::setAssembler(), complete messages are
+     * routed through the client's TopicRouter. The assembler can also be fed
+     * directly from an event callback when no router is used.
+     */
+    class MessageAssembler {
+    public:
+        MessageAssembler();
+        ~MessageAssembler();
+
+        /**
+         * @brief Allocate the buffer pool
+         * @param config Assembler settings
+         * @return true if successful
+         */
+        bool start(const AssemblerConfig& config = AssemblerConfig());
+
+        /**
+         * @brief Free the buffer pool, kept messages must be released first
+         */
+        void stop();
+
+        /**
+         * @brief Set the largest payload accepted on matching topics
+         * @param filter  Topic filter, may contain wildcards
+         * @param max_len Largest payload in bytes
+         * @return true if the filter is valid
+         * @note Limits are checked in the order they were set, the first match
+         *       applies. Other topics are limited by the buffer size.
+         */
+        bool setLimit(std::string_view filter, size_t max_len);
+
+        /**
+         * @brief Feed one MQTT_EVENT_DATA event
+         * @param event   MQTT event
+         * @param topic   Set to the message topic when complete
+         * @param payload Set to the message payload when complete
+         * @return true if a whole message is available
+         * @note The views stay valid until the handler returns. Call keep() to
+         *       hold the message longer.
+         */
+        bool feed(esp_mqtt_event_handle_t event, std::string_view& topic, std::span<const uint8_t>& payload);
+
+        /**
+         * @brief Take ownership of the message feed() just completed
+         * @return Message, or nullptr if no buffer is free
+         * @note Must be called before the next feed(). A message delivered in
+         *       place is copied into a pool buffer first. Hand the result back
+         *       with release().
+         */
+        const PooledMessage* keep();
+
+        /**
+         * @brief Return a kept message to the pool
+         * @param message Message from keep()
+         */
+        void release(const PooledMessage* message);
+
+        /**
+         * @brief Get the assembler counters
+         */
+        AssemblerStats getStats() const;
+
+    private:
+        MessageAssembler(const MessageAssembler&) = delete;
+        MessageAssembler& operator=(const MessageAssembler&) = delete;
+
+        struct Buffer {
+            PooledMessage message;
+            uint8_t*      data;
+            bool          busy;
+        };
+
+        Buffer* acquire();
+        void giveBack(Buffer* buffer);
+        size_t limitFor(std::string_view topic);
+
+        AssemblerConfig                             _config;
+        Buffer*                                     _buffers;
+        uint8_t*                                    _pool;
+        std::vector<std::pair<std::string, size_t>> _limits;
+        SemaphoreHandle_t                           _mutex;
+        Buffer*                                     _current;     // Buffer being filled
+        size_t                                      _total;       // Payload length of the current message
+        size_t                                      _filled;
+        bool                                        _skipping;    // Ignore fragments until the next message
+        Buffer*                                     _delivered;   // Last completed buffer, not kept
+        PooledMessage                               _inPlace;     // Last single-fragment message
+        uint32_t                                    _whole;
+        uint32_t                                    _reassembled;
+        uint32_t                                    _oversize;
+        uint32_t                                    _noBuffer;
+        uint32_t                                    _incomplete;
+    };
+
+} // namespace ESP32_MQTT
@@ -0,0 +1,175 @@
+// @file AsyncPublisher.hpp
+// @brief Non-blocking MQTT publish queue drained by a dedicated sender task
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "mqtt.hpp"
+
+namespace ESP32_MQTT {
+
+    /**
+     * @brief Asynchronous publisher settings
+     */
+    struct AsyncPublisherConfig {
+        size_t      slots         = 32;    // Messages that can wait for the sender
+        size_t      max_topic     = 64;    // Longest topic accepted, in bytes
+        size_t      max_payload   = 256;   // Largest payload accepted, in bytes
+        size_t      batch_max     = 16;    // Messages written per sender wake-up
+        uint32_t    linger_ms     = 5;     // Time the sender waits to fill a batch
+        uint32_t    task_stack    = 4096;
+        UBaseType_t task_priority = 5;
+        BaseType_t  task_core     = tskNO_AFFINITY;
+    };
+
+    /**
+     * @brief Publisher counters and latency
+     */
+    struct AsyncPublisherStats {
+        uint32_t depth;            // Messages currently queued
+        uint32_t peak_depth;       // Highest depth seen
+        uint32_t enqueued;
+        uint32_t sent;
+        uint32_t failed;           // Rejected by the client
+        uint32_t dropped_full;     // No free slot at enqueue time
+        uint32_t dropped_expired;  // Deadline passed before the sender got to it
+        uint32_t oversize;         // Topic or payload larger than the slot
+        uint32_t batches;          // Sender wake-ups that wrote at least one message
+        uint32_t latency_avg_us;   // Enqueue to client hand-off, smoothed over recent messages
+        uint32_t latency_max_us;
+    };
+
+    /**
+     * @brief Bounded multi-producer publish queue with a single sender task
+     *
+     * Messages are copied into a fixed slot pool allocated at start, so
+     * enqueueing never allocates and never touches the network. Slot indices
+     * travel through two FreeRTOS queues: free slots to producers and ready
+     * slots to the sender. The sender wakes on the first message, waits up
+     * to linger_ms for the batch to fill and hands the whole batch to the
+     * client back to back.
+     */
+    class AsyncPublisher {
+    public:
+        AsyncPublisher();
+        ~AsyncPublisher();
+
+        /**
+         * @brief Allocate the slot pool and start the sender task
+         * @param config Publisher settings
+         * @return true if successful
+         */
+        bool start(const AsyncPublisherConfig& config = AsyncPublisherConfig());
+
+        /**
+         * @brief Stop the sender task, queued messages are discarded
+         * @note Safe to call while other tasks publish: new calls are refused
+         *       and calls already inside publish() are waited for before the
+         *       slot pool is freed
+         */
+        void stop();
+
+        /**
+         * @brief Queue a message for publishing
+         * @param topic       Topic string
+         * @param data        Payload
+         * @param len         Payload length
+         * @param qos         Quality of Service
+         * @param retain      Retain flag
+         * @param deadline_ms Drop the message if not handed to the client within this time, 0 for no deadline
+         * @param wait        Ticks to wait for a free slot, 0 never blocks
+         * @return true if the message was queued
+         */
+        bool publish(
+            const char* topic,
+            const void* data,
+            size_t len,
+            int qos = 0,
+            bool retain = false,
+            uint32_t deadline_ms = 0,
+            TickType_t wait = 0
+        );
+
+        /**
+         * @brief Send everything queued without waiting for the linger time
+         * @param timeout Maximum wait in ticks
+         * @return true if the queue drained within the timeout
+         */
+        bool flush(TickType_t timeout = portMAX_DELAY);
+
+        /**
+         * @brief Get the number of queued messages
+         */
+        size_t depth() const;
+
+        /**
+         * @brief Get the publisher counters
+         */
+        AsyncPublisherStats getStats() const;
+
+        /**
+         * @brief Reset the counters and latency figures
+         */
+        void resetStats();
+
+    private:
+        AsyncPublisher(const AsyncPublisher&) = delete;
+        AsyncPublisher& operator=(const AsyncPublisher&) = delete;
+
+        struct Slot {
+            char*    topic;
+            uint8_t* payload;
+            uint16_t len;
+            int8_t   qos;
+            bool     retain;
+            int64_t  enqueued_us;
+            int64_t  deadline_us;  // 0 for no deadline
+        };
+
+        static constexpr uint16_t WAKE = UINT16_MAX;   // Ready-queue token that carries no slot
+
+        /**
+         * @brief Keeps the queues and slot pool alive for one publish() call
+         */
+        class ProducerRef {
+        public:
+            explicit ProducerRef(AsyncPublisher& owner);
+            ~ProducerRef();
+            bool active;   // The publisher was running when the call entered
+        private:
+            AsyncPublisher& _owner;
+        };
+
+        static void senderTask(void* arg);
+        void run();
+        void send(uint16_t index);
+        void release(uint16_t index);
+
+        AsyncPublisherConfig   _config;
+        Slot*                  _slots;
+        uint8_t*               _pool;      // Topic and payload storage of every slot
+        uint16_t*              _batch;     // Slot indices collected by the sender
+        QueueHandle_t          _free;
+        QueueHandle_t          _ready;
+        TaskHandle_t           _task;
+        std::atomic<bool>      _running;
+        std::atomic<bool>      _alive;
+        std::atomic<uint32_t>  _producers; // Calls inside publish()
+        std::atomic<uint32_t>  _flushing;  // Callers waiting in flush()
+        std::atomic<uint32_t>  _pending;   // Enqueued and not yet handed to the client
+        std::atomic<uint32_t>  _peakDepth;
+        std::atomic<uint32_t>  _enqueued;
+        std::atomic<uint32_t>  _sent;
+        std::atomic<uint32_t>  _failed;
+        std::atomic<uint32_t>  _droppedFull;
+        std::atomic<uint32_t>  _droppedExpired;
+        std::atomic<uint32_t>  _oversize;
+        std::atomic<uint32_t>  _batches;
+        std::atomic<uint32_t>  _latencyMaxUs;
+        std::atomic<uint32_t>  _latencyAvgUs;
+    };
+
+} // namespace ESP32_MQTT
@@ -0,0 +1,136 @@
+// @file TopicRouter.hpp
+// @brief Topic trie dispatching MQTT messages to per-filter handlers
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mqtt.hpp"
+
+namespace ESP32_MQTT {
+
+    /**
+     * @brief Handler for messages matching a subscription filter
+     * @param topic   Topic the message was published on
+     * @param payload Message payload
+     */
+    using MqttMessageHandler = std::function<void(std::string_view topic, std::span<const uint8_t> payload)>;
+
+    /**
+     * @brief Subscription router built on a topic-level trie
+     *
+     * Every filter level is a trie node, with '+' and '#' kept as dedicated
+     * children. An incoming topic is matched by walking its levels, so the
+     * cost depends on the topic depth and not on how many filters are
+     * registered, and nothing is allocated while matching.
+     *
+     * The broker subscription follows the handlers: the first handler on a
+     * filter subscribes, the last one to go unsubscribes, and all filters
+     * are subscribed again after every reconnect.
+     *
+     * Handlers run in the MQTT task and must not add or remove handlers.
+     */
+    class TopicRouter {
+    public:
+        TopicRouter();
+        ~TopicRouter();
+
+        /**
+         * @brief Register a handler for a topic filter
+         * @param filter  Topic filter, may contain '+' and a trailing '#'
+         * @param handler Handler called for every matching message
+         * @param qos     QoS requested from the broker
+         * @return Handler id (>0), or -1 if the filter is invalid
+         */
+        int add(std::string_view filter, MqttMessageHandler handler, int qos = 0);
+
+        /**
+         * @brief Remove a handler
+         * @param id Handler id returned by add()
+         * @return true if the handler was registered
+         */
+        bool remove(int id);
+
+        /**
+         * @brief Route one MQTT_EVENT_DATA event to the matching handlers
+         * @param event MQTT event
+         * @return Number of handlers called
+         */
+        size_t dispatch(esp_mqtt_event_handle_t event);
+
+        /**
+         * @brief Route a message to the matching handlers
+         * @param topic   Topic name, wildcards are not allowed
+         * @param payload Message payload
+         * @return Number of handlers called
+         */
+        size_t dispatch(std::string_view topic, std::span<const uint8_t> payload);
+
+        /**
+         * @brief Subscribe every registered filter, used after a reconnect
+         */
+        void resubscribe();
+
+        /**
+         * @brief Get the number of messages no handler matched
+         */
+        uint32_t getUnmatched() const;
+
+        /**
+         * @brief Check a topic filter
+         * @param filter Topic filter
+         * @return true if '+' and '#' only appear as whole levels, '#' last
+         */
+        static bool isValidFilter(std::string_view filter);
+
+        /**
+         * @brief Match a single topic against a filter
+         * @param filter Topic filter, assumed valid
+         * @param topic  Topic name
+         * @return true if the filter matches the topic
+         */
+        static bool matches(std::string_view filter, std::string_view topic);
+
+    private:
+        TopicRouter(const TopicRouter&) = delete;
+        TopicRouter& operator=(const TopicRouter&) = delete;
+
+        struct Entry {
+            int                id;
+            int                qos;
+            MqttMessageHandler fn;
+        };
+
+        struct Node {
+            std::string        level;
+            Node*              parent = nullptr;
+            std::vector<Node*> children;       // Literal levels sorted by name
+            Node*              plus = nullptr;
+            Node*              hash = nullptr;
+            std::vector<Entry> entries;        // Handlers whose filter ends here
+            std::string        filter;         // Full filter, set while entries is not empty
+            int                qos = -1;       // QoS subscribed at the broker, -1 if none
+        };
+
+        Node* child(Node* node, std::string_view level, bool create);
+        void prune(Node* node);
+        void destroy(Node* node);
+        void collect(Node* node, std::string_view topic, size_t pos, bool first, std::span<const uint8_t> payload, size_t& called);
+        static void filters(const Node* node, std::vector<std::pair<std::string, int>>& out);
+        static void call(Node* node, std::string_view topic, std::span<const uint8_t> payload, size_t& called);
+
+        Node                 _root;
+        std::map<int, Node*> _byId;
+        int                  _nextId;
+        uint32_t             _unmatched;
+        SemaphoreHandle_t    _mutex;
+    };
+
+} // namespace ESP32_MQTT
@@ -0,0 +1,169 @@
+// @file OfflineStore.hpp
+// @brief Flash ring log holding MQTT publishes while the broker is unreachable
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mqtt.hpp"
+
+#ifndef MQTT_STORE_MAX_RECORD
+#define MQTT_STORE_MAX_RECORD 1024 // Largest topic plus payload kept in the log
+#endif
+
+namespace ESP32_MQTT {
+
+    /**
+     * @brief Offline store settings
+     */
+    struct OfflineStoreConfig {
+        const char* partition_label   = "mqtt_log";
+        uint32_t    replay_bytes_per_s = 4096;  // Replay bandwidth cap, topic and payload bytes
+        uint32_t    replay_msgs_per_s  = 20;    // Replay message rate cap
+        uint32_t    task_stack         = 4096;
+        UBaseType_t task_priority      = 3;
+    };
+
+    /**
+     * @brief Offline store counters
+     */
+    struct OfflineStoreStats {
+        uint32_t pending;       // Records not replayed yet
+        uint32_t stored;        // Records appended since start
+        uint32_t replayed;
+        uint32_t overwritten;   // Unreplayed records lost when the ring wrapped
+        uint32_t corrupt;       // Records skipped on a CRC mismatch
+        uint32_t rejected;      // Records too large for the log
+        uint32_t sectors;       // Sectors in the partition
+    };
+
+    /**
+     * @brief Append-only ring log on a dedicated flash partition
+     *
+     * Each sector starts with a header carrying a sequence number, so the
+     * oldest and newest sectors are found again after a reset. Records are
+     * CRC-protected and marked replayed by clearing a state byte in place,
+     * so nothing is erased until the writer wraps around. Sectors are used
+     * strictly in turn, which spreads erase cycles evenly over the partition.
+     * When the ring is full the oldest sector is erased and its unreplayed
+     * records are counted as overwritten.
+     *
+     * While attached with MqttClient::setOfflineStore(), publishes made
+     * while disconnected are appended here. After a reconnect a replay task
+     * republishes them at the configured rate. A QoS 1/2 record stays pending
+     * in flash until the broker acknowledged it, so one is in flight at a time.
+     *
+     * In-place state updates need plain NOR writes and do not work on an
+     * encrypted partition.
+     */
+    class OfflineStore {
+    public:
+        OfflineStore();
+        ~OfflineStore();
+
+        /**
+         * @brief Mount the partition and start the replay task
+         * @param config Store settings
+         * @return true if successful
+         */
+        bool start(const OfflineStoreConfig& config = OfflineStoreConfig());
+
+        /**
+         * @brief Stop the replay task, stored records stay in flash
+         */
+        void stop();
+
+        /**
+         * @brief Append a message to the log
+         * @param topic  NUL-terminated topic
+         * @param data   Payload
+         * @param len    Payload length
+         * @param qos    Quality of Service used on replay
+         * @param retain Retain flag used on replay
+         * @return true if the message was written
+         */
+        bool append(const char* topic, const char* data, size_t len, int qos, bool retain);
+
+        /**
+         * @brief Wake the replay task, called by MqttClient on connect
+         */
+        void notifyConnected();
+
+        /**
+         * @brief Settle the QoS 1/2 record being replayed, called by MqttClient
+         * @param delivered true on the broker's acknowledgement, false if
+         *                  esp-mqtt dropped the message and it is sent again
+         */
+        void published(bool delivered);
+
+        /**
+         * @brief Erase every record
+         * @return true if successful
+         */
+        bool clear();
+
+        /**
+         * @brief Get the store counters
+         */
+        OfflineStoreStats getStats() const;
+
+    private:
+        OfflineStore(const OfflineStore&) = delete;
+        OfflineStore& operator=(const OfflineStore&) = delete;
+
+        struct SectorHeader {
+            uint32_t magic;
+            uint32_t seq;
+        };
+
+        struct RecordHeader {
+            uint16_t magic;
+            uint16_t len;        // Topic plus payload bytes
+            uint8_t  topic_len;
+            uint8_t  flags;      // QoS in bits 0-1, retain in bit 2
+            uint8_t  state;      // Erased while pending, cleared once replayed
+            uint8_t  reserved;
+            uint32_t crc;        // Over magic, len, topic_len, flags and the body
+        };
+
+        static void replayTask(void* arg);
+        void replay();
+        bool mount();
+        bool readSector(uint32_t sector, SectorHeader& header) const;
+        bool readRecord(uint32_t sector, uint32_t offset, RecordHeader& header) const;
+        uint32_t scanPending(uint32_t sector, uint32_t* first) const;
+        bool sectorErased(uint32_t sector, uint32_t offset) const;
+        bool openSector(uint32_t sector);
+        bool nextRecord(RecordHeader& header, uint32_t& epoch);
+        void ackRecord(const RecordHeader& header, uint32_t epoch);
+        static uint32_t recordSize(uint16_t len);
+        static uint32_t recordCrc(const RecordHeader& header, const void* topic, const void* data, size_t len);
+
+        OfflineStoreConfig     _config;
+        const esp_partition_t* _partition;
+        uint32_t               _sectorSize;
+        uint32_t               _sectors;
+        uint32_t               _headSector;   // Sector being appended to
+        uint32_t               _headOffset;
+        uint32_t               _headSeq;
+        uint32_t               _tailSector;   // Oldest record that may be pending
+        uint32_t               _tailOffset;
+        uint32_t               _epoch;        // Bumped whenever the writer erases the tail sector
+        uint8_t*               _buffer;       // Body of the record being replayed
+        SemaphoreHandle_t      _mutex;
+        TaskHandle_t           _task;
+        std::atomic<bool>      _running;
+        std::atomic<bool>      _alive;
+        std::atomic<uint8_t>   _inflight;     // Acknowledgement state of the replayed QoS 1/2 record
+        uint32_t               _pending;
+        uint32_t               _stored;
+        uint32_t               _replayed;
+        uint32_t               _overwritten;
+        uint32_t               _corrupt;
+        uint32_t               _rejected;
+    };
+
+} // namespace ESP32_MQTT
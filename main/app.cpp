@@ -2,7 +2,13 @@
 #include<string>
 #include <cstring>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include "esp_system.h"
+#include "esp_heap_caps.h"
 #include "../inc/app.hpp" 
+#include "../inc/binary_log.hpp"
+#include "../inc/cbor.hpp"
 #include "../inc/mqtt.hpp"
 #include "../inc/wifi.hpp"
 #include "../inc/error_handler.hpp"
@@ -31,17 +37,32 @@ using namespace ESP32_MQTT;
 #define AP_CHANNEL 1
 #define AP_MAX_CONNECTIONS 4
 
+// Publishers on both cores while the client is replaced, run once after the MQTT example.
+// Needs a reachable broker and floods it with QoS 1 traffic, enable it on test benches only.
+#ifndef MQTT_STRESS_TEST
+#define MQTT_STRESS_TEST 0
+#endif
+#define STRESS_TASKS 4
+#define STRESS_ROUNDS 8         // Client replacements while the tasks publish
+#define STRESS_RECORDS 512      // msg_ids kept per task
+#define STRESS_DRAIN_MS 15000   // Time the last client gets to empty its outbox
+
 // Function prototypes
 void app_main(void);
 void wifi_station_mode_example(void);
 void wifi_ap_mode_example(void);
 void mqtt_configure(void);
 void mqtt_run(void);
+static void publish_latency_report(int topic_class);
+bool mqtt_stress_test(void);
 //char* get_file_text(string filename);
 
 
 static void esp_app_main(void){
     ESP_LOGI(TAG_WIFI, "ESP32 WiFi Example Starting...");
+
+    // Event handlers log through the deferred logger, keep UART writes off their path
+    ESP32_LOG::BinaryLog::getInstance().start();
     
     // Initialize NVS (required for WiFi)
     esp_err_t ret = nvs_flash_init();
@@ -56,34 +77,64 @@ static void esp_app_main(void){
     wifi_ap_mode_example();
     mqtt_configure();
     mqtt_run();
+#if MQTT_STRESS_TEST
+    if (!mqtt_stress_test()) {
+        ESP_LOGE(TAG_MQTT, "MQTT stress test failed, see the errors above");
+    }
+#endif
     
     ESP_LOGI(TAG_WIFI, "Example complete, entering infinite loop");
 
-    int i = 0;
-    char payload[16];
+    uint32_t i = 0;
+    uint8_t payload[32];
+    const int telemetry_class = MqttClient::getInstance().addLatencyClass("test/telemetry");
 
     while (1) {
         i++;
-        // Format integer into a C-string
-        int len = snprintf(payload, sizeof(payload), "%d", i);
-        if (len < 0 || len >= sizeof(payload)) {
-            ESP_LOGE(TAG_MQTT, "snprintf error or output truncated");
-            len = 0;  // fallback to empty payload
+        // Encode the record as CBOR, a few bytes instead of JSON text
+        CborWriter record(payload, sizeof(payload));
+        record.beginMap(2)
+            .field("seq", i)
+            .field("heap", static_cast<uint32_t>(esp_get_free_heap_size()));
+        if (!record.ok()) {
+            ESP_LOGE(TAG_MQTT, "Telemetry record does not fit in %u bytes", (unsigned)sizeof(payload));
+            vTaskDelay(pdMS_TO_TICKS(2000));
+            continue;
         }
 
-        // Publish using explicit length to skip strlen()
-        int msg_id = mqtt_publish(
-            "test/topic",
-            payload,
-            1,
-            true
-        );
-        ESP_LOGI(TAG_MQTT, "Published msg_id=%d payload='%s'", msg_id, payload);
+        int msg_id = MqttClient::getInstance().publish("test/telemetry", record.span(), 1, true);
+        ESP_LOGI(TAG_MQTT, "Published msg_id=%d seq=%u (%u bytes)", msg_id, (unsigned)i, (unsigned)record.size());
+
+        // Export the ack latency once a minute
+        if (i % 30 == 0 && telemetry_class > 0) {
+            publish_latency_report(telemetry_class);
+        }
 
         vTaskDelay(pdMS_TO_TICKS(2000));
     }
 }
 
+/**
+ * @brief Publish the QoS 1 ack latency of a topic class as CBOR, then start a new period
+ */
+static void publish_latency_report(int topic_class) {
+    MqttClient& client = MqttClient::getInstance();
+    const MqttLatencyStats stats = client.getLatencyStats(topic_class, 1);
+    uint8_t report[96];
+    CborWriter writer(report, sizeof(report));
+    writer.beginMap(7)
+        .field("count", stats.count)
+        .field("timeouts", stats.timeouts)
+        .field("resent", stats.retransmitted)
+        .field("p50_ms", stats.percentile(50))
+        .field("p99_ms", stats.percentile(99))
+        .field("max_ms", stats.max_ms)
+        .field("mean_ms", stats.count ? static_cast<uint32_t>(stats.total_ms / stats.count) : 0u);
+    if (writer.ok() && client.publish("test/metrics/latency", writer.span(), 0, false) >= 0) {
+        client.resetLatencyStats();
+    }
+}
+
 extern "C" void application_main(void){
         esp_app_main();
 }
@@ -225,6 +276,165 @@ void mqtt_run(void) {
     ESP_LOGI(TAG_MQTT, "QoS: %d", subscribe_qos);
 }
 
+/**
+ * @brief Shared state of the publish stress test
+ */
+struct StressRun {
+    std::atomic<bool>     stop{false};
+    std::atomic<bool>     replacing{false};   // recreate() is running
+    std::atomic<uint32_t> generation{0};      // Client replacements done
+    std::atomic<uint32_t> done{0};            // Tasks finished
+    std::atomic<uint32_t> refused{0};         // -1 while the client was being replaced
+    std::atomic<uint32_t> failures{0};        // Results the client must never give
+};
+
+/**
+ * @brief One publishing task and the msg_ids it was given
+ */
+struct StressTask {
+    StressRun* run;
+    uint32_t   count;
+    uint32_t   records[STRESS_RECORDS];   // Client generation << 16 | msg_id
+};
+
+static void stress_task(void* arg) {
+    StressTask* task = static_cast<StressTask*>(arg);
+    StressRun* run = task->run;
+    MqttClient& client = MqttClient::getInstance();
+    char topic[32];
+    snprintf(topic, sizeof(topic), "test/stress/%u", (unsigned)xPortGetCoreID());
+    uint8_t payload[16];
+
+    for (uint32_t n = 0; !run->stop.load(); ++n) {
+        CborWriter record(payload, sizeof(payload));
+        record.beginArray(2).value(n).value(static_cast<uint32_t>(xPortGetCoreID()));
+        const uint32_t generation = run->generation.load();
+        const bool replacing = run->replacing.load();
+        const int msg_id = client.publish(topic, record.span(), 1, false);
+        // Published entirely by one client, without a replacement overlapping the call
+        const bool settled = !replacing && !run->replacing.load() && run->generation.load() == generation;
+
+        // No store and no budget: a QoS 1 publish is queued even while
+        // offline, it only fails while the client is being replaced
+        if (msg_id > 0) {
+            if (settled && task->count < STRESS_RECORDS) {
+                task->records[task->count++] = (generation << 16) | static_cast<uint32_t>(msg_id);
+            }
+        } else if (msg_id == -1 && !settled) {
+            run->refused.fetch_add(1);
+        } else {
+            ESP_LOGE(TAG_MQTT, "Stress test: publish returned %d on core %u%s", msg_id,
+                     (unsigned)xPortGetCoreID(), settled ? "" : " during a replacement");
+            run->failures.fetch_add(1);
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    run->done.fetch_add(1);
+    vTaskDelete(nullptr);
+}
+
+/**
+ * @brief Replace the client repeatedly while tasks on both cores publish QoS 1
+ *
+ * Needs the broker connection made by mqtt_configure(). Fails if a
+ * publish gets a result the client should never give, if one client
+ * hands out the same msg_id twice, if the last client's outbox does not
+ * drain to zero once the broker has acknowledged everything, or if the
+ * heap was corrupted by a handle used after its client was destroyed.
+ *
+ * @return true if every check passed
+ */
+bool mqtt_stress_test(void) {
+    static StressRun run;
+    static StressTask tasks[STRESS_TASKS];
+    static uint32_t ids[STRESS_TASKS * STRESS_RECORDS];
+    MqttClient& client = MqttClient::getInstance();
+    const MqttOutboxStats before = client.getOutboxStats();
+    ESP_LOGI(TAG_MQTT, "Stress test: %d tasks, %d client replacements", STRESS_TASKS, STRESS_ROUNDS);
+
+    uint32_t started = 0;
+    for (int i = 0; i < STRESS_TASKS; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "stress%d", i);
+        tasks[i].run = &run;
+        tasks[i].count = 0;
+        if (xTaskCreatePinnedToCore(stress_task, name, 4096, &tasks[i], 5, nullptr, i % portNUM_PROCESSORS) != pdPASS) {
+            ESP_LOGE(TAG_MQTT, "Failed to create stress task %d", i);
+            break;
+        }
+        ++started;
+    }
+    bool ok = started == STRESS_TASKS;
+
+    // Tear the client down under the publishers' feet, each new one gets time to connect
+    for (int round = 0; ok && round < STRESS_ROUNDS; ++round) {
+        vTaskDelay(pdMS_TO_TICKS(400));
+        run.replacing.store(true);
+        const bool replaced = client.recreate();
+        run.generation.fetch_add(1);
+        run.replacing.store(false);
+        if (!replaced) {
+            ESP_LOGE(TAG_MQTT, "Stress test: client replacement %d failed", round);
+            ok = false;
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS(400));
+    run.stop.store(true);
+    while (run.done.load() < started) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (run.failures.load()) ok = false;
+
+    // esp-mqtt numbers the messages of one client without repeats
+    size_t count = 0;
+    for (const StressTask& task : tasks) {
+        std::copy(task.records, task.records + task.count, ids + count);
+        count += task.count;
+    }
+    std::sort(ids, ids + count);
+    size_t duplicates = 0;
+    for (size_t i = 1; i < count; ++i) {
+        if (ids[i] == ids[i - 1]) {
+            ESP_LOGE(TAG_MQTT, "Stress test: msg_id %u given twice by client %u",
+                     (unsigned)(ids[i] & 0xFFFF), (unsigned)(ids[i] >> 16));
+            ++duplicates;
+        }
+    }
+    if (!count || duplicates) {
+        ESP_LOGE(TAG_MQTT, "Stress test: %u msg_ids checked, %u duplicates", (unsigned)count, (unsigned)duplicates);
+        ok = false;
+    }
+
+    // Every tracked publish of the last client must be acknowledged and released.
+    // Entries left from a replaced client or a lost early ack never would be.
+    MqttOutboxStats stats = client.getOutboxStats();
+    const TickType_t start = xTaskGetTickCount();
+    while ((stats.inflight[1] || stats.inflight[2] || stats.bytes || client.getStatus() != MqttStatus::CONNECTED)
+           && xTaskGetTickCount() - start < pdMS_TO_TICKS(STRESS_DRAIN_MS)) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        stats = client.getOutboxStats();
+    }
+    if (stats.inflight[1] || stats.inflight[2] || stats.bytes) {
+        ESP_LOGE(TAG_MQTT, "Stress test: outbox still holds %u QoS 1 and %u QoS 2 messages, %u bytes",
+                 (unsigned)stats.inflight[1], (unsigned)stats.inflight[2], (unsigned)stats.bytes);
+        ok = false;
+    }
+    if (stats.rejected != before.rejected) {
+        ESP_LOGE(TAG_MQTT, "Stress test: %u publishes refused without an outbox budget",
+                 (unsigned)(stats.rejected - before.rejected));
+        ok = false;
+    }
+    if (!heap_caps_check_integrity_all(true)) {
+        ESP_LOGE(TAG_MQTT, "Stress test: heap corrupted");
+        ok = false;
+    }
+
+    ESP_LOGI(TAG_MQTT, "Stress test %s: %u clients, %u msg_ids checked, %u refused while replacing, %u untracked",
+             ok ? "passed" : "FAILED", (unsigned)run.generation.load() + 1, (unsigned)count,
+             (unsigned)run.refused.load(), (unsigned)(stats.untracked - before.untracked));
+    return ok;
+}
+
 /*
 char* get_file_text(string filename) {
     ifstream file(filename);
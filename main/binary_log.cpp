@@ -0,0 +1,277 @@
+// @file BinaryLog.cpp
+// @brief Implementation of the deferred binary logger
+
+#include "../inc/binary_log.hpp"
+#include <cstdio>
+#include <new>
+
+namespace ESP32_LOG {
+
+BinaryLog& BinaryLog::getInstance() {
+    static BinaryLog instance;
+    return instance;
+}
+
+BinaryLog::BinaryLog()
+    : _config(),
+    _cells(nullptr),
+    _mask(0),
+    _enqueue(0),
+    _dequeue(0),
+    _level(ESP_LOG_VERBOSE),
+    _sink(nullptr),
+    _sinkData(nullptr),
+    _task(nullptr),
+    _running(false),
+    _alive(false),
+    _written(0),
+    _dropped(0)
+{
+}
+
+BinaryLog::~BinaryLog() {
+    stop();
+    delete[] _cells;
+}
+
+bool BinaryLog::start(const BinaryLogConfig& config) {
+    stop();
+    if (config.slots < 2 || config.slots > (1u << 16)) {
+        ESP_LOGE("BLOG", "Invalid binary log configuration");
+        return false;
+    }
+    _config = config;
+
+    if (!_cells) {
+        uint32_t slots = 2;
+        while (slots < config.slots) slots <<= 1;
+        _cells = new (std::nothrow) Cell[slots];
+        if (!_cells) {
+            ESP_LOGE("BLOG", "Failed to allocate %u log records", (unsigned)slots);
+            return false;
+        }
+        for (uint32_t i = 0; i < slots; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        _mask = slots - 1;
+        _enqueue.store(0);
+        _dequeue.store(0);
+    }
+
+    _running.store(true);
+    _alive.store(true);
+    if (xTaskCreatePinnedToCore(&BinaryLog::formatterTask, "blog", config.task_stack, this,
+                                config.task_priority, &_task, config.task_core) != pdPASS) {
+        ESP_LOGE("BLOG", "Failed to create the formatting task");
+        _task = nullptr;
+        _running.store(false);
+        _alive.store(false);
+        return false;
+    }
+    return true;
+}
+
+void BinaryLog::stop() {
+    if (!_task) return;
+    _running.store(false);
+    while (_alive.load()) {
+        vTaskDelay(1);
+    }
+    _task = nullptr;
+    // Records queued while the task was leaving
+    drain();
+}
+
+void BinaryLog::setLevel(esp_log_level_t level) {
+    _level.store(level, std::memory_order_relaxed);
+}
+
+void BinaryLog::setSink(BinaryLogSink sink, void* user_data) {
+    _sink = sink;
+    _sinkData = user_data;
+}
+
+BinaryLogStats BinaryLog::getStats() const {
+    BinaryLogStats stats;
+    stats.written = _written.load(std::memory_order_relaxed);
+    stats.dropped = _dropped.load(std::memory_order_relaxed);
+    stats.pending = _enqueue.load(std::memory_order_relaxed) - _dequeue.load(std::memory_order_relaxed);
+    return stats;
+}
+
+size_t BinaryLog::format(const BinaryLogRecord& record, char* out, size_t size) {
+    if (!out || size == 0) return 0;
+    const char* p = record.format ? record.format : "";
+    size_t len = 0;
+    uint8_t next = 0;
+
+    while (*p && len + 1 < size) {
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+        // Keep flags, width and precision, drop length modifiers: every argument is 32 bits wide
+        char spec[16];
+        size_t n = 0;
+        spec[n++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && n < sizeof(spec) - 2) spec[n++] = *p++;
+        while (*p && strchr("hlLjzt", *p)) ++p;
+        if (!*p) break;
+        const char conv = *p++;
+        if (conv == '%') {
+            out[len++] = '%';
+            continue;
+        }
+        spec[n++] = conv;
+        spec[n] = '\0';
+
+        char* dst = out + len;
+        const size_t room = size - len;
+        int written;
+        if (next >= record.argc) {
+            written = snprintf(dst, room, "?");
+        } else {
+            const uint32_t arg = record.args[next++];
+            switch (conv) {
+                case 'd':
+                case 'i':
+                    written = snprintf(dst, room, spec, static_cast<int>(static_cast<int32_t>(arg)));
+                    break;
+                case 'u':
+                case 'o':
+                case 'x':
+                case 'X':
+                    written = snprintf(dst, room, spec, static_cast<unsigned>(arg));
+                    break;
+                case 'c':
+                    written = snprintf(dst, room, spec, static_cast<int>(arg));
+                    break;
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G': {
+                    float f;
+                    memcpy(&f, &arg, sizeof(f));
+                    written = snprintf(dst, room, spec, static_cast<double>(f));
+                    break;
+                }
+                case 's':
+                    written = snprintf(dst, room, spec, arg < BLOG_TEXT_LEN ? record.text + arg : "");
+                    break;
+                default:
+                    written = snprintf(dst, room, "?");
+                    break;
+            }
+        }
+        if (written > 0) len += static_cast<size_t>(written) < room ? written : room - 1;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+uint32_t BinaryLog::addText(BinaryLogRecord& record, std::string_view text) {
+    // The last byte stays NUL, a string that no longer fits points at it
+    const size_t offset = record.text_len;
+    if (offset >= BLOG_TEXT_LEN - 1) return BLOG_TEXT_LEN - 1;
+    size_t len = BLOG_TEXT_LEN - 1 - offset;
+    if (text.size() < len) len = text.size();
+    memcpy(record.text + offset, text.data(), len);
+    record.text[offset + len] = '\0';
+    record.text_len = static_cast<uint8_t>(offset + len + 1);
+    return static_cast<uint32_t>(offset);
+}
+
+void BinaryLog::submit(const BinaryLogRecord& record) {
+    if (!_running.load(std::memory_order_acquire)) {
+        emit(record);
+        return;
+    }
+    if (push(record)) {
+        _written.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Bounded MPMC ring: each cell's sequence tells whose turn it is, so
+// producers and consumers only contend on their own position counter
+bool BinaryLog::push(const BinaryLogRecord& record) {
+    uint32_t pos = _enqueue.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &_cells[pos & _mask];
+        const uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+        const int32_t diff = static_cast<int32_t>(seq - pos);
+        if (diff == 0) {
+            if (_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = _enqueue.load(std::memory_order_relaxed);
+        }
+    }
+    cell->record = record;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool BinaryLog::pop(BinaryLogRecord& record) {
+    uint32_t pos = _dequeue.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &_cells[pos & _mask];
+        const uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+        const int32_t diff = static_cast<int32_t>(seq - (pos + 1));
+        if (diff == 0) {
+            if (_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            // Empty, or a writer has claimed the cell and not filled it yet
+            return false;
+        } else {
+            pos = _dequeue.load(std::memory_order_relaxed);
+        }
+    }
+    record = cell->record;
+    cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+    return true;
+}
+
+void BinaryLog::drain() {
+    if (!_cells) return;
+    BinaryLogRecord record;
+    while (pop(record)) {
+        emit(record);
+    }
+}
+
+void BinaryLog::emit(const BinaryLogRecord& record) {
+    if (_sink) {
+        _sink(record, _sinkData);
+        return;
+    }
+    static constexpr char LETTERS[] = "NEWIDV";
+    char line[BLOG_LINE_LEN];
+    format(record, line, sizeof(line));
+    const esp_log_level_t level = static_cast<esp_log_level_t>(record.level);
+    const char letter = record.level < sizeof(LETTERS) - 1 ? LETTERS[record.level] : 'V';
+    const char* tag = record.tag ? record.tag : "";
+    esp_log_write(level, tag, "%c (%u) %s: %s\n", letter, (unsigned)record.timestamp_ms, tag, line);
+}
+
+void BinaryLog::formatterTask(void* arg) {
+    BinaryLog* self = static_cast<BinaryLog*>(arg);
+    TickType_t period = pdMS_TO_TICKS(self->_config.drain_ms);
+    if (period == 0) period = 1;
+    while (self->_running.load()) {
+        self->drain();
+        vTaskDelay(period);
+    }
+    self->drain();
+    self->_alive.store(false);
+    vTaskDelete(nullptr);
+}
+
+} // namespace ESP32_LOG
+// End of BinaryLog.cpp
@@ -0,0 +1,502 @@
+// @file Cbor.cpp
+// @brief Implementation of the CBOR encoder and decoder
+
+#include "../inc/cbor.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace ESP32_MQTT {
+
+// Major types, in the top three bits of the initial byte
+static constexpr uint8_t MAJOR_UNSIGNED = 0;
+static constexpr uint8_t MAJOR_NEGATIVE = 1;
+static constexpr uint8_t MAJOR_BYTES    = 2;
+static constexpr uint8_t MAJOR_TEXT     = 3;
+static constexpr uint8_t MAJOR_ARRAY    = 4;
+static constexpr uint8_t MAJOR_MAP      = 5;
+static constexpr uint8_t MAJOR_TAG      = 6;
+static constexpr uint8_t MAJOR_SIMPLE   = 7;
+
+static constexpr uint8_t INFO_INDEFINITE = 31;
+static constexpr uint8_t SIMPLE_FALSE     = 0xF4;
+static constexpr uint8_t SIMPLE_TRUE      = 0xF5;
+static constexpr uint8_t SIMPLE_NULL      = 0xF6;
+static constexpr uint8_t SIMPLE_UNDEFINED = 0xF7;
+static constexpr uint8_t FLOAT_HALF       = 0xF9;
+static constexpr uint8_t FLOAT_SINGLE     = 0xFA;
+static constexpr uint8_t FLOAT_DOUBLE     = 0xFB;
+static constexpr uint8_t BREAK            = 0xFF;
+
+static constexpr int CBOR_MAX_DEPTH = 16;
+
+// Half-precision bits if the float converts without loss
+static bool toHalf(float value, uint16_t& half) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const int exp = static_cast<int>((bits >> 23) & 0xFF) - 127;
+    const uint32_t mant = bits & 0x7FFFFF;
+
+    if (exp == 128) {
+        // Infinity keeps its sign, NaN becomes the canonical quiet NaN
+        half = mant ? 0x7E00 : static_cast<uint16_t>(sign | 0x7C00);
+        return true;
+    }
+    if (exp == -127 && mant == 0) {
+        half = sign;
+        return true;
+    }
+    if (exp >= -14 && exp <= 15) {
+        if (mant & 0x1FFF) return false;
+        half = static_cast<uint16_t>(sign | ((exp + 15) << 10) | (mant >> 13));
+        return true;
+    }
+    if (exp >= -24 && exp < -14) {
+        // Subnormal half, the implicit bit becomes explicit
+        const uint32_t full = mant | 0x800000;
+        const int shift = -exp - 1;
+        if (full & ((1u << shift) - 1)) return false;
+        half = static_cast<uint16_t>(sign | (full >> shift));
+        return true;
+    }
+    return false;
+}
+
+static double fromHalf(uint16_t half) {
+    const int exp = (half >> 10) & 0x1F;
+    const int mant = half & 0x3FF;
+    double value;
+    if (exp == 0) {
+        value = std::ldexp(mant, -24);
+    } else if (exp != 31) {
+        value = std::ldexp(mant + 1024, exp - 25);
+    } else {
+        value = mant ? NAN : INFINITY;
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+// CborArena
+
+CborArena::CborArena(void* buffer, size_t size)
+    : _buffer(static_cast<uint8_t*>(buffer)),
+    _size(buffer ? size : 0),
+    _used(0)
+{
+}
+
+uint8_t* CborArena::allocate(size_t size, size_t align) {
+    const uintptr_t base = reinterpret_cast<uintptr_t>(_buffer);
+    const size_t start = ((base + _used + align - 1) & ~(static_cast<uintptr_t>(align) - 1)) - base;
+    if (start > _size || size > _size - start) return nullptr;
+    _used = start + size;
+    return _buffer + start;
+}
+
+void CborArena::reset() {
+    _used = 0;
+}
+
+size_t CborArena::used() const {
+    return _used;
+}
+
+size_t CborArena::capacity() const {
+    return _size;
+}
+
+// CborWriter
+
+CborWriter::CborWriter(uint8_t* buffer, size_t size)
+    : _buffer(buffer),
+    _size(buffer ? size : 0),
+    _len(0),
+    _overflow(buffer == nullptr)
+{
+}
+
+CborWriter::CborWriter(CborArena& arena, size_t size)
+    : _buffer(arena.allocate(size)),
+    _size(_buffer ? size : 0),
+    _len(0),
+    _overflow(_buffer == nullptr)
+{
+}
+
+CborWriter& CborWriter::unsignedInt(uint64_t value) {
+    head(MAJOR_UNSIGNED, value);
+    return *this;
+}
+
+CborWriter& CborWriter::integer(int64_t value) {
+    if (value >= 0) {
+        head(MAJOR_UNSIGNED, static_cast<uint64_t>(value));
+    } else {
+        // -1 - n without overflowing on INT64_MIN
+        head(MAJOR_NEGATIVE, ~static_cast<uint64_t>(value));
+    }
+    return *this;
+}
+
+CborWriter& CborWriter::boolean(bool value) {
+    const uint8_t byte = value ? SIMPLE_TRUE : SIMPLE_FALSE;
+    put(&byte, 1);
+    return *this;
+}
+
+CborWriter& CborWriter::null() {
+    const uint8_t byte = SIMPLE_NULL;
+    put(&byte, 1);
+    return *this;
+}
+
+CborWriter& CborWriter::floating(double value) {
+    uint8_t out[9];
+    const float single = static_cast<float>(value);
+    uint16_t half;
+    if ((single == value || std::isnan(value)) && toHalf(single, half)) {
+        out[0] = FLOAT_HALF;
+        out[1] = static_cast<uint8_t>(half >> 8);
+        out[2] = static_cast<uint8_t>(half);
+        put(out, 3);
+    } else if (single == value) {
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        out[0] = FLOAT_SINGLE;
+        for (int i = 0; i < 4; ++i) out[1 + i] = static_cast<uint8_t>(bits >> (24 - 8 * i));
+        put(out, 5);
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        out[0] = FLOAT_DOUBLE;
+        for (int i = 0; i < 8; ++i) out[1 + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        put(out, 9);
+    }
+    return *this;
+}
+
+CborWriter& CborWriter::text(std::string_view value) {
+    head(MAJOR_TEXT, value.size());
+    put(value.data(), value.size());
+    return *this;
+}
+
+CborWriter& CborWriter::bytes(std::span<const uint8_t> value) {
+    head(MAJOR_BYTES, value.size());
+    put(value.data(), value.size());
+    return *this;
+}
+
+CborWriter& CborWriter::tag(uint64_t tag) {
+    head(MAJOR_TAG, tag);
+    return *this;
+}
+
+CborWriter& CborWriter::beginArray(size_t count) {
+    if (count == SIZE_MAX) {
+        const uint8_t byte = (MAJOR_ARRAY << 5) | INFO_INDEFINITE;
+        put(&byte, 1);
+    } else {
+        head(MAJOR_ARRAY, count);
+    }
+    return *this;
+}
+
+CborWriter& CborWriter::beginMap(size_t pairs) {
+    if (pairs == SIZE_MAX) {
+        const uint8_t byte = (MAJOR_MAP << 5) | INFO_INDEFINITE;
+        put(&byte, 1);
+    } else {
+        head(MAJOR_MAP, pairs);
+    }
+    return *this;
+}
+
+CborWriter& CborWriter::end() {
+    const uint8_t byte = BREAK;
+    put(&byte, 1);
+    return *this;
+}
+
+bool CborWriter::ok() const {
+    return !_overflow;
+}
+
+std::span<const uint8_t> CborWriter::span() const {
+    return std::span<const uint8_t>(_buffer, _len);
+}
+
+const uint8_t* CborWriter::data() const {
+    return _buffer;
+}
+
+size_t CborWriter::size() const {
+    return _len;
+}
+
+void CborWriter::reset() {
+    _len = 0;
+    _overflow = _buffer == nullptr;
+}
+
+// Initial byte plus the shortest argument encoding
+void CborWriter::head(uint8_t major, uint64_t value) {
+    uint8_t out[9];
+    size_t len;
+    if (value < 24) {
+        out[0] = static_cast<uint8_t>((major << 5) | value);
+        len = 1;
+    } else if (value <= UINT8_MAX) {
+        out[0] = static_cast<uint8_t>((major << 5) | 24);
+        out[1] = static_cast<uint8_t>(value);
+        len = 2;
+    } else if (value <= UINT16_MAX) {
+        out[0] = static_cast<uint8_t>((major << 5) | 25);
+        out[1] = static_cast<uint8_t>(value >> 8);
+        out[2] = static_cast<uint8_t>(value);
+        len = 3;
+    } else if (value <= UINT32_MAX) {
+        out[0] = static_cast<uint8_t>((major << 5) | 26);
+        for (int i = 0; i < 4; ++i) out[1 + i] = static_cast<uint8_t>(value >> (24 - 8 * i));
+        len = 5;
+    } else {
+        out[0] = static_cast<uint8_t>((major << 5) | 27);
+        for (int i = 0; i < 8; ++i) out[1 + i] = static_cast<uint8_t>(value >> (56 - 8 * i));
+        len = 9;
+    }
+    put(out, len);
+}
+
+void CborWriter::put(const void* data, size_t len) {
+    if (_overflow || len > _size - _len) {
+        _overflow = true;
+        return;
+    }
+    if (len) memcpy(_buffer + _len, data, len);
+    _len += len;
+}
+
+// CborReader
+
+CborReader::CborReader(std::span<const uint8_t> data)
+    : _data(data),
+    _pos(0)
+{
+}
+
+bool CborReader::next(CborItem& item) {
+    item = CborItem();
+    if (_pos >= _data.size()) return false;
+    const size_t start = _pos;
+    const uint8_t initial = _data[_pos++];
+    const uint8_t major = initial >> 5;
+    const uint8_t info = initial & 0x1F;
+
+    if (major == MAJOR_SIMPLE) {
+        switch (initial) {
+            case SIMPLE_FALSE:
+            case SIMPLE_TRUE:
+                item.type = CborType::BOOL;
+                item.value = initial == SIMPLE_TRUE;
+                return true;
+            case SIMPLE_NULL:
+                item.type = CborType::NUL;
+                return true;
+            case SIMPLE_UNDEFINED:
+                item.type = CborType::UNDEFINED;
+                return true;
+            case BREAK:
+                item.type = CborType::BREAK;
+                return true;
+            case FLOAT_HALF:
+            case FLOAT_SINGLE:
+            case FLOAT_DOUBLE: {
+                uint64_t bits;
+                if (!argument(info, bits)) {
+                    _pos = start;
+                    return false;
+                }
+                item.type = CborType::FLOAT;
+                if (initial == FLOAT_HALF) {
+                    item.number = fromHalf(static_cast<uint16_t>(bits));
+                } else if (initial == FLOAT_SINGLE) {
+                    uint32_t raw = static_cast<uint32_t>(bits);
+                    float single;
+                    memcpy(&single, &raw, sizeof(single));
+                    item.number = single;
+                } else {
+                    memcpy(&item.number, &bits, sizeof(item.number));
+                }
+                return true;
+            }
+            default:
+                _pos = start;
+                return false;
+        }
+    }
+
+    if (info == INFO_INDEFINITE) {
+        if (major != MAJOR_ARRAY && major != MAJOR_MAP) {
+            _pos = start;
+            return false;
+        }
+        item.indefinite = true;
+    } else if (!argument(info, item.value)) {
+        _pos = start;
+        return false;
+    }
+
+    switch (major) {
+        case MAJOR_UNSIGNED: item.type = CborType::UNSIGNED; break;
+        case MAJOR_NEGATIVE: item.type = CborType::NEGATIVE; break;
+        case MAJOR_ARRAY:    item.type = CborType::ARRAY; break;
+        case MAJOR_MAP:      item.type = CborType::MAP; break;
+        case MAJOR_TAG:      item.type = CborType::TAG; break;
+        default:
+            if (item.value > _data.size() - _pos) {
+                _pos = start;
+                return false;
+            }
+            item.type = (major == MAJOR_TEXT) ? CborType::TEXT : CborType::BYTES;
+            item.bytes = _data.subspan(_pos, item.value);
+            _pos += item.value;
+            break;
+    }
+    return true;
+}
+
+bool CborReader::skip() {
+    const size_t start = _pos;
+    CborItem item;
+    if (next(item) && skipContents(item, 0)) return true;
+    _pos = start;
+    return false;
+}
+
+bool CborReader::readInt(int64_t& value) {
+    const size_t start = _pos;
+    CborItem item;
+    if (next(item) && item.value <= static_cast<uint64_t>(INT64_MAX)) {
+        if (item.type == CborType::UNSIGNED) {
+            value = static_cast<int64_t>(item.value);
+            return true;
+        }
+        if (item.type == CborType::NEGATIVE) {
+            value = -1 - static_cast<int64_t>(item.value);
+            return true;
+        }
+    }
+    _pos = start;
+    return false;
+}
+
+bool CborReader::readUint(uint64_t& value) {
+    const size_t start = _pos;
+    CborItem item;
+    if (next(item) && item.type == CborType::UNSIGNED) {
+        value = item.value;
+        return true;
+    }
+    _pos = start;
+    return false;
+}
+
+bool CborReader::readDouble(double& value) {
+    const size_t start = _pos;
+    CborItem item;
+    if (next(item)) {
+        if (item.type == CborType::FLOAT) {
+            value = item.number;
+            return true;
+        }
+        if (item.type == CborType::UNSIGNED) {
+            value = static_cast<double>(item.value);
+            return true;
+        }
+        if (item.type == CborType::NEGATIVE) {
+            value = -1.0 - static_cast<double>(item.value);
+            return true;
+        }
+    }
+    _pos = start;
+    return false;
+}
+
+bool CborReader::readBool(bool& value) {
+    const size_t start = _pos;
+    CborItem item;
+    if (next(item) && item.type == CborType::BOOL) {
+        value = item.value != 0;
+        return true;
+    }
+    _pos = start;
+    return false;
+}
+
+bool CborReader::readText(std::string_view& value) {
+    const size_t start = _pos;
+    CborItem item;
+    if (next(item) && item.type == CborType::TEXT) {
+        value = std::string_view(reinterpret_cast<const char*>(item.bytes.data()), item.bytes.size());
+        return true;
+    }
+    _pos = start;
+    return false;
+}
+
+bool CborReader::readBytes(std::span<const uint8_t>& value) {
+    const size_t start = _pos;
+    CborItem item;
+    if (next(item) && item.type == CborType::BYTES) {
+        value = item.bytes;
+        return true;
+    }
+    _pos = start;
+    return false;
+}
+
+bool CborReader::atEnd() const {
+    return _pos >= _data.size();
+}
+
+size_t CborReader::offset() const {
+    return _pos;
+}
+
+// Skips what a container or tag item holds, nesting is bounded to protect the stack
+bool CborReader::skipContents(const CborItem& item, int depth) {
+    if (item.type == CborType::BREAK || depth > CBOR_MAX_DEPTH) return false;
+    if (item.type == CborType::TAG) {
+        CborItem inner;
+        return next(inner) && skipContents(inner, depth + 1);
+    }
+    if (item.type != CborType::ARRAY && item.type != CborType::MAP) return true;
+
+    const uint64_t count = (item.type == CborType::MAP) ? item.value * 2 : item.value;
+    for (uint64_t i = 0; item.indefinite || i < count; ++i) {
+        CborItem inner;
+        if (!next(inner)) return false;
+        if (inner.type == CborType::BREAK) return item.indefinite;
+        if (!skipContents(inner, depth + 1)) return false;
+    }
+    return true;
+}
+
+// Big-endian argument following the initial byte
+bool CborReader::argument(uint8_t info, uint64_t& value) {
+    if (info < 24) {
+        value = info;
+        return true;
+    }
+    if (info > 27) return false;
+    const size_t len = size_t(1) << (info - 24);
+    if (len > _data.size() - _pos) return false;
+    value = 0;
+    for (size_t i = 0; i < len; ++i) {
+        value = (value << 8) | _data[_pos++];
+    }
+    return true;
+}
+
+} // namespace ESP32_MQTT
+// End of Cbor.cpp
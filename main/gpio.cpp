@@ -1,7 +1,10 @@
 // @file GpioManager.cpp
 
 #include "../inc/gpio.hpp"
+#include "../inc/binary_log.hpp"
 #include <cstring>
+#include <new>
+#include <vector>
 
 namespace ESP32_GPIO {
 
@@ -10,25 +13,85 @@ namespace ESP32_GPIO {
         return instance;
     }
 
-    GpioManager::GpioManager() : _initialized(false) {
-        std::memset(_configs, 0, sizeof(_configs));
+    GpioManager::GpioManager()
+        : _backend(&defaultGpioBackend()),
+        _initialized(false),
+        _handlerMutex(xSemaphoreCreateMutex()),
+        _wheelTick(0),
+        _debouncedPins(0),
+        _debounceTimer(nullptr),
+        _debounceMutex(nullptr),
+        _stormConfig(),
+        _stormGuard(false),
+        _monitorTimer(nullptr),
+        _eventHead(0),
+        _eventCount(0),
+        _eventsDropped(0),
+        _wakePins(0)
+    {
+        portMUX_INITIALIZE(&_debounceLock);
+        portMUX_INITIALIZE(&_eventLock);
+        for (auto& slot : _slots) {
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+        for (auto& epoch : _isrEpoch) {
+            epoch.store(0, std::memory_order_relaxed);
+        }
+        std::memset(_wheel, 0, sizeof(_wheel));
+        std::memset(_events, 0, sizeof(_events));
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+        std::memset(_glitchFilters, 0, sizeof(_glitchFilters));
+#endif
     }
 
     GpioManager::~GpioManager() {
+        if (_monitorTimer) {
+            _backend->stopTimer(_monitorTimer);
+            _backend->deleteTimer(_monitorTimer);
+        }
+        if (_debounceTimer) {
+            _backend->stopTimer(_debounceTimer);
+            _backend->deleteTimer(_debounceTimer);
+        }
+        for (PinSlot* slot : _slots) {
+            if (!slot) continue;
+            delete slot->records[0].owned;
+            delete slot->records[1].owned;
+            delete slot->debounce;
+            delete slot;
+        }
+        if (_debounceMutex) {
+            vSemaphoreDelete(_debounceMutex);
+        }
+        if (_handlerMutex) {
+            vSemaphoreDelete(_handlerMutex);
+        }
         if (_initialized) {
-            gpio_uninstall_isr_service();
+            _backend->uninstallIsrService();
         }
     }
 
     bool GpioManager::init() {
         if (!_initialized) {
-            if (gpio_install_isr_service(0) == ESP_OK) {
+            if (_backend->installIsrService(0) == ESP_OK) {
                 _initialized = true;
             }
         }
         return _initialized;
     }
 
+    void GpioManager::setBackend(GpioBackend* backend) {
+        if (_initialized || _debounceTimer || _monitorTimer) {
+            ESP_LOGE("GPIO", "Backend must be set before the manager is used");
+            return;
+        }
+        _backend = backend ? backend : &defaultGpioBackend();
+    }
+
+    GpioBackend& GpioManager::backend() const {
+        return *_backend;
+    }
+
     bool GpioManager::configurePin(int pin,
                                 PinMode mode,
                                 bool pull_up,
@@ -37,41 +100,215 @@ namespace ESP32_GPIO {
                                 GpioCallback callback,
                                 bool open_drain,
                                 DriveStrength drive){
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT) return false;
         if (!_initialized) this->init();
 
-        gpio_config_t io_conf = {};
+        gpio_config_t io_conf = makeConfig(mode, pull_up, pull_down, intr, open_drain);
         io_conf.pin_bit_mask = (1ULL << pin);
-        io_conf.mode = static_cast<gpio_mode_t>(mode);
-        io_conf.pull_up_en = pull_up ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
-        io_conf.pull_down_en = pull_down ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE;
-        io_conf.intr_type = static_cast<gpio_int_type_t>(intr);
-        io_conf.mode = open_drain ? GPIO_MODE_INPUT_OUTPUT_OD : io_conf.mode;
 
-        if (gpio_config(&io_conf) != ESP_OK) {
+        if (_backend->configure(io_conf) != ESP_OK) {
             ESP_LOGE("GPIO", "Failed to config pin %d", pin);
             return false;
         }
 
-        gpio_set_drive_capability(static_cast<gpio_num_t>(pin), static_cast<gpio_drive_cap_t>(drive));
+        _backend->setDriveStrength(pin, static_cast<gpio_drive_cap_t>(drive));
 
         if (intr != InterruptTrigger::NONE && callback) {
-            _configs[pin].cb = callback;
-            /*
-            gpio_isr_t isrHandler = [](void* arg) {
-            GpioManager::isrHandler(arg);
-            };
-            */
-            gpio_isr_handler_add(static_cast<gpio_num_t>(pin), GpioManager::isrHandler, reinterpret_cast<void*>(static_cast<intptr_t>(pin)));
+            GpioCallback* owned = new GpioCallback(std::move(callback));
+            if (!swapHandler(pin, &GpioManager::callbackTrampoline, owned, owned)) {
+                delete owned;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool GpioManager::attachHandler(int pin, GpioIsrFn fn, void* arg) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !fn) return false;
+        if (!_initialized) this->init();
+        return swapHandler(pin, fn, arg, nullptr);
+    }
+
+    void GpioManager::detachHandler(int pin) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !slotAt(pin)) return;
+        swapHandler(pin, nullptr, nullptr, nullptr);
+    }
+
+    // Read-copy-update: the new record is filled while unpublished, the
+    // pointer swap is atomic, and the old record is recycled only once no
+    // core can still be dispatching through it
+    bool GpioManager::swapHandler(int pin, GpioIsrFn fn, void* arg, GpioCallback* owned) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !_handlerMutex) return false;
+        xSemaphoreTake(_handlerMutex, portMAX_DELAY);
+        PinSlot* slot = slotFor(pin);
+        if (!slot) {
+            xSemaphoreGive(_handlerMutex);
+            return false;
+        }
+        HandlerRecord* current = slot->handler.load(std::memory_order_relaxed);
+        HandlerRecord* next = nullptr;
+        if (fn) {
+            next = (current == &slot->records[0]) ? &slot->records[1] : &slot->records[0];
+            next->fn = fn;
+            next->arg = arg;
+            next->owned = owned;
+        }
+        slot->handler.store(next, std::memory_order_release);
+
+        if (fn && !slot->registered) {
+            if (_backend->addIsrHandler(pin, GpioManager::isrHandler, slot) != ESP_OK) {
+                // Never reachable from the ISR, the caller still owns the callback
+                ESP_LOGE("GPIO", "Failed to attach handler to pin %d", pin);
+                slot->handler.store(current, std::memory_order_release);
+                *next = HandlerRecord();
+                xSemaphoreGive(_handlerMutex);
+                return false;
+            }
+            slot->registered = true;
+        } else if (!fn && slot->registered) {
+            _backend->removeIsrHandler(pin);
+            slot->registered = false;
+        }
+
+        if (current) {
+            waitForIsrReaders();
+            delete current->owned;
+            *current = HandlerRecord();
+        }
+        xSemaphoreGive(_handlerMutex);
+        return true;
+    }
+
+    // Grace period: every core that was inside a dispatch when the pointer
+    // was swapped has left it. The calling core cannot be inside one, an
+    // ISR always completes before the interrupted task resumes.
+    void GpioManager::waitForIsrReaders() const {
+        // Order the pointer swap before the epoch reads
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int self = xPortGetCoreID();
+        uint32_t seen[portNUM_PROCESSORS];
+        for (int core = 0; core < portNUM_PROCESSORS; ++core) {
+            seen[core] = _isrEpoch[core].load(std::memory_order_acquire);
+        }
+        for (int core = 0; core < portNUM_PROCESSORS; ++core) {
+            if (core == self || !(seen[core] & 1)) continue;
+            while (_isrEpoch[core].load(std::memory_order_acquire) == seen[core]) {
+            }
+        }
+    }
+
+    // Callers hold different locks, or none, so the first slot of a pin is
+    // installed with a compare-exchange and a racing loser is discarded
+    GpioManager::PinSlot* GpioManager::slotFor(int pin) {
+        PinSlot* slot = _slots[pin].load(std::memory_order_acquire);
+        if (slot) return slot;
+        PinSlot* created = new (std::nothrow) PinSlot();
+        if (!created) return nullptr;
+        created->pin = pin;
+        if (_slots[pin].compare_exchange_strong(slot, created, std::memory_order_acq_rel)) {
+            return created;
+        }
+        delete created;
+        return slot;
+    }
+
+    GpioManager::PinSlot* GpioManager::slotAt(int pin) const {
+        return _slots[pin].load(std::memory_order_acquire);
+    }
+
+    GpioManager::DebounceState* GpioManager::debounceOf(int pin) const {
+        const PinSlot* slot = slotAt(pin);
+        return slot ? slot->debounce : nullptr;
+    }
+
+    void GpioManager::callbackTrampoline(int gpio_num, int level, void* arg) {
+        (*static_cast<GpioCallback*>(arg))(gpio_num, level);
+    }
+
+    bool GpioManager::configurePins(const PinSpec* specs, size_t count) {
+        if (!specs) return false;
+        if (!_initialized) this->init();
+
+        // Group pins with identical settings so each group costs one gpio_config call
+        gpio_config_t groups[SOC_GPIO_PIN_COUNT];
+        size_t group_count = 0;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const PinSpec& spec = specs[i];
+            if (spec.pin < 0 || spec.pin >= SOC_GPIO_PIN_COUNT) {
+                ESP_LOGE("GPIO", "Invalid pin %d in configuration table", spec.pin);
+                return false;
+            }
+            if (seen & (1ULL << spec.pin)) {
+                ESP_LOGE("GPIO", "Pin %d listed twice in configuration table", spec.pin);
+                return false;
+            }
+            seen |= (1ULL << spec.pin);
+            gpio_config_t conf = makeConfig(spec.mode, spec.pull_up, spec.pull_down, spec.intr, spec.open_drain);
+            size_t g = 0;
+            while (g < group_count
+                   && !(groups[g].mode == conf.mode
+                        && groups[g].pull_up_en == conf.pull_up_en
+                        && groups[g].pull_down_en == conf.pull_down_en
+                        && groups[g].intr_type == conf.intr_type)) {
+                ++g;
+            }
+            if (g == group_count) {
+                if (group_count == SOC_GPIO_PIN_COUNT) {
+                    ESP_LOGE("GPIO", "Too many distinct settings in configuration table");
+                    return false;
+                }
+                groups[group_count++] = conf;
+            }
+            groups[g].pin_bit_mask |= (1ULL << spec.pin);
         }
+
+        for (size_t g = 0; g < group_count; ++g) {
+            if (_backend->configure(groups[g]) != ESP_OK) {
+                ESP_LOGE("GPIO", "Failed to config pin mask 0x%llx", (unsigned long long)groups[g].pin_bit_mask);
+                return false;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            const PinSpec& spec = specs[i];
+            // Inputs have no driver (GPIO34-39 reject the call) and outputs reset to the default strength
+            if (spec.mode == PinMode::OUTPUT && spec.drive != DriveStrength::DEFAULT) {
+                _backend->setDriveStrength(spec.pin, static_cast<gpio_drive_cap_t>(spec.drive));
+            }
+            if (spec.intr != InterruptTrigger::NONE && spec.callback) {
+                GpioCallback* owned = new GpioCallback(spec.callback);
+                if (!swapHandler(spec.pin, &GpioManager::callbackTrampoline, owned, owned)) {
+                    delete owned;
+                    return false;
+                }
+            }
+        }
+
+        ESP_LOGI("GPIO", "Configured %u pins with %u gpio_config calls", (unsigned)count, (unsigned)group_count);
         return true;
     }
 
+    gpio_config_t GpioManager::makeConfig(PinMode mode,
+                                          bool pull_up,
+                                          bool pull_down,
+                                          InterruptTrigger intr,
+                                          bool open_drain) {
+        gpio_config_t io_conf = {};
+        io_conf.mode = static_cast<gpio_mode_t>(mode);
+        io_conf.pull_up_en = pull_up ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
+        io_conf.pull_down_en = pull_down ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE;
+        io_conf.intr_type = static_cast<gpio_int_type_t>(intr);
+        io_conf.mode = open_drain ? GPIO_MODE_INPUT_OUTPUT_OD : io_conf.mode;
+        return io_conf;
+    }
+
     void GpioManager::setLevel(int pin, uint32_t level) {
-        gpio_set_level(static_cast<gpio_num_t>(pin), level);
+        _backend->setLevel(pin, level);
     }
 
     int GpioManager::getLevel(int pin) const {
-        return gpio_get_level(static_cast<gpio_num_t>(pin));
+        return _backend->getLevel(pin);
     }
 
     void GpioManager::toggle(int pin) {
@@ -79,35 +316,84 @@ namespace ESP32_GPIO {
         setLevel(pin, !lvl);
     }
 
+    uint64_t GpioManager::readPort() const {
+        return _backend->readPort();
+    }
+
+    void GpioManager::writePort(uint64_t set_mask, uint64_t clear_mask) {
+        _backend->writePort(set_mask, clear_mask);
+    }
+
     void GpioManager::resetPin(int pin) {
-        gpio_reset_pin(static_cast<gpio_num_t>(pin));
+        _backend->resetPin(pin);
     }
 
     void GpioManager::setDriveStrength(int pin, DriveStrength strength) {
-        gpio_set_drive_capability(static_cast<gpio_num_t>(pin), static_cast<gpio_drive_cap_t>(strength));
+        _backend->setDriveStrength(pin, static_cast<gpio_drive_cap_t>(strength));
     }
 
-    /*
     void GpioManager::enableGlitchFilter(int pin) {
-        gpio_glitch_filter_config_t filter_cfg = {
-            .gpio_num = static_cast<gpio_num_t>(pin),
-            .clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT
-        };
-        gpio_new_glitch_filter(&filter_cfg, nullptr);
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+        if (_glitchFilters[pin]) return;
+
+        gpio_pin_glitch_filter_config_t filter_cfg = {};
+        filter_cfg.clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT;
+        filter_cfg.gpio_num = static_cast<gpio_num_t>(pin);
+
+        gpio_glitch_filter_handle_t filter = nullptr;
+        if (gpio_new_pin_glitch_filter(&filter_cfg, &filter) != ESP_OK) {
+            ESP_LOGE("GPIO", "Failed to create glitch filter for pin %d", pin);
+            return;
+        }
+        if (gpio_glitch_filter_enable(filter) != ESP_OK) {
+            ESP_LOGE("GPIO", "Failed to enable glitch filter for pin %d", pin);
+            gpio_del_glitch_filter(filter);
+            return;
+        }
+        _glitchFilters[pin] = filter;
+#else
+        ESP_LOGW("GPIO", "No glitch filter on this target, pin %d unfiltered", pin);
+#endif
     }
 
     void GpioManager::disableGlitchFilter(int pin) {
-        gpio_del_glitch_filter(static_cast<gpio_num_t>(pin));
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+        gpio_glitch_filter_handle_t filter = _glitchFilters[pin];
+        if (!filter) return;
+        gpio_glitch_filter_disable(filter);
+        gpio_del_glitch_filter(filter);
+        _glitchFilters[pin] = nullptr;
+#endif
     }
-    */
 
     void GpioManager::isrHandler(void* arg) {
-        int pin = static_cast<int>(reinterpret_cast<intptr_t>(arg));
-        int level = gpio_get_level(static_cast<gpio_num_t>(pin));
-        auto& cfg = getInstance()._configs[pin];
-        if (cfg.cb) {
-            cfg.cb(pin, level);
+        PinSlot* slot = static_cast<PinSlot*>(arg);
+        int pin = slot->pin;
+        GpioManager& self = getInstance();
+
+        IrqCounters& irq = slot->irq;
+        irq.total.fetch_add(1, std::memory_order_relaxed);
+        uint32_t in_window = irq.window.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (self._stormGuard.load(std::memory_order_relaxed)) {
+            uint32_t budget = irq.budget.load(std::memory_order_relaxed);
+            if (!budget) budget = self._stormConfig.max_per_window;
+            if (budget && in_window > budget) {
+                // Mask the pin, the monitor timer re-arms it after the cooldown
+                self._backend->disableIntr(pin);
+                irq.masked.store(true, std::memory_order_relaxed);
+                irq.mask_events.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
         }
+
+        // The epoch is odd for as long as the record may be in use on this core
+        std::atomic<uint32_t>& epoch = self._isrEpoch[xPortGetCoreID()];
+        epoch.fetch_add(1);
+        const HandlerRecord* handler = slot->handler.load(std::memory_order_acquire);
+        if (handler) {
+            handler->fn(pin, self._backend->getLevel(pin), handler->arg);
+        }
+        epoch.fetch_add(1, std::memory_order_release);
     }
 
     esp_err_t GpioManager::set_isr_handler(void (*fn)(void*), void *arg, int intr_alloc_flags, gpio_isr_handle_t *handle) {
@@ -115,7 +401,437 @@ namespace ESP32_GPIO {
             ESP_LOGE("GPIO", "GpioManager not initialized");
             return ESP_ERR_INVALID_STATE;
         }
-        return gpio_isr_handler_add(static_cast<gpio_num_t>(reinterpret_cast<intptr_t>(arg)), fn, arg);
+        return _backend->addIsrHandler(static_cast<int>(reinterpret_cast<intptr_t>(arg)), fn, arg);
+    }
+
+    bool GpioManager::enableStormGuard(const StormGuardConfig& config) {
+        if (config.window_ms == 0) return false;
+
+        if (!_monitorTimer) {
+            if (_backend->createTimer(&GpioManager::monitorTimerCb, this, "gpio_monitor", &_monitorTimer) != ESP_OK) {
+                ESP_LOGE("GPIO", "Failed to create interrupt monitor timer");
+                return false;
+            }
+        }
+
+        _stormGuard.store(false);
+        _backend->stopTimer(_monitorTimer);
+        _stormConfig = config;
+        for (PinSlot* slot : _slots) {
+            if (slot) slot->irq.window.store(0, std::memory_order_relaxed);
+        }
+        _stormGuard.store(true);
+        return _backend->startTimerPeriodic(_monitorTimer, config.window_ms * 1000ULL) == ESP_OK;
+    }
+
+    void GpioManager::disableStormGuard() {
+        _stormGuard.store(false);
+        if (_monitorTimer) {
+            _backend->stopTimer(_monitorTimer);
+        }
+        for (PinSlot* slot : _slots) {
+            if (slot && slot->irq.masked.exchange(false)) {
+                slot->irq.rearm_at_us = 0;
+                _backend->enableIntr(slot->pin);
+            }
+        }
+    }
+
+    void GpioManager::setInterruptBudget(int pin, uint32_t max_per_window) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT) return;
+        PinSlot* slot = slotFor(pin);
+        if (slot) slot->irq.budget.store(max_per_window, std::memory_order_relaxed);
+    }
+
+    bool GpioManager::getIrqStats(int pin, PinIrqStats& stats) const {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT) return false;
+        const PinSlot* slot = slotAt(pin);
+        if (!slot) {
+            stats = {};
+            return true;
+        }
+        const IrqCounters& irq = slot->irq;
+        stats.total = irq.total.load(std::memory_order_relaxed);
+        stats.rate_hz = irq.rate_hz;
+        stats.peak_rate_hz = irq.peak_rate_hz;
+        stats.mask_events = irq.mask_events.load(std::memory_order_relaxed);
+        stats.masked = irq.masked.load(std::memory_order_relaxed);
+        return true;
+    }
+
+    void GpioManager::resetIrqStats(int pin) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !slotAt(pin)) return;
+        IrqCounters& irq = slotAt(pin)->irq;
+        irq.total.store(0, std::memory_order_relaxed);
+        irq.mask_events.store(0, std::memory_order_relaxed);
+        irq.rate_hz = 0;
+        irq.peak_rate_hz = 0;
+    }
+
+    void GpioManager::monitorTimerCb(void* arg) {
+        static_cast<GpioManager*>(arg)->monitorTick();
+    }
+
+    void GpioManager::monitorTick() {
+        int64_t now = _backend->nowUs();
+        uint32_t window_ms = _stormConfig.window_ms;
+
+        for (PinSlot* slot : _slots) {
+            if (!slot) continue;
+            int pin = slot->pin;
+            IrqCounters& irq = slot->irq;
+            uint32_t count = irq.window.exchange(0, std::memory_order_relaxed);
+            irq.rate_hz = static_cast<uint32_t>(count * 1000ULL / window_ms);
+            if (irq.rate_hz > irq.peak_rate_hz) irq.peak_rate_hz = irq.rate_hz;
+
+            if (!irq.masked.load(std::memory_order_relaxed)) continue;
+            if (irq.rearm_at_us == 0) {
+                irq.rearm_at_us = now + _stormConfig.cooldown_ms * 1000LL;
+                BLOG_W("GPIO", "Interrupt storm on pin %d (%u irq/s), masked for %u ms",
+                       pin, (unsigned)irq.rate_hz, (unsigned)_stormConfig.cooldown_ms);
+            } else if (now >= irq.rearm_at_us) {
+                irq.rearm_at_us = 0;
+                irq.masked.store(false, std::memory_order_relaxed);
+                _backend->enableIntr(pin);
+                BLOG_I("GPIO", "Pin %d interrupt re-armed", pin);
+            }
+        }
+    }
+
+    bool GpioManager::addDebouncedPin(int pin, const DebounceConfig& config, ButtonCallback callback) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !callback) return false;
+
+        if (!_debounceMutex) {
+            _debounceMutex = xSemaphoreCreateRecursiveMutex();
+            if (!_debounceMutex) return false;
+        }
+        if (!_debounceTimer) {
+            if (_backend->createTimer(&GpioManager::debounceTimerCb, this, "gpio_debounce", &_debounceTimer) != ESP_OK) {
+                ESP_LOGE("GPIO", "Failed to create debounce timer");
+                return false;
+            }
+        }
+
+        xSemaphoreTakeRecursive(_debounceMutex, portMAX_DELAY);
+        PinSlot* slot = slotFor(pin);
+        if (!slot) {
+            xSemaphoreGiveRecursive(_debounceMutex);
+            return false;
+        }
+        bool added = !slot->debounce;
+        if (added) {
+            slot->debounce = new DebounceState();
+            ++_debouncedPins;
+        }
+        DebounceState* st = slot->debounce;
+        st->cb = callback;
+        st->stable_ticks = (config.stable_ms + GPIO_DEBOUNCE_TICK_MS - 1) / GPIO_DEBOUNCE_TICK_MS;
+        st->long_ticks = (config.long_press_ms + GPIO_DEBOUNCE_TICK_MS - 1) / GPIO_DEBOUNCE_TICK_MS;
+        if (st->stable_ticks == 0) st->stable_ticks = 1;
+        st->deadline = 0;
+        st->press_tick = 0;
+        st->active_low = config.active_low;
+        st->pressed = false;
+        st->long_fired = false;
+        xSemaphoreGiveRecursive(_debounceMutex);
+
+        bool ok = configurePin(pin,
+            PinMode::INPUT,
+            config.pull && config.active_low,
+            config.pull && !config.active_low,
+            InterruptTrigger::BOTH)
+            && attachHandler(pin, &GpioManager::debounceIsr, this);
+        if (!ok) {
+            removeDebouncedPin(pin);
+            return false;
+        }
+
+        if (config.glitch_filter) {
+            enableGlitchFilter(pin);
+        }
+
+        // Seed the debounced state from the current level so no spurious event is reported
+        portENTER_CRITICAL(&_debounceLock);
+        st->pressed = (_backend->getLevel(pin) == 0) == st->active_low;
+        st->press_tick = _wheelTick;
+        portEXIT_CRITICAL(&_debounceLock);
+
+        if (!_backend->isTimerActive(_debounceTimer)) {
+            _backend->startTimerPeriodic(_debounceTimer, GPIO_DEBOUNCE_TICK_MS * 1000ULL);
+        }
+        return true;
+    }
+
+    bool GpioManager::setDebounceTime(int pin, uint32_t stable_ms, uint32_t long_press_ms) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !_debounceMutex) return false;
+
+        xSemaphoreTakeRecursive(_debounceMutex, portMAX_DELAY);
+        DebounceState* st = debounceOf(pin);
+        if (st) {
+            portENTER_CRITICAL(&_debounceLock);
+            st->stable_ticks = (stable_ms + GPIO_DEBOUNCE_TICK_MS - 1) / GPIO_DEBOUNCE_TICK_MS;
+            st->long_ticks = (long_press_ms + GPIO_DEBOUNCE_TICK_MS - 1) / GPIO_DEBOUNCE_TICK_MS;
+            if (st->stable_ticks == 0) st->stable_ticks = 1;
+            portEXIT_CRITICAL(&_debounceLock);
+        }
+        xSemaphoreGiveRecursive(_debounceMutex);
+        return st != nullptr;
+    }
+
+    bool GpioManager::removeDebouncedPin(int pin) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !_debounceMutex) return false;
+
+        xSemaphoreTakeRecursive(_debounceMutex, portMAX_DELAY);
+        if (!debounceOf(pin)) {
+            xSemaphoreGiveRecursive(_debounceMutex);
+            return false;
+        }
+
+        detachHandler(pin);
+        _backend->setIntrType(pin, GPIO_INTR_DISABLE);
+        disableGlitchFilter(pin);
+
+        portENTER_CRITICAL(&_debounceLock);
+        PinSlot* slot = slotAt(pin);
+        DebounceState* st = slot->debounce;
+        slot->debounce = nullptr;
+        portEXIT_CRITICAL(&_debounceLock);
+        if (--_debouncedPins == 0) {
+            _backend->stopTimer(_debounceTimer);
+        }
+        xSemaphoreGiveRecursive(_debounceMutex);
+
+        delete st;
+        return true;
+    }
+
+    bool GpioManager::isPressed(int pin) const {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !_debounceMutex) return false;
+        xSemaphoreTakeRecursive(_debounceMutex, portMAX_DELAY);
+        const DebounceState* st = debounceOf(pin);
+        bool pressed = st && st->pressed;
+        xSemaphoreGiveRecursive(_debounceMutex);
+        return pressed;
+    }
+
+    void GpioManager::debounceIsr(int gpio_num, int level, void* arg) {
+        static_cast<GpioManager*>(arg)->debounceEdge(gpio_num);
+    }
+
+    // Called from isrHandler on every edge of a debounced pin
+    void GpioManager::debounceEdge(int pin) {
+        portENTER_CRITICAL_ISR(&_debounceLock);
+        DebounceState* st = debounceOf(pin);
+        if (st) {
+            scheduleDebounce(pin, _wheelTick + st->stable_ticks);
+        }
+        portEXIT_CRITICAL_ISR(&_debounceLock);
+    }
+
+    // Caller must hold _debounceLock
+    void GpioManager::scheduleDebounce(int pin, uint32_t deadline) {
+        // A newer deadline supersedes any bucket entry left by the previous one
+        slotAt(pin)->debounce->deadline = deadline;
+        _wheel[deadline % GPIO_DEBOUNCE_WHEEL_SLOTS] |= (1ULL << pin);
+    }
+
+    void GpioManager::debounceTimerCb(void* arg) {
+        static_cast<GpioManager*>(arg)->debounceTick();
+    }
+
+    void GpioManager::debounceTick() {
+        xSemaphoreTakeRecursive(_debounceMutex, portMAX_DELAY);
+
+        portENTER_CRITICAL(&_debounceLock);
+        uint32_t tick = ++_wheelTick;
+        uint64_t due = _wheel[tick % GPIO_DEBOUNCE_WHEEL_SLOTS];
+        _wheel[tick % GPIO_DEBOUNCE_WHEEL_SLOTS] = 0;
+        portEXIT_CRITICAL(&_debounceLock);
+
+        while (due) {
+            int pin = __builtin_ctzll(due);
+            due &= due - 1;
+
+            ButtonEvent event;
+            bool report = false;
+
+            portENTER_CRITICAL(&_debounceLock);
+            DebounceState* st = debounceOf(pin);
+            if (!st) {
+                portEXIT_CRITICAL(&_debounceLock);
+                continue;
+            }
+            int32_t remaining = static_cast<int32_t>(st->deadline - tick);
+            if (remaining > 0) {
+                // Deadline is one or more wheel revolutions away, keep waiting
+                _wheel[tick % GPIO_DEBOUNCE_WHEEL_SLOTS] |= (1ULL << pin);
+                portEXIT_CRITICAL(&_debounceLock);
+                continue;
+            }
+            if (remaining < 0) {
+                // Stale entry, the pin was rescheduled by a later edge
+                portEXIT_CRITICAL(&_debounceLock);
+                continue;
+            }
+
+            bool pressed = (_backend->getLevel(pin) == 0) == st->active_low;
+            if (pressed != st->pressed) {
+                st->pressed = pressed;
+                event = pressed ? ButtonEvent::PRESS : ButtonEvent::RELEASE;
+                report = true;
+                if (pressed) {
+                    st->press_tick = tick;
+                    st->long_fired = false;
+                }
+            } else if (pressed && st->long_ticks && !st->long_fired
+                       && tick - st->press_tick >= st->long_ticks) {
+                st->long_fired = true;
+                event = ButtonEvent::LONG_PRESS;
+                report = true;
+            }
+            if (st->pressed && st->long_ticks && !st->long_fired) {
+                uint32_t long_deadline = st->press_tick + st->long_ticks;
+                scheduleDebounce(pin, static_cast<int32_t>(long_deadline - tick) > 0 ? long_deadline : tick + 1);
+            }
+            portEXIT_CRITICAL(&_debounceLock);
+
+            if (report) {
+                // Run a copy: the callback may remove or re-add its own pin,
+                // which replaces or deletes st->cb while it is executing
+                ButtonCallback cb = st->cb;
+                if (cb) cb(pin, event);
+            }
+        }
+
+        xSemaphoreGiveRecursive(_debounceMutex);
+    }
+
+    bool GpioManager::enableWakePin(int pin, bool pull_up, bool pull_down, GpioCallback callback) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT) return false;
+        // Wake pins dispatch through wakeIsr, do not silently drop another handler
+        const PinSlot* existing = slotAt(pin);
+        const HandlerRecord* current = existing ? existing->handler.load(std::memory_order_acquire) : nullptr;
+        if (current && current->fn != &GpioManager::wakeIsr) {
+            ESP_LOGE("GPIO", "Pin %d already has an interrupt handler", pin);
+            return false;
+        }
+        if (!configurePin(pin, PinMode::INPUT, pull_up, pull_down, InterruptTrigger::BOTH)
+            || !attachHandler(pin, &GpioManager::wakeIsr, this)) {
+            ESP_LOGE("GPIO", "Failed to configure wake pin %d", pin);
+            return false;
+        }
+        slotAt(pin)->wake_cb = std::move(callback);
+        portENTER_CRITICAL(&_eventLock);
+        slotAt(pin)->wake_level = _backend->getLevel(pin);
+        _wakePins |= (1ULL << pin);
+        portEXIT_CRITICAL(&_eventLock);
+        return true;
+    }
+
+    void GpioManager::disableWakePin(int pin) {
+        if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !(_wakePins & (1ULL << pin))) return;
+        detachHandler(pin);
+        _backend->disableWakeup(pin);
+        portENTER_CRITICAL(&_eventLock);
+        _wakePins &= ~(1ULL << pin);
+        slotAt(pin)->wake_level = -1;
+        portEXIT_CRITICAL(&_eventLock);
+        slotAt(pin)->wake_cb = nullptr;
+    }
+
+    void GpioManager::setEventBatchCallback(GpioBatchCallback callback) {
+        _batchCallback = std::move(callback);
+    }
+
+    esp_err_t GpioManager::lightSleep(uint64_t timeout_us) {
+        // Arm each pin to wake on the level opposite to the one it has now.
+        // The edge interrupt is masked meanwhile, the ESP32 wake logic turns
+        // it into a level interrupt that would fire continuously.
+        uint64_t pins = _wakePins;
+        for (uint64_t rest = pins; rest; rest &= rest - 1) {
+            int pin = __builtin_ctzll(rest);
+            _backend->disableIntr(pin);
+            int level = _backend->getLevel(pin);
+            portENTER_CRITICAL(&_eventLock);
+            if (level != slotAt(pin)->wake_level) pushEvent(pin, level);
+            portEXIT_CRITICAL(&_eventLock);
+            _backend->enableWakeup(pin, level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+        }
+
+        esp_err_t err = _backend->lightSleep(timeout_us);
+
+        // Restore edge interrupts and queue every change the ISR did not see
+        for (uint64_t rest = pins; rest; rest &= rest - 1) {
+            int pin = __builtin_ctzll(rest);
+            _backend->disableWakeup(pin);
+            _backend->setIntrType(pin, GPIO_INTR_ANYEDGE);
+            int level = _backend->getLevel(pin);
+            portENTER_CRITICAL(&_eventLock);
+            if (level != slotAt(pin)->wake_level) pushEvent(pin, level);
+            portEXIT_CRITICAL(&_eventLock);
+            // A pin the storm guard has masked stays masked until monitorTick rearms it
+            if (!slotAt(pin)->irq.masked.load(std::memory_order_relaxed)) {
+                _backend->enableIntr(pin);
+            }
+        }
+
+        if (err != ESP_OK) {
+            ESP_LOGE("GPIO", "Light sleep failed: %s", esp_err_to_name(err));
+        }
+        flushEvents();
+        return err;
+    }
+
+    size_t GpioManager::flushEvents() {
+        GpioEvent batch[GPIO_EVENT_QUEUE_LEN];
+        portENTER_CRITICAL(&_eventLock);
+        size_t count = _eventCount;
+        for (size_t i = 0; i < count; ++i) {
+            batch[i] = _events[(_eventHead + i) % GPIO_EVENT_QUEUE_LEN];
+        }
+        _eventHead = 0;
+        _eventCount = 0;
+        portEXIT_CRITICAL(&_eventLock);
+
+        if (count && _batchCallback) {
+            _batchCallback(batch, count);
+        }
+        // Then each edge to the callback of its pin, in the order they were seen
+        for (size_t i = 0; i < count; ++i) {
+            const PinSlot* slot = slotAt(batch[i].pin);
+            if (!slot || !slot->wake_cb) continue;
+            // A copy, the callback may disable its own pin
+            GpioCallback cb = slot->wake_cb;
+            cb(batch[i].pin, batch[i].level);
+        }
+        return count;
+    }
+
+    uint32_t GpioManager::getDroppedEvents() const {
+        return _eventsDropped;
+    }
+
+    void GpioManager::wakeIsr(int gpio_num, int level, void* arg) {
+        GpioManager* self = static_cast<GpioManager*>(arg);
+        portENTER_CRITICAL_ISR(&self->_eventLock);
+        if (level != self->slotAt(gpio_num)->wake_level) {
+            self->pushEvent(gpio_num, level);
+        }
+        portEXIT_CRITICAL_ISR(&self->_eventLock);
+    }
+
+    // Caller must hold _eventLock
+    void GpioManager::pushEvent(int pin, int level) {
+        slotAt(pin)->wake_level = level;
+        if (_eventCount == GPIO_EVENT_QUEUE_LEN) {
+            ++_eventsDropped;
+            return;
+        }
+        GpioEvent& event = _events[(_eventHead + _eventCount) % GPIO_EVENT_QUEUE_LEN];
+        event.pin = pin;
+        event.level = level;
+        event.time_us = _backend->nowUs();
+        ++_eventCount;
     }
 
     extern "C" {
@@ -140,6 +856,21 @@ namespace ESP32_GPIO {
             ) ? 1 : 0;
     }
 
+    int gpio_mgr_configure_table(const gpio_mgr_pin_spec_t* specs, size_t count) {
+        if (!specs) return 0;
+        std::vector<ESP32_GPIO::PinSpec> table(count);
+        for (size_t i = 0; i < count; ++i) {
+            table[i].pin = specs[i].pin;
+            table[i].mode = static_cast<ESP32_GPIO::PinMode>(specs[i].mode);
+            table[i].pull_up = specs[i].pull_up;
+            table[i].pull_down = specs[i].pull_down;
+            table[i].intr = static_cast<ESP32_GPIO::InterruptTrigger>(specs[i].intr_type);
+            table[i].open_drain = specs[i].open_drain;
+            table[i].drive = static_cast<ESP32_GPIO::DriveStrength>(specs[i].drive);
+        }
+        return ESP32_GPIO::GpioManager::getInstance().configurePins(table.data(), table.size()) ? 1 : 0;
+    }
+
     void gpio_mgr_set_level(int pin, int level) {
         ESP32_GPIO::GpioManager::getInstance().setLevel(pin, level);
     }
@@ -168,6 +899,84 @@ namespace ESP32_GPIO {
         ESP32_GPIO::GpioManager::getInstance().disableGlitchFilter(pin);
     }
 
+    bool gpio_mgr_isr_register(void (*fn)(void*), void *arg, int intr_alloc_flags, gpio_isr_handle_t *handle) {
+        return ESP32_GPIO::GpioManager::getInstance().set_isr_handler(fn, arg, intr_alloc_flags, handle) == ESP_OK;
+    }
+
+    int gpio_mgr_add_debounce(int pin,
+        uint32_t stable_ms,
+        uint32_t long_press_ms,
+        bool active_low,
+        gpio_mgr_button_cb_t cb,
+        void* arg
+    ) {
+        if (!cb) return 0;
+        ESP32_GPIO::DebounceConfig config;
+        config.stable_ms = stable_ms;
+        config.long_press_ms = long_press_ms;
+        config.active_low = active_low;
+        return ESP32_GPIO::GpioManager::getInstance().addDebouncedPin(
+            pin,
+            config,
+            [cb, arg](int gpio_num, ESP32_GPIO::ButtonEvent event) {
+                cb(gpio_num, static_cast<int>(event), arg);
+            }
+            ) ? 1 : 0;
+    }
+
+    int gpio_mgr_remove_debounce(int pin) {
+        return ESP32_GPIO::GpioManager::getInstance().removeDebouncedPin(pin) ? 1 : 0;
+    }
+
+    int gpio_mgr_enable_storm_guard(uint32_t max_per_window, uint32_t window_ms, uint32_t cooldown_ms) {
+        ESP32_GPIO::StormGuardConfig config;
+        config.max_per_window = max_per_window;
+        config.window_ms = window_ms;
+        config.cooldown_ms = cooldown_ms;
+        return ESP32_GPIO::GpioManager::getInstance().enableStormGuard(config) ? 1 : 0;
+    }
+
+    void gpio_mgr_disable_storm_guard(void) {
+        ESP32_GPIO::GpioManager::getInstance().disableStormGuard();
+    }
+
+    int gpio_mgr_get_irq_stats(int pin, uint32_t* total, uint32_t* rate_hz, uint32_t* mask_events) {
+        ESP32_GPIO::PinIrqStats stats;
+        if (!ESP32_GPIO::GpioManager::getInstance().getIrqStats(pin, stats)) return 0;
+        if (total) *total = stats.total;
+        if (rate_hz) *rate_hz = stats.rate_hz;
+        if (mask_events) *mask_events = stats.mask_events;
+        return 1;
+    }
+
+    int gpio_mgr_enable_wake_pin(int pin, bool pull_up, bool pull_down) {
+        return ESP32_GPIO::GpioManager::getInstance().enableWakePin(pin, pull_up, pull_down) ? 1 : 0;
+    }
+
+    void gpio_mgr_disable_wake_pin(int pin) {
+        ESP32_GPIO::GpioManager::getInstance().disableWakePin(pin);
+    }
+
+    void gpio_mgr_set_batch_cb(gpio_mgr_batch_cb_t cb, void* arg) {
+        static_assert(sizeof(gpio_mgr_event_t) == sizeof(ESP32_GPIO::GpioEvent), "event layouts differ");
+        if (!cb) {
+            ESP32_GPIO::GpioManager::getInstance().setEventBatchCallback(nullptr);
+            return;
+        }
+        ESP32_GPIO::GpioManager::getInstance().setEventBatchCallback(
+            [cb, arg](const ESP32_GPIO::GpioEvent* events, size_t count) {
+                cb(reinterpret_cast<const gpio_mgr_event_t*>(events), count, arg);
+            });
+    }
+
+    int gpio_mgr_light_sleep(uint64_t timeout_us) {
+        return ESP32_GPIO::GpioManager::getInstance().lightSleep(timeout_us) == ESP_OK ? 1 : 0;
+    }
+
+    size_t gpio_mgr_flush_events(void) {
+        return ESP32_GPIO::GpioManager::getInstance().flushEvents();
+    }
+
     } // extern "C"
 
 } // namespace ESP32_GPIO
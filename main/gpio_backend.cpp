@@ -0,0 +1,142 @@
+// @file GpioBackend.cpp
+// @brief ESP-IDF implementation of the GPIO backend
+
+#include "../inc/gpio_backend.hpp"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
+
+namespace ESP32_GPIO {
+
+    GpioBackend& defaultGpioBackend() {
+        static Esp32GpioBackend backend;
+        return backend;
+    }
+
+    esp_err_t Esp32GpioBackend::configure(const gpio_config_t& config) {
+        return gpio_config(&config);
+    }
+
+    esp_err_t Esp32GpioBackend::resetPin(int pin) {
+        return gpio_reset_pin(static_cast<gpio_num_t>(pin));
+    }
+
+    esp_err_t Esp32GpioBackend::setLevel(int pin, uint32_t level) {
+        return gpio_set_level(static_cast<gpio_num_t>(pin), level);
+    }
+
+    int Esp32GpioBackend::getLevel(int pin) {
+        return gpio_get_level(static_cast<gpio_num_t>(pin));
+    }
+
+    esp_err_t Esp32GpioBackend::setDriveStrength(int pin, gpio_drive_cap_t strength) {
+        return gpio_set_drive_capability(static_cast<gpio_num_t>(pin), strength);
+    }
+
+    uint64_t Esp32GpioBackend::readPort() {
+        uint64_t levels = REG_READ(GPIO_IN_REG);
+#if SOC_GPIO_PIN_COUNT > 32
+        levels |= static_cast<uint64_t>(REG_READ(GPIO_IN1_REG)) << 32;
+#endif
+        return levels;
+    }
+
+    void Esp32GpioBackend::writePort(uint64_t set_mask, uint64_t clear_mask) {
+        // W1TS/W1TC registers touch only the given bits, no read-modify-write
+        if (static_cast<uint32_t>(set_mask)) REG_WRITE(GPIO_OUT_W1TS_REG, static_cast<uint32_t>(set_mask));
+        if (static_cast<uint32_t>(clear_mask)) REG_WRITE(GPIO_OUT_W1TC_REG, static_cast<uint32_t>(clear_mask));
+#if SOC_GPIO_PIN_COUNT > 32
+        if (set_mask >> 32) REG_WRITE(GPIO_OUT1_W1TS_REG, static_cast<uint32_t>(set_mask >> 32));
+        if (clear_mask >> 32) REG_WRITE(GPIO_OUT1_W1TC_REG, static_cast<uint32_t>(clear_mask >> 32));
+#endif
+    }
+
+    esp_err_t Esp32GpioBackend::installIsrService(int intr_alloc_flags) {
+        return gpio_install_isr_service(intr_alloc_flags);
+    }
+
+    void Esp32GpioBackend::uninstallIsrService() {
+        gpio_uninstall_isr_service();
+    }
+
+    esp_err_t Esp32GpioBackend::addIsrHandler(int pin, gpio_isr_t fn, void* arg) {
+        return gpio_isr_handler_add(static_cast<gpio_num_t>(pin), fn, arg);
+    }
+
+    esp_err_t Esp32GpioBackend::removeIsrHandler(int pin) {
+        return gpio_isr_handler_remove(static_cast<gpio_num_t>(pin));
+    }
+
+    esp_err_t Esp32GpioBackend::setIntrType(int pin, gpio_int_type_t type) {
+        return gpio_set_intr_type(static_cast<gpio_num_t>(pin), type);
+    }
+
+    esp_err_t Esp32GpioBackend::enableIntr(int pin) {
+        return gpio_intr_enable(static_cast<gpio_num_t>(pin));
+    }
+
+    esp_err_t Esp32GpioBackend::disableIntr(int pin) {
+        return gpio_intr_disable(static_cast<gpio_num_t>(pin));
+    }
+
+    esp_err_t Esp32GpioBackend::enableWakeup(int pin, gpio_int_type_t level) {
+        esp_err_t err = gpio_wakeup_enable(static_cast<gpio_num_t>(pin), level);
+        if (err != ESP_OK) return err;
+        return esp_sleep_enable_gpio_wakeup();
+    }
+
+    esp_err_t Esp32GpioBackend::disableWakeup(int pin) {
+        return gpio_wakeup_disable(static_cast<gpio_num_t>(pin));
+    }
+
+    esp_err_t Esp32GpioBackend::lightSleep(uint64_t timeout_us) {
+        if (timeout_us) {
+            esp_sleep_enable_timer_wakeup(timeout_us);
+        }
+        esp_err_t err = esp_light_sleep_start();
+        if (timeout_us) {
+            esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+        }
+        return err;
+    }
+
+    int64_t Esp32GpioBackend::nowUs() {
+        return esp_timer_get_time();
+    }
+
+    esp_err_t Esp32GpioBackend::createTimer(GpioTimerFn fn, void* arg, const char* name, GpioTimerHandle* out) {
+        esp_timer_create_args_t timer_args = {};
+        timer_args.callback = fn;
+        timer_args.arg = arg;
+        timer_args.dispatch_method = ESP_TIMER_TASK;
+        timer_args.name = name;
+        timer_args.skip_unhandled_events = true;
+        esp_timer_handle_t timer = nullptr;
+        esp_err_t err = esp_timer_create(&timer_args, &timer);
+        *out = timer;
+        return err;
+    }
+
+    esp_err_t Esp32GpioBackend::startTimerPeriodic(GpioTimerHandle timer, uint64_t period_us) {
+        return esp_timer_start_periodic(static_cast<esp_timer_handle_t>(timer), period_us);
+    }
+
+    esp_err_t Esp32GpioBackend::startTimerOnce(GpioTimerHandle timer, uint64_t timeout_us) {
+        return esp_timer_start_once(static_cast<esp_timer_handle_t>(timer), timeout_us);
+    }
+
+    esp_err_t Esp32GpioBackend::stopTimer(GpioTimerHandle timer) {
+        return esp_timer_stop(static_cast<esp_timer_handle_t>(timer));
+    }
+
+    esp_err_t Esp32GpioBackend::deleteTimer(GpioTimerHandle timer) {
+        return esp_timer_delete(static_cast<esp_timer_handle_t>(timer));
+    }
+
+    bool Esp32GpioBackend::isTimerActive(GpioTimerHandle timer) {
+        return esp_timer_is_active(static_cast<esp_timer_handle_t>(timer));
+    }
+
+} // namespace ESP32_GPIO
+// End of GpioBackend.cpp
@@ -0,0 +1,258 @@
+// @file GpioLatencyBench.cpp
+// @brief Implementation of the GPIO interrupt latency benchmark
+
+#include "../inc/gpio_bench.hpp"
+#include "../inc/mqtt.hpp"
+#include <algorithm>
+#include <string>
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+#define TAG "GpioLatencyBench"
+
+namespace ESP32_GPIO {
+
+    GpioLatencyBench::GpioLatencyBench(const BenchConfig& config)
+        : _config(config),
+        _waiter(nullptr),
+        _deferred(nullptr),
+        _queue(nullptr),
+        _stampCycles(0),
+        _stampCore(-1),
+        _loadRunning(false),
+        _loadAlive(0)
+    {
+    }
+
+    GpioLatencyBench::~GpioLatencyBench() {
+        stopLoad();
+        if (_queue) {
+            vQueueDelete(_queue);
+        }
+    }
+
+    bool GpioLatencyBench::run(BenchResult& result) {
+        GpioManager& gpio = GpioManager::getInstance();
+        if (!gpio.configurePin(_config.out_pin, PinMode::OUTPUT)
+            || !gpio.configurePin(_config.in_pin, PinMode::INPUT, false, true, InterruptTrigger::RISING)) {
+            ESP_LOGE(TAG, "Failed to configure loopback pins %d -> %d", _config.out_pin, _config.in_pin);
+            return false;
+        }
+        if (!_queue) {
+            _queue = xQueueCreate(4, sizeof(uint8_t));
+            if (!_queue) return false;
+        }
+
+        startLoad();
+        // Let the load settle before the first edge
+        vTaskDelay(pdMS_TO_TICKS(100));
+        bool ok = measure(Path::RAW_ISR, result.edge_to_isr)
+            && measure(Path::DIRECT, result.edge_to_callback)
+            && measure(Path::DEFERRED, result.edge_to_task);
+        stopLoad();
+
+        gpio.resetPin(_config.out_pin);
+        gpio.resetPin(_config.in_pin);
+        return ok;
+    }
+
+    bool GpioLatencyBench::measure(Path path, LatencyStats& stats) {
+        GpioManager& gpio = GpioManager::getInstance();
+        const int core = xPortGetCoreID();
+        gpio.setLevel(_config.out_pin, 0);
+
+        esp_err_t err = ESP_OK;
+        switch (path) {
+            case Path::RAW_ISR:
+                gpio.detachHandler(_config.in_pin);
+                err = gpio_isr_handler_add(static_cast<gpio_num_t>(_config.in_pin), &GpioLatencyBench::rawIsr, this);
+                break;
+            case Path::DIRECT:
+                err = gpio.attachHandler(_config.in_pin, &GpioLatencyBench::directIsr, this) ? ESP_OK : ESP_FAIL;
+                break;
+            case Path::DEFERRED:
+                xQueueReset(_queue);
+                if (xTaskCreatePinnedToCore(&GpioLatencyBench::deferredTask, "bench_deferred", 2048, this,
+                                            _config.task_priority, &_deferred, core) != pdPASS) {
+                    err = ESP_ERR_NO_MEM;
+                    break;
+                }
+                err = gpio.attachHandler(_config.in_pin, &GpioLatencyBench::deferredIsr, this) ? ESP_OK : ESP_FAIL;
+                break;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to attach benchmark handler: %s", esp_err_to_name(err));
+            return false;
+        }
+
+        std::vector<uint32_t> cycles;
+        cycles.reserve(_config.samples);
+        uint32_t lost = 0;
+        TickType_t gap = std::max<TickType_t>(1, pdMS_TO_TICKS(_config.interval_ms));
+        _waiter = xTaskGetCurrentTaskHandle();
+
+        for (uint32_t i = 0; i < _config.samples; ++i) {
+            ulTaskNotifyTake(pdTRUE, 0);
+            _stampCore = -1;
+            uint32_t start = esp_cpu_get_cycle_count();
+            gpio_set_level(static_cast<gpio_num_t>(_config.out_pin), 1);
+            bool seen = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)) > 0;
+            if (seen && _stampCore == core) {
+                cycles.push_back(_stampCycles - start);
+            } else {
+                ++lost;
+            }
+            gpio_set_level(static_cast<gpio_num_t>(_config.out_pin), 0);
+            vTaskDelay(gap);
+        }
+
+        if (path == Path::RAW_ISR) {
+            gpio_isr_handler_remove(static_cast<gpio_num_t>(_config.in_pin));
+        } else {
+            gpio.detachHandler(_config.in_pin);
+        }
+        if (_deferred) {
+            vTaskDelete(_deferred);
+            _deferred = nullptr;
+        }
+        _waiter = nullptr;
+
+        stats = summarize(cycles, lost);
+        return true;
+    }
+
+    LatencyStats GpioLatencyBench::summarize(std::vector<uint32_t>& cycles, uint32_t lost) {
+        LatencyStats stats = {};
+        stats.samples = cycles.size();
+        stats.lost = lost;
+        if (cycles.empty()) return stats;
+
+        std::sort(cycles.begin(), cycles.end());
+        const float ticks_per_us = static_cast<float>(esp_rom_get_cpu_ticks_per_us());
+        auto percentile = [&](uint32_t per_mille) {
+            size_t index = std::min(cycles.size() - 1, cycles.size() * per_mille / 1000);
+            return cycles[index] / ticks_per_us;
+        };
+        stats.min_us = cycles.front() / ticks_per_us;
+        stats.p50_us = percentile(500);
+        stats.p90_us = percentile(900);
+        stats.p99_us = percentile(990);
+        stats.p999_us = percentile(999);
+        stats.max_us = cycles.back() / ticks_per_us;
+        return stats;
+    }
+
+    void GpioLatencyBench::printTable(const BenchResult& result) {
+        const struct {
+            const char* name;
+            const LatencyStats* stats;
+        } rows[] = {
+            { "edge->isr",      &result.edge_to_isr },
+            { "edge->callback", &result.edge_to_callback },
+            { "edge->task",     &result.edge_to_task },
+        };
+
+        ESP_LOGI(TAG, "%-16s %6s %6s %8s %8s %8s %8s %8s %8s",
+                 "path (us)", "n", "lost", "min", "p50", "p90", "p99", "p99.9", "max");
+        for (const auto& row : rows) {
+            const LatencyStats& s = *row.stats;
+            ESP_LOGI(TAG, "%-16s %6u %6u %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f",
+                     row.name, (unsigned)s.samples, (unsigned)s.lost,
+                     s.min_us, s.p50_us, s.p90_us, s.p99_us, s.p999_us, s.max_us);
+        }
+    }
+
+    void GpioLatencyBench::startLoad() {
+        const BenchLoadConfig& load = _config.load;
+        _loadRunning.store(true);
+
+        for (uint8_t i = 0; i < load.cpu_tasks; ++i) {
+            if (xTaskCreatePinnedToCore(&GpioLatencyBench::cpuLoadTask, "bench_cpu", 2048, this,
+                                        load.cpu_priority, nullptr, i % portNUM_PROCESSORS) == pdPASS) {
+                _loadAlive.fetch_add(1);
+            }
+        }
+        if (load.mqtt_rate_hz) {
+            if (xTaskCreate(&GpioLatencyBench::mqttLoadTask, "bench_mqtt", 4096, this,
+                            load.cpu_priority, nullptr) == pdPASS) {
+                _loadAlive.fetch_add(1);
+            }
+        }
+    }
+
+    void GpioLatencyBench::stopLoad() {
+        _loadRunning.store(false);
+        // Load tasks exit on their own so none is deleted while holding a driver lock
+        while (_loadAlive.load() > 0) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+
+    void GpioLatencyBench::stamp() {
+        _stampCycles = esp_cpu_get_cycle_count();
+        _stampCore = xPortGetCoreID();
+    }
+
+    void GpioLatencyBench::rawIsr(void* arg) {
+        GpioLatencyBench* self = static_cast<GpioLatencyBench*>(arg);
+        self->stamp();
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(self->_waiter, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+
+    void GpioLatencyBench::directIsr(int gpio_num, int level, void* arg) {
+        rawIsr(arg);
+    }
+
+    void GpioLatencyBench::deferredIsr(int gpio_num, int level, void* arg) {
+        GpioLatencyBench* self = static_cast<GpioLatencyBench*>(arg);
+        uint8_t token = 0;
+        BaseType_t woken = pdFALSE;
+        xQueueSendFromISR(self->_queue, &token, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+
+    void GpioLatencyBench::deferredTask(void* arg) {
+        GpioLatencyBench* self = static_cast<GpioLatencyBench*>(arg);
+        uint8_t token;
+        while (true) {
+            if (xQueueReceive(self->_queue, &token, portMAX_DELAY) == pdTRUE) {
+                self->stamp();
+                xTaskNotifyGive(self->_waiter);
+            }
+        }
+    }
+
+    void GpioLatencyBench::cpuLoadTask(void* arg) {
+        GpioLatencyBench* self = static_cast<GpioLatencyBench*>(arg);
+        const int64_t busy_us = self->_config.load.cpu_duty_pct * 100LL;
+        const TickType_t idle = std::max<TickType_t>(1, pdMS_TO_TICKS(10 - busy_us / 1000));
+        while (self->_loadRunning.load(std::memory_order_relaxed)) {
+            int64_t until = esp_timer_get_time() + busy_us;
+            while (esp_timer_get_time() < until) {
+            }
+            vTaskDelay(idle);
+        }
+        self->_loadAlive.fetch_sub(1);
+        vTaskDelete(nullptr);
+    }
+
+    void GpioLatencyBench::mqttLoadTask(void* arg) {
+        GpioLatencyBench* self = static_cast<GpioLatencyBench*>(arg);
+        const BenchLoadConfig& load = self->_config.load;
+        const std::string topic(load.mqtt_topic);
+        const std::string payload(load.mqtt_payload, 'x');
+        const TickType_t period = std::max<TickType_t>(1, pdMS_TO_TICKS(1000 / load.mqtt_rate_hz));
+        TickType_t last = xTaskGetTickCount();
+        while (self->_loadRunning.load(std::memory_order_relaxed)) {
+            ESP32_MQTT::MqttClient::getInstance().publish(topic, payload, 0, false);
+            vTaskDelayUntil(&last, period);
+        }
+        self->_loadAlive.fetch_sub(1);
+        vTaskDelete(nullptr);
+    }
+
+} // namespace ESP32_GPIO
+// End of GpioLatencyBench.cpp
@@ -0,0 +1,292 @@
+// @file QuadratureEncoder.cpp
+// @brief Implementation of the quadrature encoder decoder
+
+#include "../inc/gpio_encoder.hpp"
+
+#define TAG "QuadratureEncoder"
+
+namespace ESP32_GPIO {
+
+    // PCNT counter range, the counter is cleared when either limit is reached
+    static constexpr int PCNT_HIGH_LIMIT = 32767;
+    static constexpr int PCNT_LOW_LIMIT  = -32768;
+
+    // Position delta indexed by (previous AB << 2) | current AB
+    static const int8_t QUAD_TABLE[16] = {
+         0, -1,  1,  0,
+         1,  0,  0, -1,
+        -1,  0,  0,  1,
+         0,  1, -1,  0
+    };
+
+    QuadratureEncoder::QuadratureEncoder()
+        : _config(),
+        _foldedCount(0),
+        _velocity(0.0f),
+        _errors(0),
+        _state(0),
+        _lastPosition(0),
+        _lastSampleUs(0),
+        _velocityTimer(nullptr),
+        _running(false),
+        _usePcnt(false)
+#if SOC_PCNT_SUPPORTED
+        , _unit(nullptr),
+        _chanA(nullptr),
+        _chanB(nullptr)
+#endif
+    {
+        portMUX_INITIALIZE(&_lock);
+    }
+
+    QuadratureEncoder::~QuadratureEncoder() {
+        deinit();
+    }
+
+    bool QuadratureEncoder::init(const EncoderConfig& config) {
+        if (_running) deinit();
+        _config = config;
+        _base.store(0);
+        _foldedCount.store(0);
+        _velocity.store(0.0f);
+        _errors.store(0);
+
+        bool ok = false;
+#if SOC_PCNT_SUPPORTED
+        if (_config.use_pcnt) {
+            ok = initPcnt();
+            if (!ok) ESP_LOGW(TAG, "PCNT unavailable, falling back to ISR decoding");
+        }
+#endif
+        if (!ok) ok = initIsr();
+        if (!ok) return false;
+        _running = true;
+
+        if (_config.velocity_period_ms) {
+            GpioBackend& backend = GpioManager::getInstance().backend();
+            if (backend.createTimer(&QuadratureEncoder::velocityTimerCb, this, "qenc_velocity", &_velocityTimer) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to create velocity timer");
+                deinit();
+                return false;
+            }
+            _lastPosition = getPosition();
+            _lastSampleUs = backend.nowUs();
+            backend.startTimerPeriodic(_velocityTimer, _config.velocity_period_ms * 1000ULL);
+        }
+
+        ESP_LOGI(TAG, "Encoder on pins %d/%d using %s", _config.pin_a, _config.pin_b, _usePcnt ? "PCNT" : "ISR");
+        return true;
+    }
+
+    bool QuadratureEncoder::initPcnt() {
+#if SOC_PCNT_SUPPORTED
+        pcnt_unit_config_t unit_config = {};
+        unit_config.low_limit = PCNT_LOW_LIMIT;
+        unit_config.high_limit = PCNT_HIGH_LIMIT;
+        // The driver folds each limit event into the count it reports, under
+        // the same lock as the read, so a cleared hardware counter is never
+        // seen without its limit. pcntReachCb extends that sum to 64 bits.
+        unit_config.flags.accum_count = 1;
+        if (pcnt_new_unit(&unit_config, &_unit) != ESP_OK) {
+            _unit = nullptr;
+            return false;
+        }
+
+        if (_config.glitch_ns) {
+            pcnt_glitch_filter_config_t filter_config = {};
+            filter_config.max_glitch_ns = _config.glitch_ns;
+            pcnt_unit_set_glitch_filter(_unit, &filter_config);
+        }
+
+        // Each channel counts the edges of one input gated by the level of the other
+        pcnt_chan_config_t chan_a_config = {};
+        chan_a_config.edge_gpio_num = _config.pin_a;
+        chan_a_config.level_gpio_num = _config.pin_b;
+        pcnt_chan_config_t chan_b_config = {};
+        chan_b_config.edge_gpio_num = _config.pin_b;
+        chan_b_config.level_gpio_num = _config.pin_a;
+        if (pcnt_new_channel(_unit, &chan_a_config, &_chanA) != ESP_OK
+            || pcnt_new_channel(_unit, &chan_b_config, &_chanB) != ESP_OK) {
+            deinit();
+            return false;
+        }
+        pcnt_channel_set_edge_action(_chanA, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+        pcnt_channel_set_level_action(_chanA, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+        pcnt_channel_set_edge_action(_chanB, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+        pcnt_channel_set_level_action(_chanB, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+
+        if (_config.pull_up) {
+            gpio_pullup_en(static_cast<gpio_num_t>(_config.pin_a));
+            gpio_pullup_en(static_cast<gpio_num_t>(_config.pin_b));
+        }
+
+        // Accumulation needs the limits as watch points
+        pcnt_event_callbacks_t cbs = {};
+        cbs.on_reach = &QuadratureEncoder::pcntReachCb;
+        if (pcnt_unit_add_watch_point(_unit, PCNT_HIGH_LIMIT) != ESP_OK
+            || pcnt_unit_add_watch_point(_unit, PCNT_LOW_LIMIT) != ESP_OK
+            || pcnt_unit_register_event_callbacks(_unit, &cbs, this) != ESP_OK
+            || pcnt_unit_enable(_unit) != ESP_OK) {
+            deinit();
+            return false;
+        }
+        pcnt_unit_clear_count(_unit);
+        pcnt_unit_start(_unit);
+        _usePcnt = true;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool QuadratureEncoder::initIsr() {
+        GpioManager& gpio = GpioManager::getInstance();
+        if (!gpio.configurePin(_config.pin_a, PinMode::INPUT, _config.pull_up, false, InterruptTrigger::BOTH)
+            || !gpio.configurePin(_config.pin_b, PinMode::INPUT, _config.pull_up, false, InterruptTrigger::BOTH)
+            || !gpio.attachHandler(_config.pin_a, &QuadratureEncoder::edgeIsr, this)
+            || !gpio.attachHandler(_config.pin_b, &QuadratureEncoder::edgeIsr, this)) {
+            ESP_LOGE(TAG, "Failed to configure encoder pins %d/%d", _config.pin_a, _config.pin_b);
+            return false;
+        }
+        _state = static_cast<uint8_t>((gpio.getLevel(_config.pin_a) << 1) | gpio.getLevel(_config.pin_b));
+        _usePcnt = false;
+        return true;
+    }
+
+    void QuadratureEncoder::deinit() {
+        if (_velocityTimer) {
+            GpioBackend& backend = GpioManager::getInstance().backend();
+            backend.stopTimer(_velocityTimer);
+            backend.deleteTimer(_velocityTimer);
+            _velocityTimer = nullptr;
+        }
+#if SOC_PCNT_SUPPORTED
+        if (_unit) {
+            pcnt_unit_stop(_unit);
+            pcnt_unit_disable(_unit);
+        }
+        if (_chanA) {
+            pcnt_del_channel(_chanA);
+            _chanA = nullptr;
+        }
+        if (_chanB) {
+            pcnt_del_channel(_chanB);
+            _chanB = nullptr;
+        }
+        if (_unit) {
+            pcnt_del_unit(_unit);
+            _unit = nullptr;
+        }
+#endif
+        if (_running && !_usePcnt) {
+            GpioManager::getInstance().detachHandler(_config.pin_a);
+            GpioManager::getInstance().detachHandler(_config.pin_b);
+            GpioManager::getInstance().resetPin(_config.pin_a);
+            GpioManager::getInstance().resetPin(_config.pin_b);
+        }
+        _running = false;
+    }
+
+    int64_t QuadratureEncoder::getPosition() const {
+#if SOC_PCNT_SUPPORTED
+        if (_usePcnt) {
+            // Retry if a fold or setPosition() ran while reading. The sum moves
+            // by at most one limit between folds, the 32-bit difference is exact.
+            uint32_t seq;
+            int64_t base;
+            uint32_t folded;
+            int count = 0;
+            do {
+                seq = _base.sequence();
+                base = _base.load();
+                folded = _foldedCount.load(std::memory_order_relaxed);
+                pcnt_unit_get_count(_unit, &count);
+            } while ((seq & 1) || seq != _base.sequence());
+            return base + static_cast<int32_t>(static_cast<uint32_t>(count) - folded);
+        }
+#endif
+        return _base.load();
+    }
+
+    float QuadratureEncoder::getVelocity() const {
+        return _velocity.load(std::memory_order_relaxed);
+    }
+
+    void QuadratureEncoder::setPosition(int64_t position) {
+        portENTER_CRITICAL(&_lock);
+        // Readers retry from here on, before the hardware count is cleared
+        _base.begin();
+#if SOC_PCNT_SUPPORTED
+        if (_usePcnt && _unit) {
+            pcnt_unit_clear_count(_unit);
+        }
+#endif
+        _foldedCount.store(0, std::memory_order_relaxed);
+        _base.commit(position);
+        portEXIT_CRITICAL(&_lock);
+        _lastPosition = position;
+    }
+
+    uint32_t QuadratureEncoder::getErrorCount() const {
+        return _errors.load(std::memory_order_relaxed);
+    }
+
+    bool QuadratureEncoder::usesPcnt() const {
+        return _usePcnt;
+    }
+
+    void QuadratureEncoder::edgeIsr(int gpio_num, int level, void* arg) {
+        static_cast<QuadratureEncoder*>(arg)->decodeEdge();
+    }
+
+    // Runs in the GpioManager ISR on every edge of either channel
+    void QuadratureEncoder::decodeEdge() {
+        GpioBackend& backend = GpioManager::getInstance().backend();
+        uint8_t current = static_cast<uint8_t>((backend.getLevel(_config.pin_a) << 1) | backend.getLevel(_config.pin_b));
+        portENTER_CRITICAL_ISR(&_lock);
+        uint8_t index = static_cast<uint8_t>((_state << 2) | current);
+        int8_t delta = QUAD_TABLE[index];
+        if (delta) {
+            _base.add(delta);
+        } else if (current != _state) {
+            // Both channels changed between two interrupts, a count was lost
+            _errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        _state = current;
+        portEXIT_CRITICAL_ISR(&_lock);
+    }
+
+    void QuadratureEncoder::velocityTimerCb(void* arg) {
+        QuadratureEncoder* self = static_cast<QuadratureEncoder*>(arg);
+        int64_t now = GpioManager::getInstance().backend().nowUs();
+        int64_t position = self->getPosition();
+        int64_t dt = now - self->_lastSampleUs;
+        if (dt <= 0) return;
+
+        float sample = static_cast<float>(position - self->_lastPosition) * 1e6f / static_cast<float>(dt);
+        float previous = self->_velocity.load(std::memory_order_relaxed);
+        float alpha = self->_config.velocity_smoothing;
+        self->_velocity.store(previous + alpha * (sample - previous), std::memory_order_relaxed);
+        self->_lastPosition = position;
+        self->_lastSampleUs = now;
+    }
+
+#if SOC_PCNT_SUPPORTED
+    // Runs in the PCNT ISR after the driver added the limit to its sum
+    bool QuadratureEncoder::pcntReachCb(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t* edata, void* user_ctx) {
+        QuadratureEncoder* self = static_cast<QuadratureEncoder*>(user_ctx);
+        int count = 0;
+        pcnt_unit_get_count(unit, &count);
+        portENTER_CRITICAL_ISR(&self->_lock);
+        const uint32_t folded = self->_foldedCount.load(std::memory_order_relaxed);
+        const int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(count) - folded);
+        self->_base.begin();
+        self->_foldedCount.store(static_cast<uint32_t>(count), std::memory_order_relaxed);
+        self->_base.commit(self->_base.raw() + delta);
+        portEXIT_CRITICAL_ISR(&self->_lock);
+        return false;
+    }
+#endif
+
+} // namespace ESP32_GPIO
+// End of QuadratureEncoder.cpp
@@ -0,0 +1,310 @@
+// @file FrequencyCounter.cpp
+// @brief Implementation of the multi-pin frequency counter
+
+#include "../inc/gpio_freq.hpp"
+
+#define TAG "FrequencyCounter"
+
+namespace ESP32_GPIO {
+
+#if SOC_PCNT_SUPPORTED
+    // Only rising edges are counted, the driver adds the limit to its sum each time it is reached
+    static constexpr int PCNT_HIGH_LIMIT = 32767;
+    static constexpr int PCNT_LOW_LIMIT  = -1;
+#endif
+
+    FrequencyCounter::FrequencyCounter()
+        : _config(),
+        _timer(nullptr),
+        _mutex(xSemaphoreCreateMutex())
+    {
+        for (size_t i = 0; i < GPIO_FREQ_MAX_CHANNELS; ++i) {
+            portMUX_INITIALIZE(&_channels[i].lock);
+        }
+    }
+
+    FrequencyCounter::~FrequencyCounter() {
+        stop();
+        if (_mutex) vSemaphoreDelete(_mutex);
+    }
+
+    bool FrequencyCounter::start(const FreqConfig& config) {
+        stop();
+        if (config.gate_ms == 0 || config.period_below >= config.count_above) {
+            ESP_LOGE(TAG, "Invalid gate %u ms or switch thresholds %u/%u", (unsigned)config.gate_ms,
+                (unsigned)config.period_below, (unsigned)config.count_above);
+            return false;
+        }
+        _config = config;
+
+        GpioBackend& io = GpioManager::getInstance().backend();
+        if (!_mutex
+            || io.createTimer(&FrequencyCounter::gateTimerCb, this, "freq_gate", &_timer) != ESP_OK
+            || io.startTimerPeriodic(_timer, config.gate_ms * 1000ULL) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start the gate timer");
+            stop();
+            return false;
+        }
+        return true;
+    }
+
+    void FrequencyCounter::stop() {
+        GpioBackend& io = GpioManager::getInstance().backend();
+        if (_timer) {
+            io.stopTimer(_timer);
+            io.deleteTimer(_timer);
+            _timer = nullptr;
+        }
+        if (!_mutex) return;
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        for (size_t i = 0; i < GPIO_FREQ_MAX_CHANNELS; ++i) {
+            if (_channels[i].pin >= 0) release(_channels[i]);
+        }
+        xSemaphoreGive(_mutex);
+    }
+
+    bool FrequencyCounter::addPin(int pin, bool pull_up, bool pull_down) {
+        if (!_timer || pin < 0 || pin >= SOC_GPIO_PIN_COUNT) return false;
+
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        Channel* ch = nullptr;
+        for (size_t i = 0; i < GPIO_FREQ_MAX_CHANNELS; ++i) {
+            if (_channels[i].pin == pin) {
+                xSemaphoreGive(_mutex);
+                return true;
+            }
+            if (!ch && _channels[i].pin < 0) ch = &_channels[i];
+        }
+        if (!ch) {
+            xSemaphoreGive(_mutex);
+            ESP_LOGE(TAG, "No free channel for pin %d", pin);
+            return false;
+        }
+
+        // The edge interrupt stays attached and is only enabled for the PERIOD method
+        GpioManager& gpio = GpioManager::getInstance();
+        if (!gpio.configurePin(pin, PinMode::INPUT, pull_up, pull_down, InterruptTrigger::RISING)
+            || !gpio.attachHandler(pin, &FrequencyCounter::edgeIsr, ch)) {
+            ESP_LOGE(TAG, "Failed to configure pin %d", pin);
+            gpio.resetPin(pin);
+            xSemaphoreGive(_mutex);
+            return false;
+        }
+
+        ch->edges = 0;
+        ch->last_us = 0;
+        ch->ref_us = -1;
+        ch->last_count = 0;
+        ch->hz.store(0.0f);
+        ch->gate_edges.store(0);
+        ch->has_pcnt = false;
+        ch->pin = pin;
+#if SOC_PCNT_SUPPORTED
+        // PCNT takes the same input through the GPIO matrix, the interrupt path is unaffected
+        if (_config.use_pcnt) {
+            ch->has_pcnt = initPcnt(*ch);
+            if (!ch->has_pcnt) ESP_LOGW(TAG, "PCNT unavailable for pin %d, timing periods only", pin);
+            else ch->last_count = readPcnt(*ch);
+        }
+#endif
+        ch->last_gate_us = gpio.backend().nowUs();
+        setMethod(*ch, ch->has_pcnt ? FreqMethod::COUNT : FreqMethod::PERIOD);
+        xSemaphoreGive(_mutex);
+        return true;
+    }
+
+    void FrequencyCounter::removePin(int pin) {
+        if (!_mutex) return;
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        Channel* ch = find(pin);
+        if (ch) release(*ch);
+        xSemaphoreGive(_mutex);
+    }
+
+    float FrequencyCounter::getFrequency(int pin) const {
+        const Channel* ch = find(pin);
+        return ch ? ch->hz.load(std::memory_order_relaxed) : 0.0f;
+    }
+
+    bool FrequencyCounter::getReading(int pin, FreqReading& reading) const {
+        const Channel* ch = find(pin);
+        if (!ch) return false;
+        reading.hz = ch->hz.load(std::memory_order_relaxed);
+        reading.method = static_cast<FreqMethod>(ch->reported.load(std::memory_order_relaxed));
+        reading.edges = ch->gate_edges.load(std::memory_order_relaxed);
+        return true;
+    }
+
+    FrequencyCounter::Channel* FrequencyCounter::find(int pin) const {
+        if (pin < 0) return nullptr;
+        for (size_t i = 0; i < GPIO_FREQ_MAX_CHANNELS; ++i) {
+            if (_channels[i].pin == pin) return const_cast<Channel*>(&_channels[i]);
+        }
+        return nullptr;
+    }
+
+    void FrequencyCounter::release(Channel& ch) {
+        GpioManager& gpio = GpioManager::getInstance();
+        int pin = ch.pin;
+        ch.pin = -1;
+        gpio.backend().disableIntr(pin);
+        gpio.detachHandler(pin);
+#if SOC_PCNT_SUPPORTED
+        if (ch.unit) {
+            pcnt_unit_stop(ch.unit);
+            pcnt_unit_disable(ch.unit);
+        }
+        if (ch.chan) {
+            pcnt_del_channel(ch.chan);
+            ch.chan = nullptr;
+        }
+        if (ch.unit) {
+            pcnt_del_unit(ch.unit);
+            ch.unit = nullptr;
+        }
+#endif
+        ch.has_pcnt = false;
+        ch.hz.store(0.0f);
+        gpio.resetPin(pin);
+    }
+
+    void FrequencyCounter::setMethod(Channel& ch, FreqMethod method) {
+        GpioBackend& io = GpioManager::getInstance().backend();
+        int pin = ch.pin;
+        if (method == FreqMethod::PERIOD) {
+            portENTER_CRITICAL(&ch.lock);
+            ch.edges = 0;
+            portEXIT_CRITICAL(&ch.lock);
+            ch.ref_us = -1;
+            io.enableIntr(pin);
+        } else {
+            io.disableIntr(pin);
+        }
+        ch.method = method;
+        ch.reported.store(static_cast<uint8_t>(method), std::memory_order_relaxed);
+    }
+
+    void FrequencyCounter::gateTimerCb(void* arg) {
+        static_cast<FrequencyCounter*>(arg)->gate();
+    }
+
+    void FrequencyCounter::gate() {
+        // Skip a gate rather than stall the timer task behind addPin/removePin
+        if (xSemaphoreTake(_mutex, 0) != pdTRUE) return;
+        int64_t now = GpioManager::getInstance().backend().nowUs();
+        for (size_t i = 0; i < GPIO_FREQ_MAX_CHANNELS; ++i) {
+            if (_channels[i].pin >= 0) measure(_channels[i], now);
+        }
+        xSemaphoreGive(_mutex);
+    }
+
+    void FrequencyCounter::measure(Channel& ch, int64_t now) {
+        portENTER_CRITICAL(&ch.lock);
+        uint32_t timed = ch.edges;
+        int64_t first = ch.first_us;
+        int64_t last = ch.last_us;
+        ch.edges = 0;
+        portEXIT_CRITICAL(&ch.lock);
+
+        uint32_t edges = timed;
+#if SOC_PCNT_SUPPORTED
+        if (ch.has_pcnt) {
+            // The modular difference stays exact across the 32-bit wrap of the sum
+            uint32_t count = readPcnt(ch);
+            edges = count - ch.last_count;
+            ch.last_count = count;
+        }
+#endif
+        int64_t dt = now - ch.last_gate_us;
+        ch.last_gate_us = now;
+
+        const int64_t timeout_us = static_cast<int64_t>(_config.timeout_ms) * 1000;
+        float hz = ch.hz.load(std::memory_order_relaxed);
+        if (ch.method == FreqMethod::COUNT) {
+            hz = dt > 0 ? static_cast<float>(edges) * 1e6f / static_cast<float>(dt) : 0.0f;
+        } else {
+            // Reciprocal counting: whole periods over the time they span, the
+            // span continues from the last edge of the previous gate
+            if (ch.ref_us >= 0 && now - ch.ref_us > timeout_us) ch.ref_us = -1;
+            if (timed) {
+                int64_t from = ch.ref_us >= 0 ? ch.ref_us : first;
+                uint32_t periods = ch.ref_us >= 0 ? timed : timed - 1;
+                if (periods && last > from) {
+                    hz = static_cast<float>(periods) * 1e6f / static_cast<float>(last - from);
+                }
+                ch.ref_us = last;
+            } else if (ch.ref_us < 0) {
+                hz = 0.0f;
+            }
+        }
+        ch.hz.store(hz, std::memory_order_relaxed);
+        ch.gate_edges.store(edges, std::memory_order_relaxed);
+
+        // Timing periods costs an interrupt per edge, counting loses resolution at
+        // low rates; the gap between the thresholds keeps a channel from flapping
+        if (ch.has_pcnt) {
+            if (ch.method == FreqMethod::COUNT && edges < _config.period_below) {
+                setMethod(ch, FreqMethod::PERIOD);
+            } else if (ch.method == FreqMethod::PERIOD && edges > _config.count_above) {
+                setMethod(ch, FreqMethod::COUNT);
+            }
+        }
+    }
+
+    // Runs in the GpioManager ISR on every rising edge while the channel times periods
+    void FrequencyCounter::edgeIsr(int gpio_num, int level, void* arg) {
+        Channel* ch = static_cast<Channel*>(arg);
+        int64_t now = GpioManager::getInstance().backend().nowUs();
+        portENTER_CRITICAL_ISR(&ch->lock);
+        if (ch->edges == 0) ch->first_us = now;
+        ch->last_us = now;
+        ++ch->edges;
+        portEXIT_CRITICAL_ISR(&ch->lock);
+    }
+
+#if SOC_PCNT_SUPPORTED
+    bool FrequencyCounter::initPcnt(Channel& ch) {
+        pcnt_unit_config_t unit_config = {};
+        unit_config.low_limit = PCNT_LOW_LIMIT;
+        unit_config.high_limit = PCNT_HIGH_LIMIT;
+        // The driver folds each limit event into the count it reports under
+        // the same lock as the read, a cleared counter is never seen alone
+        unit_config.flags.accum_count = 1;
+        if (pcnt_new_unit(&unit_config, &ch.unit) != ESP_OK) {
+            ch.unit = nullptr;
+            return false;
+        }
+
+        if (_config.glitch_ns) {
+            pcnt_glitch_filter_config_t filter_config = {};
+            filter_config.max_glitch_ns = _config.glitch_ns;
+            pcnt_unit_set_glitch_filter(ch.unit, &filter_config);
+        }
+
+        pcnt_chan_config_t chan_config = {};
+        chan_config.edge_gpio_num = ch.pin;
+        chan_config.level_gpio_num = -1;
+        if (pcnt_new_channel(ch.unit, &chan_config, &ch.chan) != ESP_OK
+            || pcnt_channel_set_edge_action(ch.chan, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD) != ESP_OK
+            || pcnt_unit_add_watch_point(ch.unit, PCNT_HIGH_LIMIT) != ESP_OK
+            || pcnt_unit_enable(ch.unit) != ESP_OK) {
+            if (ch.chan) pcnt_del_channel(ch.chan);
+            pcnt_del_unit(ch.unit);
+            ch.chan = nullptr;
+            ch.unit = nullptr;
+            return false;
+        }
+        pcnt_unit_clear_count(ch.unit);
+        pcnt_unit_start(ch.unit);
+        return true;
+    }
+
+    uint32_t FrequencyCounter::readPcnt(Channel& ch) {
+        int count = 0;
+        pcnt_unit_get_count(ch.unit, &count);
+        return static_cast<uint32_t>(count);
+    }
+#endif
+
+} // namespace ESP32_GPIO
+// End of FrequencyCounter.cpp
@@ -0,0 +1,414 @@
+// @file HostGpioBackend.cpp
+// @brief Implementation of the simulated GPIO backend for Linux host builds
+
+#include "../inc/gpio_host_backend.hpp"
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace ESP32_GPIO {
+
+    GpioBackend& defaultGpioBackend() {
+        static HostGpioBackend backend;
+        return backend;
+    }
+
+    HostGpioBackend::HostGpioBackend()
+        : _now(0),
+        _isrService(false)
+    {
+    }
+
+    HostGpioBackend::~HostGpioBackend() = default;
+
+    int HostGpioBackend::loadTrace(const std::string& path, int64_t offset_us) {
+        std::ifstream file(path);
+        if (!file) return -1;
+
+        int count = 0;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream fields(line);
+            int64_t time_us;
+            int pin, level;
+            if (!(fields >> time_us >> pin >> level) || !validPin(pin)) continue;
+            injectEdge(offset_us + time_us, pin, level ? 1 : 0);
+            ++count;
+        }
+        return count;
+    }
+
+    void HostGpioBackend::injectEdge(int64_t time_us, int pin, int level) {
+        if (!validPin(pin)) return;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        // Keep the queue ordered, edges with equal times stay in insertion order
+        auto it = _edges.end();
+        while (it != _edges.begin() && std::prev(it)->time_us > time_us) --it;
+        _edges.insert(it, Edge{ time_us, pin, level ? 1 : 0 });
+    }
+
+    void HostGpioBackend::runUntil(int64_t time_us) {
+        std::unique_lock<std::recursive_mutex> lock(_mutex);
+        int64_t due;
+        while (nextDue(time_us, due)) {
+            if (due > _now) _now = due;
+            if (!_edges.empty() && _edges.front().time_us == due) {
+                // Edges at a timestamp are delivered before timers due at the same time
+                Edge edge = _edges.front();
+                _edges.pop_front();
+                record(HostGpioRecord::Op::EDGE, edge.pin, edge.level);
+                changeLevel(edge.pin, edge.level, lock);
+                continue;
+            }
+            for (Timer& timer : _timers) {
+                if (!timer.active || timer.due_us != due) continue;
+                if (timer.period_us) {
+                    timer.due_us += timer.period_us;
+                } else {
+                    timer.active = false;
+                }
+                GpioTimerFn fn = timer.fn;
+                void* arg = timer.arg;
+                lock.unlock();
+                fn(arg);
+                lock.lock();
+                break;
+            }
+        }
+        if (time_us > _now) _now = time_us;
+    }
+
+    void HostGpioBackend::advance(int64_t delta_us) {
+        runUntil(nowUs() + delta_us);
+    }
+
+    void HostGpioBackend::runAll() {
+        int64_t last;
+        {
+            std::lock_guard<std::recursive_mutex> guard(_mutex);
+            if (_edges.empty()) return;
+            last = _edges.back().time_us;
+        }
+        runUntil(last);
+    }
+
+    void HostGpioBackend::loopback(int out, int in) {
+        if (!validPin(out) || !validPin(in)) return;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _pins[out].loopback = in;
+    }
+
+    std::vector<HostGpioRecord> HostGpioBackend::records() const {
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        return _records;
+    }
+
+    void HostGpioBackend::clearRecords() {
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _records.clear();
+    }
+
+    bool HostGpioBackend::saveRecords(const std::string& path) const {
+        static const char* const OP_NAMES[] = { "SET_LEVEL", "GET_LEVEL", "EDGE", "PORT_READ", "PORT_SET", "PORT_CLEAR", "SLEEP", "WAKE" };
+        std::ofstream file(path);
+        if (!file) return false;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        for (const HostGpioRecord& rec : _records) {
+            file << rec.time_us << ' ' << OP_NAMES[static_cast<int>(rec.op)] << ' '
+                 << rec.pin << ' ' << rec.value << '\n';
+        }
+        return static_cast<bool>(file);
+    }
+
+    esp_err_t HostGpioBackend::configure(const gpio_config_t& config) {
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        for (int pin = 0; pin < SOC_GPIO_PIN_COUNT; ++pin) {
+            if (!(config.pin_bit_mask & (1ULL << pin))) continue;
+            Pin& p = _pins[pin];
+            p.mode = config.mode;
+            p.intr = config.intr_type;
+            p.intr_enabled = config.intr_type != GPIO_INTR_DISABLE;
+            if (!(config.mode & GPIO_MODE_OUTPUT)) {
+                // An undriven input settles at its pull
+                if (config.pull_up_en) p.level = 1;
+                else if (config.pull_down_en) p.level = 0;
+            }
+        }
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::resetPin(int pin) {
+        if (!validPin(pin)) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        int wired = _pins[pin].loopback;
+        _pins[pin] = Pin();
+        _pins[pin].loopback = wired;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::setLevel(int pin, uint32_t level) {
+        if (!validPin(pin)) return ESP_ERR_INVALID_ARG;
+        std::unique_lock<std::recursive_mutex> lock(_mutex);
+        record(HostGpioRecord::Op::SET_LEVEL, pin, level ? 1 : 0);
+        changeLevel(pin, level ? 1 : 0, lock);
+        return ESP_OK;
+    }
+
+    int HostGpioBackend::getLevel(int pin) {
+        if (!validPin(pin)) return 0;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        int level = _pins[pin].level;
+        record(HostGpioRecord::Op::GET_LEVEL, pin, level);
+        return level;
+    }
+
+    esp_err_t HostGpioBackend::setDriveStrength(int pin, gpio_drive_cap_t strength) {
+        return validPin(pin) ? ESP_OK : ESP_ERR_INVALID_ARG;
+    }
+
+    uint64_t HostGpioBackend::readPort() {
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        uint64_t levels = 0;
+        for (int pin = 0; pin < SOC_GPIO_PIN_COUNT; ++pin) {
+            if (_pins[pin].level) levels |= 1ULL << pin;
+        }
+        record(HostGpioRecord::Op::PORT_READ, -1, levels);
+        return levels;
+    }
+
+    void HostGpioBackend::writePort(uint64_t set_mask, uint64_t clear_mask) {
+        std::unique_lock<std::recursive_mutex> lock(_mutex);
+        record(HostGpioRecord::Op::PORT_SET, -1, set_mask);
+        record(HostGpioRecord::Op::PORT_CLEAR, -1, clear_mask);
+        for (int pin = 0; pin < SOC_GPIO_PIN_COUNT; ++pin) {
+            if (set_mask & (1ULL << pin)) changeLevel(pin, 1, lock);
+            else if (clear_mask & (1ULL << pin)) changeLevel(pin, 0, lock);
+        }
+    }
+
+    esp_err_t HostGpioBackend::installIsrService(int intr_alloc_flags) {
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        if (_isrService) return ESP_ERR_INVALID_STATE;
+        _isrService = true;
+        return ESP_OK;
+    }
+
+    void HostGpioBackend::uninstallIsrService() {
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _isrService = false;
+        for (Pin& p : _pins) {
+            p.fn = nullptr;
+            p.arg = nullptr;
+        }
+    }
+
+    esp_err_t HostGpioBackend::addIsrHandler(int pin, gpio_isr_t fn, void* arg) {
+        if (!validPin(pin)) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        if (!_isrService) return ESP_ERR_INVALID_STATE;
+        _pins[pin].fn = fn;
+        _pins[pin].arg = arg;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::removeIsrHandler(int pin) {
+        if (!validPin(pin)) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _pins[pin].fn = nullptr;
+        _pins[pin].arg = nullptr;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::setIntrType(int pin, gpio_int_type_t type) {
+        if (!validPin(pin)) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _pins[pin].intr = type;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::enableIntr(int pin) {
+        if (!validPin(pin)) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _pins[pin].intr_enabled = true;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::disableIntr(int pin) {
+        if (!validPin(pin)) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _pins[pin].intr_enabled = false;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::enableWakeup(int pin, gpio_int_type_t level) {
+        if (!validPin(pin) || (level != GPIO_INTR_LOW_LEVEL && level != GPIO_INTR_HIGH_LEVEL)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _pins[pin].wake = level;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::disableWakeup(int pin) {
+        if (!validPin(pin)) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _pins[pin].wake = GPIO_INTR_DISABLE;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::lightSleep(uint64_t timeout_us) {
+        std::unique_lock<std::recursive_mutex> lock(_mutex);
+        auto wakes = [this](int pin, int level) {
+            gpio_int_type_t wake = _pins[pin].wake;
+            return (wake == GPIO_INTR_LOW_LEVEL && !level) || (wake == GPIO_INTR_HIGH_LEVEL && level);
+        };
+        record(HostGpioRecord::Op::SLEEP, -1, timeout_us);
+
+        for (int pin = 0; pin < SOC_GPIO_PIN_COUNT; ++pin) {
+            if (wakes(pin, _pins[pin].level)) {
+                // A wake level is already present, the chip wakes right away
+                record(HostGpioRecord::Op::WAKE, pin, _pins[pin].level);
+                return ESP_OK;
+            }
+        }
+
+        const int64_t deadline = timeout_us ? _now + static_cast<int64_t>(timeout_us) : INT64_MAX;
+        while (!_edges.empty() && _edges.front().time_us <= deadline) {
+            Edge edge = _edges.front();
+            _edges.pop_front();
+            if (edge.time_us > _now) _now = edge.time_us;
+            record(HostGpioRecord::Op::EDGE, edge.pin, edge.level);
+            if (wakes(edge.pin, edge.level)) {
+                record(HostGpioRecord::Op::WAKE, edge.pin, edge.level);
+                // The latched interrupt is serviced once the chip is awake
+                changeLevel(edge.pin, edge.level, lock);
+                return ESP_OK;
+            }
+            // Interrupts are not serviced while asleep, only the level changes
+            _pins[edge.pin].level = edge.level;
+        }
+
+        if (!timeout_us) return ESP_ERR_INVALID_STATE;
+        _now = deadline;
+        record(HostGpioRecord::Op::WAKE, -1, 0);
+        return ESP_OK;
+    }
+
+    int64_t HostGpioBackend::nowUs() {
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        return _now;
+    }
+
+    esp_err_t HostGpioBackend::createTimer(GpioTimerFn fn, void* arg, const char* name, GpioTimerHandle* out) {
+        if (!fn || !out) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        _timers.push_back(Timer{ fn, arg, name, 0, 0, false });
+        *out = &_timers.back();
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::startTimerPeriodic(GpioTimerHandle timer, uint64_t period_us) {
+        if (!timer || !period_us) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        Timer* t = static_cast<Timer*>(timer);
+        if (t->active) return ESP_ERR_INVALID_STATE;
+        t->period_us = period_us;
+        t->due_us = _now + static_cast<int64_t>(period_us);
+        t->active = true;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::startTimerOnce(GpioTimerHandle timer, uint64_t timeout_us) {
+        if (!timer) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        Timer* t = static_cast<Timer*>(timer);
+        if (t->active) return ESP_ERR_INVALID_STATE;
+        t->period_us = 0;
+        t->due_us = _now + static_cast<int64_t>(timeout_us);
+        t->active = true;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::stopTimer(GpioTimerHandle timer) {
+        if (!timer) return ESP_ERR_INVALID_ARG;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        Timer* t = static_cast<Timer*>(timer);
+        if (!t->active) return ESP_ERR_INVALID_STATE;
+        t->active = false;
+        return ESP_OK;
+    }
+
+    esp_err_t HostGpioBackend::deleteTimer(GpioTimerHandle timer) {
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        for (auto it = _timers.begin(); it != _timers.end(); ++it) {
+            if (&*it == timer) {
+                if (it->active) return ESP_ERR_INVALID_STATE;
+                _timers.erase(it);
+                return ESP_OK;
+            }
+        }
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bool HostGpioBackend::isTimerActive(GpioTimerHandle timer) {
+        if (!timer) return false;
+        std::lock_guard<std::recursive_mutex> guard(_mutex);
+        return static_cast<Timer*>(timer)->active;
+    }
+
+    bool HostGpioBackend::validPin(int pin) const {
+        return pin >= 0 && pin < SOC_GPIO_PIN_COUNT;
+    }
+
+    // Caller must hold _mutex
+    void HostGpioBackend::record(HostGpioRecord::Op op, int pin, uint64_t value) {
+        _records.push_back(HostGpioRecord{ _now, op, pin, value });
+    }
+
+    // Caller must hold _mutex through lock, it is released around the handler
+    void HostGpioBackend::changeLevel(int pin, int level, std::unique_lock<std::recursive_mutex>& lock) {
+        Pin& p = _pins[pin];
+        int previous = p.level;
+        p.level = level;
+
+        bool fire = false;
+        switch (p.intr) {
+            case GPIO_INTR_POSEDGE:    fire = !previous && level; break;
+            case GPIO_INTR_NEGEDGE:    fire = previous && !level; break;
+            case GPIO_INTR_ANYEDGE:    fire = previous != level; break;
+            case GPIO_INTR_LOW_LEVEL:  fire = previous != level && !level; break;
+            case GPIO_INTR_HIGH_LEVEL: fire = previous != level && level; break;
+            default: break;
+        }
+        if (fire && _isrService && p.intr_enabled && p.fn) {
+            gpio_isr_t fn = p.fn;
+            void* arg = p.arg;
+            lock.unlock();
+            fn(arg);
+            lock.lock();
+        }
+
+        if (p.loopback >= 0 && p.loopback != pin) {
+            changeLevel(p.loopback, level, lock);
+        }
+    }
+
+    // Caller must hold _mutex
+    bool HostGpioBackend::nextDue(int64_t limit, int64_t& due) {
+        bool found = false;
+        if (!_edges.empty() && _edges.front().time_us <= limit) {
+            due = _edges.front().time_us;
+            found = true;
+        }
+        for (const Timer& timer : _timers) {
+            if (timer.active && timer.due_us <= limit && (!found || timer.due_us < due)) {
+                due = timer.due_us;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+} // namespace ESP32_GPIO
+// End of HostGpioBackend.cpp
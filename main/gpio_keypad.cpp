@@ -0,0 +1,222 @@
+// @file KeypadScanner.cpp
+// @brief Implementation of the matrix keypad scanner
+
+#include "../inc/gpio_keypad.hpp"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_rom_sys.h"
+#endif
+
+#define TAG "KeypadScanner"
+
+namespace ESP32_GPIO {
+
+    KeypadScanner::KeypadScanner()
+        : _rowMask(0),
+        _config(),
+        _timer(nullptr),
+        _queue(nullptr),
+        _scans(0),
+        _ghostScans(0),
+        _dropped(0)
+    {
+        for (size_t r = 0; r < GPIO_KEYPAD_MAX_ROWS; ++r) {
+            _raw[r] = 0;
+            _stableFor[r] = 0;
+            _state[r].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    KeypadScanner::~KeypadScanner() {
+        stop();
+    }
+
+    bool KeypadScanner::start(const KeypadConfig& config) {
+        stop();
+        if (!config.row_pins || !config.col_pins
+            || config.num_rows == 0 || config.num_rows > GPIO_KEYPAD_MAX_ROWS
+            || config.num_cols == 0 || config.num_cols > GPIO_KEYPAD_MAX_COLS
+            || config.scan_period_ms == 0) {
+            ESP_LOGE(TAG, "Invalid matrix size %ux%u", (unsigned)config.num_rows, (unsigned)config.num_cols);
+            return false;
+        }
+        _config = config;
+        _rows.assign(config.row_pins, config.row_pins + config.num_rows);
+        _cols.assign(config.col_pins, config.col_pins + config.num_cols);
+
+        std::vector<PinSpec> specs;
+        specs.reserve(_rows.size() + _cols.size());
+        _rowMask = 0;
+        for (int pin : _rows) {
+            PinSpec spec = {};
+            spec.pin = pin;
+            spec.mode = PinMode::OUTPUT;
+            spec.open_drain = true;
+            specs.push_back(spec);
+            _rowMask |= (1ULL << pin);
+        }
+        for (int pin : _cols) {
+            PinSpec spec = {};
+            spec.pin = pin;
+            spec.mode = PinMode::INPUT;
+            spec.pull_up = true;
+            specs.push_back(spec);
+        }
+
+        GpioManager& gpio = GpioManager::getInstance();
+        if (!gpio.configurePins(specs.data(), specs.size())) {
+            ESP_LOGE(TAG, "Failed to configure matrix pins");
+            return false;
+        }
+        // Release every row, a low row selects it
+        gpio.writePort(_rowMask, 0);
+
+        for (size_t r = 0; r < GPIO_KEYPAD_MAX_ROWS; ++r) {
+            _raw[r] = 0;
+            _stableFor[r] = 0;
+            _state[r].store(0, std::memory_order_relaxed);
+        }
+        _scans.store(0);
+        _ghostScans.store(0);
+        _dropped.store(0);
+
+        _queue = xQueueCreate(config.queue_len, sizeof(KeyEvent));
+        GpioBackend& io = gpio.backend();
+        if (!_queue
+            || io.createTimer(&KeypadScanner::scanTimerCb, this, "keypad_scan", &_timer) != ESP_OK
+            || io.startTimerPeriodic(_timer, config.scan_period_ms * 1000ULL) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start the scan timer");
+            stop();
+            return false;
+        }
+        return true;
+    }
+
+    void KeypadScanner::stop() {
+        GpioManager& gpio = GpioManager::getInstance();
+        if (_timer) {
+            gpio.backend().stopTimer(_timer);
+            gpio.backend().deleteTimer(_timer);
+            _timer = nullptr;
+        }
+        if (_queue) {
+            vQueueDelete(_queue);
+            _queue = nullptr;
+        }
+        for (int pin : _rows) gpio.resetPin(pin);
+        for (int pin : _cols) gpio.resetPin(pin);
+        _rows.clear();
+        _cols.clear();
+        _rowMask = 0;
+    }
+
+    bool KeypadScanner::waitEvent(KeyEvent& event, TickType_t timeout) {
+        return _queue && xQueueReceive(_queue, &event, timeout) == pdTRUE;
+    }
+
+    QueueHandle_t KeypadScanner::events() const {
+        return _queue;
+    }
+
+    bool KeypadScanner::isPressed(size_t row, size_t col) const {
+        if (row >= GPIO_KEYPAD_MAX_ROWS || col >= GPIO_KEYPAD_MAX_COLS) return false;
+        return (_state[row].load(std::memory_order_relaxed) >> col) & 1;
+    }
+
+    KeypadStats KeypadScanner::getStats() const {
+        KeypadStats stats;
+        stats.scans = _scans.load(std::memory_order_relaxed);
+        stats.ghost_scans = _ghostScans.load(std::memory_order_relaxed);
+        stats.dropped_events = _dropped.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void KeypadScanner::scanTimerCb(void* arg) {
+        static_cast<KeypadScanner*>(arg)->scan();
+    }
+
+    void KeypadScanner::scan() {
+        GpioBackend& io = GpioManager::getInstance().backend();
+        const size_t rows = _rows.size();
+        const int64_t now = io.nowUs();
+
+        // One port write and one port read per row
+        uint32_t sample[GPIO_KEYPAD_MAX_ROWS];
+        uint64_t previous = 0;
+        for (size_t r = 0; r < rows; ++r) {
+            uint64_t bit = 1ULL << _rows[r];
+            io.writePort(previous, bit);
+            previous = bit;
+#if !CONFIG_IDF_TARGET_LINUX
+            if (_config.settle_us) esp_rom_delay_us(_config.settle_us);
+#endif
+            sample[r] = readColumns(io.readPort());
+        }
+        io.writePort(previous, 0);
+
+        for (size_t r = 0; r < rows; ++r) {
+            if (sample[r] != _raw[r]) {
+                _raw[r] = sample[r];
+                _stableFor[r] = 1;
+            } else if (_stableFor[r] < UINT8_MAX) {
+                ++_stableFor[r];
+            }
+        }
+
+        bool ghosted = false;
+        for (size_t r = 0; r < rows; ++r) {
+            if (_stableFor[r] < _config.debounce_scans) continue;
+            uint32_t state = _state[r].load(std::memory_order_relaxed);
+            uint32_t target = _raw[r];
+            if (!_config.diodes) {
+                // Ambiguous keys may stay pressed but may not become pressed
+                uint32_t blocked = ghostMask(r, _raw) & ~state;
+                if (target & blocked) ghosted = true;
+                target &= ~blocked;
+            }
+            if (target != state) {
+                _state[r].store(target, std::memory_order_relaxed);
+                report(r, target ^ state, target, now);
+            }
+        }
+
+        _scans.fetch_add(1, std::memory_order_relaxed);
+        if (ghosted) _ghostScans.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t KeypadScanner::readColumns(uint64_t port) const {
+        uint32_t pressed = 0;
+        for (size_t c = 0; c < _cols.size(); ++c) {
+            if (!((port >> _cols[c]) & 1)) pressed |= (1U << c);
+        }
+        return pressed;
+    }
+
+    // Two rows sharing two or more pressed columns form a rectangle, and any
+    // of its four corners may be a ghost of the other three
+    uint32_t KeypadScanner::ghostMask(size_t row, const uint32_t* raw) const {
+        uint32_t mask = 0;
+        for (size_t r = 0; r < _rows.size(); ++r) {
+            if (r == row) continue;
+            uint32_t common = raw[row] & raw[r];
+            if (common & (common - 1)) mask |= common;
+        }
+        return mask;
+    }
+
+    void KeypadScanner::report(size_t row, uint32_t changed, uint32_t state, int64_t now) {
+        while (changed) {
+            int col = __builtin_ctz(changed);
+            changed &= changed - 1;
+            KeyEvent event;
+            event.row = static_cast<uint8_t>(row);
+            event.col = static_cast<uint8_t>(col);
+            event.pressed = (state >> col) & 1;
+            event.time_us = now;
+            if (xQueueSend(_queue, &event, 0) != pdTRUE) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+} // namespace ESP32_GPIO
+// End of KeypadScanner.cpp
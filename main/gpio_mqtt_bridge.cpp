@@ -0,0 +1,218 @@
+// @file GpioMqttBridge.cpp
+// @brief Implementation of the coalescing GPIO to MQTT bridge
+
+#include "../inc/gpio_mqtt_bridge.hpp"
+#include <algorithm>
+#include <iterator>
+#include "../inc/mqtt.hpp"
+
+#define TAG "GpioMqttBridge"
+
+namespace ESP32_GPIO {
+
+    GpioMqttBridge::GpioMqttBridge()
+        : _config(),
+        _numPins(0),
+        _task(nullptr),
+        _marked(0),
+        _published(0),
+        _seq(0),
+        _running(false),
+        _alive(false),
+        _forceSnapshot(false),
+        _edges(0),
+        _messages(0),
+        _failed(0)
+    {
+        portMUX_INITIALIZE(&_lock);
+        std::fill(std::begin(_index), std::end(_index), -1);
+    }
+
+    GpioMqttBridge::~GpioMqttBridge() {
+        stop();
+    }
+
+    bool GpioMqttBridge::start(const GpioBridgeConfig& config) {
+        stop();
+        if (!config.pins || config.num_pins == 0 || config.num_pins > GPIO_BRIDGE_MAX_PINS || !config.topic) {
+            ESP_LOGE(TAG, "Invalid bridge configuration (%u pins)", (unsigned)config.num_pins);
+            return false;
+        }
+        _config = config;
+        _topic = config.topic;
+        _numPins = config.num_pins;
+        for (size_t i = 0; i < _numPins; ++i) {
+            int pin = config.pins[i];
+            if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || _index[pin] >= 0) {
+                ESP_LOGE(TAG, "Invalid or duplicate pin %d", pin);
+                std::fill(std::begin(_index), std::end(_index), -1);
+                _numPins = 0;
+                return false;
+            }
+            _pins[i] = pin;
+            _index[pin] = static_cast<int8_t>(i);
+        }
+
+        GpioManager& gpio = GpioManager::getInstance();
+        for (size_t i = 0; i < _numPins; ++i) {
+            if (!gpio.configurePin(_pins[i], PinMode::INPUT, config.pull_up, config.pull_down, InterruptTrigger::BOTH)) {
+                ESP_LOGE(TAG, "Failed to configure pin %d", _pins[i]);
+                stop();
+                return false;
+            }
+        }
+
+        _marked = 0;
+        _published = snapshot();
+        _seq = 0;
+        _edges.store(0);
+        _messages.store(0);
+        _failed.store(0);
+        _running.store(true);
+        _alive.store(true);
+        if (xTaskCreate(&GpioMqttBridge::bridgeTask, "gpio_bridge", config.task_stack, this,
+                        config.task_priority, &_task) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create the bridge task");
+            _task = nullptr;
+            _running.store(false);
+            _alive.store(false);
+            stop();
+            return false;
+        }
+
+        // Handlers go in last, the ISR wakes the task
+        for (size_t i = 0; i < _numPins; ++i) {
+            if (!gpio.attachHandler(_pins[i], &GpioMqttBridge::edgeIsr, this)) {
+                ESP_LOGE(TAG, "Failed to attach handler to pin %d", _pins[i]);
+                stop();
+                return false;
+            }
+        }
+        // The first message carries the full state
+        requestSnapshot();
+        return true;
+    }
+
+    void GpioMqttBridge::stop() {
+        GpioManager& gpio = GpioManager::getInstance();
+        for (size_t i = 0; i < _numPins; ++i) {
+            gpio.detachHandler(_pins[i]);
+            gpio.resetPin(_pins[i]);
+        }
+        if (_task) {
+            _running.store(false);
+            xTaskNotifyGive(_task);
+            // The task may be inside a publish, let it leave on its own
+            while (_alive.load()) {
+                vTaskDelay(1);
+            }
+            _task = nullptr;
+        }
+        std::fill(std::begin(_index), std::end(_index), -1);
+        _numPins = 0;
+    }
+
+    void GpioMqttBridge::requestSnapshot() {
+        _forceSnapshot.store(true);
+        if (_task) xTaskNotifyGive(_task);
+    }
+
+    GpioBridgeStats GpioMqttBridge::getStats() const {
+        GpioBridgeStats stats;
+        stats.edges = _edges.load(std::memory_order_relaxed);
+        stats.messages = _messages.load(std::memory_order_relaxed);
+        stats.failed = _failed.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // Runs in the GpioManager ISR, records which pin moved and defers the rest
+    void GpioMqttBridge::edgeIsr(int gpio_num, int level, void* arg) {
+        GpioMqttBridge* self = static_cast<GpioMqttBridge*>(arg);
+        int8_t bit = self->_index[gpio_num];
+        if (bit < 0) return;
+        portENTER_CRITICAL_ISR(&self->_lock);
+        self->_marked |= (1ULL << bit);
+        portEXIT_CRITICAL_ISR(&self->_lock);
+        self->_edges.fetch_add(1, std::memory_order_relaxed);
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(self->_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+
+    void GpioMqttBridge::bridgeTask(void* arg) {
+        GpioMqttBridge* self = static_cast<GpioMqttBridge*>(arg);
+        self->run();
+        self->_alive.store(false);
+        vTaskDelete(nullptr);
+    }
+
+    void GpioMqttBridge::run() {
+        const TickType_t window = std::max<TickType_t>(1, pdMS_TO_TICKS(_config.window_ms));
+        uint64_t pending_pulses = 0;   // Kept across a rejected publish
+        bool force = false;
+        bool retry = false;
+        while (_running.load()) {
+            ulTaskNotifyTake(pdTRUE, retry ? window : portMAX_DELAY);
+            if (!_running.load()) break;
+
+            // Let the burst play out, edges during the window are covered by this snapshot
+            vTaskDelay(window);
+            ulTaskNotifyTake(pdTRUE, 0);
+            portENTER_CRITICAL(&_lock);
+            uint64_t marked = _marked;
+            _marked = 0;
+            portEXIT_CRITICAL(&_lock);
+
+            uint64_t levels = snapshot();
+            uint64_t changed = levels ^ _published;
+            uint64_t pulsed = pending_pulses | (marked & ~changed);
+            force |= _forceSnapshot.exchange(false);
+            if (!changed && !pulsed && !force) {
+                retry = false;
+                continue;
+            }
+
+            if (publish(changed, levels, pulsed)) {
+                _published = levels;
+                pending_pulses = 0;
+                force = false;
+                retry = false;
+            } else {
+                _failed.fetch_add(1, std::memory_order_relaxed);
+                pending_pulses = pulsed & ~changed;
+                retry = true;
+            }
+        }
+    }
+
+    uint64_t GpioMqttBridge::snapshot() const {
+        uint64_t port = GpioManager::getInstance().readPort();
+        uint64_t levels = 0;
+        for (size_t i = 0; i < _numPins; ++i) {
+            if ((port >> _pins[i]) & 1) levels |= (1ULL << i);
+        }
+        return levels;
+    }
+
+    bool GpioMqttBridge::publish(uint64_t changed, uint64_t levels, uint64_t pulsed) {
+        const size_t width = (_numPins + 7) / 8;
+        uint8_t payload[2 + 3 * sizeof(uint64_t)];
+        size_t len = 0;
+        payload[len++] = static_cast<uint8_t>(_seq);
+        payload[len++] = static_cast<uint8_t>(_seq >> 8);
+        for (uint64_t mask : { changed, levels, pulsed }) {
+            for (size_t b = 0; b < width; ++b) {
+                payload[len++] = static_cast<uint8_t>(mask >> (8 * b));
+            }
+        }
+
+        int msg_id = ESP32_MQTT::MqttClient::getInstance().publish(_topic.c_str(), reinterpret_cast<const char*>(payload), len,
+                                                                      _config.qos, _config.retain);
+        if (msg_id < 0) return false;
+        ++_seq;
+        _messages.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+} // namespace ESP32_GPIO
+// End of GpioMqttBridge.cpp
@@ -0,0 +1,393 @@
+// @file WaveformEngine.cpp
+// @brief Implementation of the buffered waveform output engine
+
+#include "../inc/gpio_waveform.hpp"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
+#if SOC_DEDICATED_GPIO_SUPPORTED
+#include "hal/dedic_gpio_cpu_ll.h"
+#endif
+
+#define TAG "WaveformEngine"
+
+namespace ESP32_GPIO {
+
+    // Longest duration of one half of an RMT symbol, in ticks
+    static constexpr uint32_t RMT_MAX_TICKS = 0x7FFF;
+
+    WaveformEngine::WaveformEngine()
+        : _mode(WaveformMode::AUTO),
+        _loaded(false),
+        _pins(0),
+        _durationNs(0)
+#if SOC_RMT_SUPPORTED && SOC_RMT_SUPPORT_TX_SYNCHRO
+        , _rmtSync(nullptr)
+#endif
+#if SOC_DEDICATED_GPIO_SUPPORTED
+        , _bundle(nullptr)
+#endif
+    {
+        portMUX_INITIALIZE(&_lock);
+    }
+
+    WaveformEngine::~WaveformEngine() {
+        release();
+    }
+
+    bool WaveformEngine::load(const WaveStep* steps, size_t count, const WaveformConfig& config) {
+        release();
+        if (!steps || !count) return false;
+
+        uint64_t pins = 0;
+        uint64_t duration = 0;
+        for (size_t i = 0; i < count; ++i) {
+            pins |= steps[i].mask;
+            duration += steps[i].duration_ns;
+        }
+        if (!pins || (SOC_GPIO_PIN_COUNT < 64 && (pins >> SOC_GPIO_PIN_COUNT))) {
+            ESP_LOGE(TAG, "Invalid waveform pin mask 0x%llx", (unsigned long long)pins);
+            return false;
+        }
+        _pins = pins;
+        _durationNs = duration;
+
+        const bool cpu_ok = duration <= config.max_blocking_us * 1000ULL;
+        WaveformMode mode = config.mode;
+        bool ok = false;
+
+#if SOC_RMT_SUPPORTED
+        // Several pins need as many channels, started in step by a sync manager
+        const int pin_count = __builtin_popcountll(pins);
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+        const bool rmt_fits = pin_count <= SOC_RMT_TX_CANDIDATES_PER_GROUP;
+#else
+        const bool rmt_fits = pin_count == 1;
+#endif
+        // An RMT track has no level of its own before its first step sets one,
+        // so every pin must be driven by the first step
+        const bool rmt_seeded = steps[0].mask == pins;
+        if (mode == WaveformMode::AUTO || mode == WaveformMode::RMT) {
+            if (!rmt_fits) {
+                if (mode == WaveformMode::RMT) ESP_LOGE(TAG, "RMT cannot play %d pins in step on this target", pin_count);
+            } else if (!rmt_seeded) {
+                if (mode == WaveformMode::RMT) ESP_LOGE(TAG, "RMT needs the first step to drive every pin of the waveform");
+            } else {
+                ok = compileRmt(steps, count, pins, config.rmt_resolution_hz);
+                if (ok) {
+                    _mode = WaveformMode::RMT;
+                } else {
+                    // Free the channels claimed so far before trying the CPU paths
+                    release();
+                    _pins = pins;
+                    _durationNs = duration;
+                }
+            }
+        }
+#endif
+#if SOC_DEDICATED_GPIO_SUPPORTED
+        if (!ok && cpu_ok && (mode == WaveformMode::AUTO || mode == WaveformMode::DEDICATED)
+            && __builtin_popcountll(pins) <= SOC_DEDIC_GPIO_OUT_CHANNELS_NUM) {
+            ok = compileDedicated(steps, count, pins);
+            if (ok) _mode = WaveformMode::DEDICATED;
+        }
+#endif
+        if (!ok && cpu_ok && (mode == WaveformMode::AUTO || mode == WaveformMode::IRAM_LOOP)) {
+            ok = compileCpu(steps, count, pins);
+            if (ok) _mode = WaveformMode::IRAM_LOOP;
+        }
+
+        if (!ok) {
+            if (!cpu_ok) {
+                ESP_LOGE(TAG, "Waveform of %llu us exceeds the %u us CPU playback limit",
+                         (unsigned long long)(duration / 1000), (unsigned)config.max_blocking_us);
+            } else {
+                ESP_LOGE(TAG, "No playback method available for this waveform");
+            }
+            release();
+            return false;
+        }
+        _loaded = true;
+        return true;
+    }
+
+    bool WaveformEngine::play(bool wait) {
+        if (!_loaded) return false;
+
+        switch (_mode) {
+#if SOC_RMT_SUPPORTED
+            case WaveformMode::RMT: {
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+                // The sync manager starts the channels once all of them have
+                // been given their symbols, a previous round must be over
+                if (_rmtSync) {
+                    waitDone(-1);
+                    rmt_sync_reset(_rmtSync);
+                }
+#endif
+                for (RmtTrack& track : _rmtTracks) {
+                    rmt_transmit_config_t tx_config = {};
+                    tx_config.flags.eot_level = track.eot_level;
+                    if (rmt_transmit(track.channel, track.encoder, track.symbols.data(),
+                                     track.symbols.size() * sizeof(rmt_symbol_word_t), &tx_config) != ESP_OK) {
+                        ESP_LOGE(TAG, "Failed to start RMT playback on pin %d", track.pin);
+                        return false;
+                    }
+                }
+                return wait ? waitDone(-1) : true;
+            }
+#endif
+#if SOC_DEDICATED_GPIO_SUPPORTED
+            case WaveformMode::DEDICATED:
+                portENTER_CRITICAL(&_lock);
+                playDedicated(_cpuSteps.data(), _cpuSteps.size());
+                portEXIT_CRITICAL(&_lock);
+                return true;
+#endif
+            case WaveformMode::IRAM_LOOP:
+                portENTER_CRITICAL(&_lock);
+                playRegisters(_cpuSteps.data(), _cpuSteps.size());
+                portEXIT_CRITICAL(&_lock);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool WaveformEngine::waitDone(int timeout_ms) {
+#if SOC_RMT_SUPPORTED
+        if (_loaded && _mode == WaveformMode::RMT) {
+            // The channels run in step, the timeout applies to each of them
+            bool done = true;
+            for (RmtTrack& track : _rmtTracks) {
+                done = rmt_tx_wait_all_done(track.channel, timeout_ms) == ESP_OK && done;
+            }
+            return done;
+        }
+#endif
+        // CPU playback has always finished when play() returns
+        return true;
+    }
+
+    void WaveformEngine::release() {
+#if SOC_RMT_SUPPORTED
+        for (RmtTrack& track : _rmtTracks) {
+            if (track.channel) rmt_tx_wait_all_done(track.channel, -1);
+        }
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+        // The group goes before its channels
+        if (_rmtSync) {
+            rmt_del_sync_manager(_rmtSync);
+            _rmtSync = nullptr;
+        }
+#endif
+        for (RmtTrack& track : _rmtTracks) {
+            if (track.channel) {
+                rmt_disable(track.channel);
+                rmt_del_channel(track.channel);
+            }
+            if (track.encoder) {
+                rmt_del_encoder(track.encoder);
+            }
+        }
+        _rmtTracks.clear();
+#endif
+#if SOC_DEDICATED_GPIO_SUPPORTED
+        if (_bundle) {
+            dedic_gpio_del_bundle(_bundle);
+            _bundle = nullptr;
+        }
+#endif
+        _cpuSteps.clear();
+        _loaded = false;
+        _pins = 0;
+        _durationNs = 0;
+        _mode = WaveformMode::AUTO;
+    }
+
+    WaveformMode WaveformEngine::mode() const {
+        return _mode;
+    }
+
+    uint64_t WaveformEngine::durationNs() const {
+        return _durationNs;
+    }
+
+#if SOC_RMT_SUPPORTED
+    bool WaveformEngine::compileRmt(const WaveStep* steps, size_t count, uint64_t pins, uint32_t resolution_hz) {
+        // Every track rounds the same step durations, so edges of different pins stay aligned
+        for (uint64_t rest = pins; rest; rest &= rest - 1) {
+            _rmtTracks.emplace_back();
+            RmtTrack& track = _rmtTracks.back();
+            track.pin = __builtin_ctzll(rest);
+            if (!compileRmtTrack(steps, count, track, resolution_hz)) return false;
+        }
+
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+        if (_rmtTracks.size() > 1) {
+            rmt_channel_handle_t channels[SOC_RMT_TX_CANDIDATES_PER_GROUP];
+            for (size_t i = 0; i < _rmtTracks.size(); ++i) {
+                channels[i] = _rmtTracks[i].channel;
+            }
+            rmt_sync_manager_config_t sync_config = {};
+            sync_config.tx_channel_array = channels;
+            sync_config.array_size = _rmtTracks.size();
+            if (rmt_new_sync_manager(&sync_config, &_rmtSync) != ESP_OK) {
+                _rmtSync = nullptr;
+                return false;
+            }
+        }
+#endif
+        return true;
+    }
+
+    bool WaveformEngine::compileRmtTrack(const WaveStep* steps, size_t count, RmtTrack& track, uint32_t resolution_hz) {
+        // Flatten the steps into (level, ticks) halves no longer than one symbol half
+        const int pin = track.pin;
+        bool level = false;    // Set by the first step, load() checks that it covers every pin
+        bool pending = false;  // A first half is waiting for its partner
+        rmt_symbol_word_t symbol = {};
+        auto push = [&](bool lvl, uint32_t ticks) {
+            if (!pending) {
+                symbol.level0 = lvl;
+                symbol.duration0 = ticks;
+            } else {
+                symbol.level1 = lvl;
+                symbol.duration1 = ticks;
+                track.symbols.push_back(symbol);
+            }
+            pending = !pending;
+        };
+
+        for (size_t i = 0; i < count; ++i) {
+            if (steps[i].mask & (1ULL << pin)) {
+                level = (steps[i].level >> pin) & 1;
+            }
+            uint64_t ticks = (static_cast<uint64_t>(steps[i].duration_ns) * resolution_hz + 500000000ULL) / 1000000000ULL;
+            if (ticks == 0) ticks = 1;
+            while (ticks) {
+                uint32_t chunk = ticks > RMT_MAX_TICKS ? RMT_MAX_TICKS : static_cast<uint32_t>(ticks);
+                push(level, chunk);
+                ticks -= chunk;
+            }
+        }
+        if (pending) {
+            // A zero-length second half ends the transmission
+            symbol.level1 = level;
+            symbol.duration1 = 0;
+            track.symbols.push_back(symbol);
+        }
+        track.eot_level = level;
+
+        rmt_tx_channel_config_t chan_config = {};
+        chan_config.gpio_num = pin;
+        chan_config.clk_src = RMT_CLK_SRC_DEFAULT;
+        chan_config.resolution_hz = resolution_hz;
+        // One memory block per channel, so a synced group can use every channel
+        chan_config.mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL;
+        chan_config.trans_queue_depth = 1;
+        if (rmt_new_tx_channel(&chan_config, &track.channel) != ESP_OK) {
+            track.channel = nullptr;
+            return false;
+        }
+        rmt_copy_encoder_config_t encoder_config = {};
+        if (rmt_new_copy_encoder(&encoder_config, &track.encoder) != ESP_OK) {
+            track.encoder = nullptr;
+            return false;
+        }
+        return rmt_enable(track.channel) == ESP_OK;
+    }
+#endif
+
+#if SOC_DEDICATED_GPIO_SUPPORTED
+    bool WaveformEngine::compileDedicated(const WaveStep* steps, size_t count, uint64_t pins) {
+        int gpio_array[SOC_DEDIC_GPIO_OUT_CHANNELS_NUM];
+        size_t size = 0;
+        for (uint64_t rest = pins; rest; rest &= rest - 1) {
+            gpio_array[size++] = __builtin_ctzll(rest);
+        }
+
+        dedic_gpio_bundle_config_t bundle_config = {};
+        bundle_config.gpio_array = gpio_array;
+        bundle_config.array_size = size;
+        bundle_config.flags.out_en = 1;
+        uint32_t offset = 0;
+        if (dedic_gpio_new_bundle(&bundle_config, &_bundle) != ESP_OK) {
+            _bundle = nullptr;
+            return false;
+        }
+        dedic_gpio_get_out_offset(_bundle, &offset);
+
+        const uint32_t ticks_per_us = esp_rom_get_cpu_ticks_per_us();
+        _cpuSteps.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            CpuStep& step = _cpuSteps[i];
+            step = {};
+            for (size_t bit = 0; bit < size; ++bit) {
+                uint64_t pin_bit = 1ULL << gpio_array[bit];
+                if (!(steps[i].mask & pin_bit)) continue;
+                step.set_lo |= 1U << (offset + bit);
+                if (steps[i].level & pin_bit) step.clr_lo |= 1U << (offset + bit);
+            }
+            step.cycles = static_cast<uint32_t>(static_cast<uint64_t>(steps[i].duration_ns) * ticks_per_us / 1000);
+        }
+        return true;
+    }
+#endif
+
+    bool WaveformEngine::compileCpu(const WaveStep* steps, size_t count, uint64_t pins) {
+        GpioManager& gpio = GpioManager::getInstance();
+        for (uint64_t rest = pins; rest; rest &= rest - 1) {
+            if (!gpio.configurePin(__builtin_ctzll(rest), PinMode::OUTPUT)) return false;
+        }
+
+        const uint32_t ticks_per_us = esp_rom_get_cpu_ticks_per_us();
+        _cpuSteps.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            const uint64_t set = steps[i].mask & steps[i].level;
+            const uint64_t clr = steps[i].mask & ~steps[i].level;
+            CpuStep& step = _cpuSteps[i];
+            step.set_lo = static_cast<uint32_t>(set);
+            step.clr_lo = static_cast<uint32_t>(clr);
+            step.set_hi = static_cast<uint32_t>(set >> 32);
+            step.clr_hi = static_cast<uint32_t>(clr >> 32);
+            step.cycles = static_cast<uint32_t>(static_cast<uint64_t>(steps[i].duration_ns) * ticks_per_us / 1000);
+        }
+        return true;
+    }
+
+    // Each edge is placed at the accumulated deadline, so the cost of the
+    // register writes does not add up across steps
+    void IRAM_ATTR WaveformEngine::playRegisters(const CpuStep* steps, size_t count) {
+        uint32_t deadline = esp_cpu_get_cycle_count();
+        for (size_t i = 0; i < count; ++i) {
+            const CpuStep& step = steps[i];
+            if (step.set_lo) REG_WRITE(GPIO_OUT_W1TS_REG, step.set_lo);
+            if (step.clr_lo) REG_WRITE(GPIO_OUT_W1TC_REG, step.clr_lo);
+#if SOC_GPIO_PIN_COUNT > 32
+            if (step.set_hi) REG_WRITE(GPIO_OUT1_W1TS_REG, step.set_hi);
+            if (step.clr_hi) REG_WRITE(GPIO_OUT1_W1TC_REG, step.clr_hi);
+#endif
+            deadline += step.cycles;
+            while (static_cast<int32_t>(esp_cpu_get_cycle_count() - deadline) < 0) {
+            }
+        }
+    }
+
+    void IRAM_ATTR WaveformEngine::playDedicated(const CpuStep* steps, size_t count) {
+#if SOC_DEDICATED_GPIO_SUPPORTED
+        uint32_t deadline = esp_cpu_get_cycle_count();
+        for (size_t i = 0; i < count; ++i) {
+            const CpuStep& step = steps[i];
+            dedic_gpio_cpu_ll_write_mask(step.set_lo, step.clr_lo);
+            deadline += step.cycles;
+            while (static_cast<int32_t>(esp_cpu_get_cycle_count() - deadline) < 0) {
+            }
+        }
+#endif
+    }
+
+} // namespace ESP32_GPIO
+// End of WaveformEngine.cpp
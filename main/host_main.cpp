@@ -0,0 +1,184 @@
+// @file host_main.cpp
+// @brief Linux host entry point: GPIO regression traces, or a trace given in the environment
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../inc/gpio.hpp"
+#include "../inc/gpio_encoder.hpp"
+#include "../inc/gpio_host_backend.hpp"
+
+#define TAG "GpioReplay"
+
+#ifndef GPIO_TEST_DIR
+#define GPIO_TEST_DIR "test/gpio" // Regression traces, relative to the working directory
+#endif
+
+using namespace ESP32_GPIO;
+
+static const char* const BUTTON_EVENTS[] = { "PRESS", "RELEASE", "LONG_PRESS" };
+
+/**
+ * @brief Replay a trace from the current virtual time and let the debounce wheel settle
+ * @return Edges replayed, -1 if the trace could not be read
+ */
+static int replay(HostGpioBackend& host, const std::string& path) {
+    int edges = host.loadTrace(path, host.nowUs());
+    if (edges < 0) return -1;
+    host.runAll();
+    host.advance(1000 * 1000);
+    return edges;
+}
+
+/**
+ * @brief Bouncing presses on pin 4, one held past the long-press time
+ *
+ * Logs "time_us pin EVENT" per button event, time relative to the start of the trace.
+ */
+static bool testDebounce(HostGpioBackend& host, const std::string& trace, std::vector<std::string>& events) {
+    GpioManager& gpio = GpioManager::getInstance();
+    const int64_t start = host.nowUs();
+    DebounceConfig config;
+    config.stable_ms = 20;
+    config.long_press_ms = 1000;
+    if (!gpio.addDebouncedPin(4, config, [&host, &events, start](int pin, ButtonEvent event) {
+            events.push_back(std::to_string(host.nowUs() - start) + " " + std::to_string(pin) + " "
+                             + BUTTON_EVENTS[static_cast<int>(event)]);
+        })) {
+        return false;
+    }
+    bool ok = replay(host, trace) >= 0;
+    gpio.removeDebouncedPin(4);
+    return ok;
+}
+
+/**
+ * @brief Quadrature edges on pins 5/6 decoded by the ISR path
+ *
+ * Logs "position N" after the trace and "errors N" for transitions where both channels changed.
+ */
+static bool testEncoder(HostGpioBackend& host, const std::string& trace, std::vector<std::string>& events) {
+    QuadratureEncoder encoder;
+    EncoderConfig config = {};
+    config.pin_a = 5;
+    config.pin_b = 6;
+    config.pull_up = true;
+    config.use_pcnt = false;
+    config.velocity_period_ms = 0;
+    if (!encoder.init(config)) return false;
+    bool ok = replay(host, trace) >= 0;
+    events.push_back("position " + std::to_string(encoder.getPosition()));
+    events.push_back("errors " + std::to_string(encoder.getErrorCount()));
+    encoder.deinit();
+    return ok;
+}
+
+/**
+ * @brief Read the expected events of a case, '#' lines and blank lines are skipped
+ */
+static bool readExpected(const std::string& path, std::vector<std::string>& lines) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        lines.push_back(line);
+    }
+    return true;
+}
+
+/**
+ * @brief Replay every regression trace and compare its events with the expected ones
+ * @return true if every case matched
+ */
+static bool runRegressionTraces(HostGpioBackend& host, const std::string& dir) {
+    struct TestCase {
+        const char* name;
+        bool (*run)(HostGpioBackend& host, const std::string& trace, std::vector<std::string>& events);
+    };
+    static const TestCase CASES[] = {
+        { "debounce", &testDebounce },
+        { "encoder",  &testEncoder },
+    };
+
+    int failed = 0;
+    for (const TestCase& test : CASES) {
+        const std::string base = dir + "/" + test.name;
+        std::vector<std::string> expected;
+        std::vector<std::string> events;
+        if (!readExpected(base + ".expected", expected)) {
+            ESP_LOGE(TAG, "%s: cannot read %s.expected", test.name, base.c_str());
+            ++failed;
+            continue;
+        }
+        if (!test.run(host, base + ".trace", events)) {
+            ESP_LOGE(TAG, "%s: cannot replay %s.trace", test.name, base.c_str());
+            ++failed;
+            continue;
+        }
+
+        bool match = events.size() == expected.size();
+        for (size_t i = 0; i < events.size() || i < expected.size(); ++i) {
+            const std::string got = i < events.size() ? events[i] : "(nothing)";
+            const std::string want = i < expected.size() ? expected[i] : "(nothing)";
+            if (got != want) {
+                ESP_LOGE(TAG, "%s: event %u is \"%s\", expected \"%s\"", test.name, (unsigned)i, got.c_str(), want.c_str());
+                match = false;
+            }
+        }
+        if (match) {
+            ESP_LOGI(TAG, "%s: %u events match", test.name, (unsigned)events.size());
+        } else {
+            ++failed;
+        }
+    }
+    ESP_LOGI(TAG, "%d of %u trace cases failed", failed, (unsigned)(sizeof(CASES) / sizeof(CASES[0])));
+    return failed == 0;
+}
+
+// GPIO_TRACE    trace file to replay ("time_us pin level" per line)
+// GPIO_PINS     comma separated pins registered as debounced inputs
+// GPIO_RECORD   output file for the recorded backend calls
+// Without GPIO_TRACE the regression traces in GPIO_TEST_DIR are checked
+// and the process exits with 1 if any of them does not match.
+extern "C" void app_main(void)
+{
+    HostGpioBackend& host = static_cast<HostGpioBackend&>(defaultGpioBackend());
+    GpioManager& gpio = GpioManager::getInstance();
+    gpio.init();
+
+    const char* trace = std::getenv("GPIO_TRACE");
+    if (!trace) {
+        const char* dir = std::getenv("GPIO_TEST_DIR");
+        std::exit(runRegressionTraces(host, dir ? dir : GPIO_TEST_DIR) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    const char* pins = std::getenv("GPIO_PINS");
+    const char* output = std::getenv("GPIO_RECORD");
+    if (!pins) {
+        ESP_LOGE(TAG, "Set GPIO_PINS with GPIO_TRACE");
+        return;
+    }
+
+    std::istringstream list(pins);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        int pin = std::atoi(item.c_str());
+        gpio.addDebouncedPin(pin, DebounceConfig(), [&host](int gpio_num, ButtonEvent event) {
+            ESP_LOGI(TAG, "%lld us: pin %d %s", (long long)host.nowUs(), gpio_num, BUTTON_EVENTS[static_cast<int>(event)]);
+        });
+    }
+
+    int edges = replay(host, trace);
+    if (edges < 0) {
+        ESP_LOGE(TAG, "Cannot read trace %s", trace);
+        return;
+    }
+    ESP_LOGI(TAG, "Replayed %d edges", edges);
+
+    if (output && !host.saveRecords(output)) {
+        ESP_LOGE(TAG, "Cannot write %s", output);
+    }
+}
@@ -3,9 +3,21 @@
 
 #include "../inc/mqtt.hpp"
 #include <cstring>
+#include <new>
+#include "esp_timer.h"
+#include "../inc/binary_log.hpp"
+#include "../inc/mqtt_assembler.hpp"
+#include "../inc/mqtt_router.hpp"
+#include "../inc/mqtt_store.hpp"
 
 namespace ESP32_MQTT {
 
+// Fixed header, topic length and packet id around topic and payload
+static constexpr size_t MQTT_PUBLISH_OVERHEAD = 9;
+
+// esp-mqtt retransmit timeout when the configuration leaves it at 0
+static constexpr uint32_t MQTT_DEFAULT_RETRANSMIT_MS = 1000;
+
 MqttClient& MqttClient::getInstance() {
     static MqttClient instance;
     return instance;
@@ -17,6 +29,11 @@ MqttClient::MqttClient()
     _status(MqttStatus::DISCONNECTED),
     _userCallback(nullptr),
     _userData(nullptr),
+    _router(nullptr),
+    _store(nullptr),
+    _assembler(nullptr),
+    _backpressureCallback(nullptr),
+    _backpressureData(nullptr),
     _brokerUri(""),
     _clientId(""),
     _willTopic(""),
@@ -24,15 +41,20 @@ MqttClient::MqttClient()
     _willQos(0),
     _willRetain(false)
 {
+    _publishMutex = xSemaphoreCreateMutex();
+    _configMutex = xSemaphoreCreateMutex();
+    resetOutbox();
     ESP_LOGI("MQTT", "MqttClient instance created");
 }
 
 MqttClient::~MqttClient() {
-    if (_client) {
-        esp_mqtt_client_stop(_client);
-        esp_mqtt_client_destroy(_client);
-        _client = nullptr;
+    esp_mqtt_client_handle_t client = retireClient();
+    if (client) {
+        esp_mqtt_client_stop(client);
+        esp_mqtt_client_destroy(client);
     }
+    if (_publishMutex) vSemaphoreDelete(_publishMutex);
+    if (_configMutex) vSemaphoreDelete(_configMutex);
 }
 
 bool MqttClient::init() {
@@ -40,6 +62,31 @@ bool MqttClient::init() {
     return true;
 }
 
+bool MqttClient::setProtocol(MqttProtocol protocol, const Mqtt5Options& options) {
+#if !CONFIG_MQTT_PROTOCOL_5
+    if (protocol == MqttProtocol::V5) {
+        ESP_LOGE("MQTT", "MQTT 5 needs CONFIG_MQTT_PROTOCOL_5");
+        return false;
+    }
+#endif
+    _protocol = protocol;
+    _mqtt5 = options;
+    return true;
+}
+
+MqttProtocol MqttClient::getProtocol() const {
+    return _protocol;
+}
+
+MqttAliasStats MqttClient::getAliasStats() const {
+    MqttAliasStats stats = {};
+    if (!_publishMutex) return stats;
+    xSemaphoreTake(_publishMutex, portMAX_DELAY);
+    stats = _aliases.getStats();
+    xSemaphoreGive(_publishMutex);
+    return stats;
+}
+
 bool MqttClient::configure(
     const std::string& uri,
     const std::string& clientId,
@@ -48,102 +95,308 @@ bool MqttClient::configure(
     int keepalive,
     bool cleanSession
 ) {
+    if (!_configMutex) return false;
+    xSemaphoreTake(_configMutex, portMAX_DELAY);
     _brokerUri = uri;
     _clientId = clientId;
+    _username = username;
+    _password = password;
+    _keepalive = keepalive;
+    _cleanSession = cleanSession;
+    fillConfig();
+
+    // An existing client takes the new settings in place: the connection
+    // stays up and they are sent with the next CONNECT
+    esp_mqtt_client_handle_t client = _client.load();
+    if (client && esp_mqtt_set_config(client, &_config) == ESP_OK) {
+        applySession(client);
+        xSemaphoreGive(_configMutex);
+        return true;
+    }
+
+    if (client) ESP_LOGW("MQTT", "Client rejected the new settings, replacing it");
+    bool ok = createClient();
+    xSemaphoreGive(_configMutex);
+    return ok;
+}
+
+bool MqttClient::setNetworkOptions(const MqttNetworkOptions& options) {
+    if (!_configMutex) return false;
+    xSemaphoreTake(_configMutex, portMAX_DELAY);
+    _network = options;
+    bool ok = applyConfig();
+    xSemaphoreGive(_configMutex);
+    return ok;
+}
 
+bool MqttClient::reconnect() {
+    if (!_configMutex) return false;
+    xSemaphoreTake(_configMutex, portMAX_DELAY);
+    esp_mqtt_client_handle_t client = _client.load();
+    bool ok = false;
+    if (client) {
+        // esp_mqtt_client_disconnect() only asks the MQTT task to disconnect,
+        // esp_mqtt_client_reconnect() fails until the client waits to
+        // reconnect. The DISCONNECTED event cuts that wait short.
+        _reconnectPending = true;
+        ok = esp_mqtt_client_disconnect(client) == ESP_OK;
+        if (!ok) {
+            // Not connected, it may already be waiting to reconnect
+            _reconnectPending = false;
+            ok = esp_mqtt_client_reconnect(client) == ESP_OK;
+        }
+    }
+    xSemaphoreGive(_configMutex);
+    return ok;
+}
+
+bool MqttClient::recreate() {
+    if (!_configMutex) return false;
+    xSemaphoreTake(_configMutex, portMAX_DELAY);
+    bool ok = false;
+    if (_client.load()) {
+        const bool restart = _started;
+        fillConfig();
+        ok = createClient();
+        if (ok && restart) {
+            ok = esp_mqtt_client_start(_client.load()) == ESP_OK;
+            _status = ok ? MqttStatus::CONNECTING : MqttStatus::ERROR;
+            _started = ok;
+        }
+    }
+    xSemaphoreGive(_configMutex);
+    return ok;
+}
+
+// Called with the config mutex held. _config only points into owned members,
+// esp-mqtt copies the strings it keeps.
+void MqttClient::fillConfig() {
     memset(&_config, 0, sizeof(_config));
     _config.broker.address.uri = _brokerUri.c_str();
     _config.credentials.client_id = _clientId.c_str();
-    if (!username.empty()) _config.credentials.username = username.c_str();
-    if (!password.empty()) {
-        _config.credentials.authentication.password = password.c_str();
-    };
-    _config.session.keepalive = keepalive;
-    _config.session.disable_clean_session = cleanSession;
+    if (!_username.empty()) _config.credentials.username = _username.c_str();
+    if (!_password.empty()) _config.credentials.authentication.password = _password.c_str();
+    _config.session.keepalive = _keepalive;
+    _config.session.disable_clean_session = !_cleanSession;
+    _config.session.message_retransmit_timeout = _network.retransmit_timeout_ms;
+    _retransmitMs.store(_network.retransmit_timeout_ms > 0 ? _network.retransmit_timeout_ms : MQTT_DEFAULT_RETRANSMIT_MS,
+                        std::memory_order_relaxed);
+    _config.session.protocol_ver = (_protocol == MqttProtocol::V5) ? MQTT_PROTOCOL_V_5 : MQTT_PROTOCOL_V_3_1_1;
+    _config.network.reconnect_timeout_ms = _network.reconnect_timeout_ms;
+    _config.network.timeout_ms = _network.timeout_ms;
+    _config.outbox.limit = _outboxBudget;
     // LWT fields if setWill called earlier
     if (!_willTopic.empty()) {
         _config.session.last_will.topic = _willTopic.c_str();
         _config.session.last_will.msg = _willPayload.c_str();
+        _config.session.last_will.msg_len = static_cast<int>(_willPayload.size());
         _config.session.last_will.qos = _willQos;
         _config.session.last_will.retain = _willRetain;
     }
+}
 
-    _client = esp_mqtt_client_init(&_config);
-    if (!_client) {
-        _status = MqttStatus::ERROR;
-        return false;
-    }
+// Called with the config mutex held, refreshes a configured client in place
+bool MqttClient::applyConfig() {
+    fillConfig();
+    esp_mqtt_client_handle_t client = _client.load();
+    return !client || esp_mqtt_set_config(client, &_config) == ESP_OK;
+}
 
-    esp_mqtt_client_register_event(
-        _client, 
-        MQTT_EVENT_ANY, 
-        &MqttClient::eventHandlerCb, 
-        this
-    );
-    _status = MqttStatus::DISCONNECTED;
-    return true;
+// Called with the config mutex held
+void MqttClient::applySession(esp_mqtt_client_handle_t client) {
+    if (_publishMutex) xSemaphoreTake(_publishMutex, portMAX_DELAY);
+    // Reset in place, the MQTT task may be inside reconnected() right now
+    uint16_t alias_max = 0;
+#if CONFIG_MQTT_PROTOCOL_5
+    if (_protocol == MqttProtocol::V5) {
+        esp_mqtt5_connection_property_config_t property = {};
+        property.session_expiry_interval = _mqtt5.session_expiry_s;
+        property.topic_alias_maximum = _mqtt5.receive_alias_max;
+        property.request_problem_info = true;
+        esp_mqtt5_client_set_connect_property(client, &property);
+        // Starts empty, aliases are sent with their topic again before being used alone
+        alias_max = _mqtt5.topic_alias_max;
+    }
+#endif
+    _aliases.resize(alias_max, _mqtt5.alias_after);
+    if (_publishMutex) xSemaphoreGive(_publishMutex);
 }
 
 void MqttClient::setWill(const std::string& topic,
                          const std::string& payload,
                          int qos,
                          bool retain) {
+    if (_configMutex) xSemaphoreTake(_configMutex, portMAX_DELAY);
     _willTopic = topic;
     _willPayload = payload;
     _willQos = qos;
     _willRetain = retain;
+    // A configured client sends the new will with its next CONNECT
+    applyConfig();
+    if (_configMutex) xSemaphoreGive(_configMutex);
 }
 
 bool MqttClient::connect() {
-    if (!_client) return false;
-    esp_err_t err = esp_mqtt_client_start(_client);
-    if (err == ESP_OK) {
-        _status = MqttStatus::CONNECTING;
-        return true;
+    if (!_configMutex) return false;
+    xSemaphoreTake(_configMutex, portMAX_DELAY);
+    esp_mqtt_client_handle_t client = _client.load();
+    bool ok = false;
+    if (client) {
+        ok = esp_mqtt_client_start(client) == ESP_OK;
+        _status = ok ? MqttStatus::CONNECTING : MqttStatus::ERROR;
+        if (ok) _started = true;
     }
-    _status = MqttStatus::ERROR;
-    return false;
+    xSemaphoreGive(_configMutex);
+    return ok;
 }
 
 bool MqttClient::disconnect() {
-    if (!_client) return false;
-    esp_err_t err = esp_mqtt_client_stop(_client);
-    if (err == ESP_OK) {
+    if (!_configMutex) return false;
+    xSemaphoreTake(_configMutex, portMAX_DELAY);
+    esp_mqtt_client_handle_t client = _client.load();
+    bool ok = client && esp_mqtt_client_stop(client) == ESP_OK;
+    if (ok) {
         _status = MqttStatus::DISCONNECTED;
-        return true;
+        _started = false;
     }
-    return false;
+    xSemaphoreGive(_configMutex);
+    return ok;
 }
 
 int MqttClient::publish(
-    const std::string& topic,
-    const std::string& payload,
+    std::string_view topic,
+    std::string_view payload,
     int qos,
     bool retain
 ) {
-    if (!_client) return -1;
-    return esp_mqtt_client_publish(_client, topic.c_str(), payload.c_str(), 0, qos, retain);
+    if (topic.size() < MQTT_TOPIC_STACK_LEN) {
+        char terminated[MQTT_TOPIC_STACK_LEN];
+        memcpy(terminated, topic.data(), topic.size());
+        terminated[topic.size()] = '\0';
+        return publish(terminated, payload.data(), payload.size(), qos, retain);
+    }
+    // Rare long topic, fall back to a heap copy
+    std::string terminated(topic);
+    return publish(terminated.c_str(), payload.data(), payload.size(), qos, retain);
 }
 
 int MqttClient::publish(
-    const std::string& topic,
+    std::string_view topic,
     const uint8_t* data,
     size_t len,
     int qos,
     bool retain
 ) {
-    if (!_client) return -1;
-    return esp_mqtt_client_publish(_client, topic.c_str(), reinterpret_cast<const char*>(data), len, qos, retain);
+    return publish(topic, std::string_view(reinterpret_cast<const char*>(data), len), qos, retain);
+}
+
+int MqttClient::publish(
+    const char* topic,
+    const char* data,
+    size_t len,
+    int qos,
+    bool retain
+) {
+    static const MqttPublishOptions defaults;
+    return publish(topic, data, len, qos, retain, defaults);
+}
+
+int MqttClient::publish(
+    const char* topic,
+    const char* data,
+    size_t len,
+    int qos,
+    bool retain,
+    const MqttPublishOptions& options
+) {
+    if (!topic) return -1;
+    if (_store && _status != MqttStatus::CONNECTED) {
+        return _store->append(topic, data, len, qos, retain) ? 0 : -1;
+    }
+    ClientRef client(*this);
+    if (!client.handle) return -1;
+    // Only QoS 1/2 messages stay in the outbox until acknowledged
+    int slot = -1;
+    if (qos > 0) {
+        slot = reserveOutbox(qos, strlen(topic) + len + MQTT_PUBLISH_OVERHEAD, latencyClass(topic));
+        if (slot == -2) return -2;
+    }
+    // esp-mqtt only queues a publish made while disconnected, it goes out first on the next connect
+    const bool connected = _status == MqttStatus::CONNECTED;
+    int msg_id = send(client.handle, topic, data, len, qos, retain, options);
+    if (slot >= 0) commitOutbox(slot, msg_id, connected);
+    return msg_id;
+}
+
+int MqttClient::send(
+    esp_mqtt_client_handle_t client,
+    const char* topic,
+    const char* data,
+    size_t len,
+    int qos,
+    bool retain,
+    const MqttPublishOptions& options
+) {
+    // esp-mqtt runs strlen() on a non-null payload given with length 0
+    if (!len) data = nullptr;
+#if CONFIG_MQTT_PROTOCOL_5
+    if (_protocol == MqttProtocol::V5 && _publishMutex) {
+        if (options.user_property_count > MQTT_USER_PROPERTY_MAX) return -1;
+        esp_mqtt5_publish_property_config_t property = {};
+        property.message_expiry_interval = options.expiry_s;
+        property.content_type = options.content_type;
+        if (options.user_property_count) {
+            esp_mqtt5_user_property_item_t items[MQTT_USER_PROPERTY_MAX];
+            for (size_t i = 0; i < options.user_property_count; ++i) {
+                items[i].key = options.user_properties[i].key;
+                items[i].value = options.user_properties[i].value;
+            }
+            if (esp_mqtt5_client_set_user_property(&property.user_property, items,
+                                                   static_cast<uint8_t>(options.user_property_count)) != ESP_OK) {
+                return -1;
+            }
+        }
+
+        // Publish properties are client-wide in esp-mqtt, the lock keeps them with this message
+        xSemaphoreTake(_publishMutex, portMAX_DELAY);
+        bool established = false;
+        uint16_t alias = 0;
+        // QoS 1/2 packets are resent as they are after a reconnect, by then
+        // their alias may belong to another topic, so they never carry one
+        if (_aliases.valid() && options.alias && qos == 0 && _status == MqttStatus::CONNECTED) {
+            alias = _aliases.lookup(topic, established);
+        }
+        property.topic_alias = alias;
+        if (esp_mqtt5_client_set_publish_property(client, &property) != ESP_OK && alias) {
+            // The broker allows fewer aliases than configured
+            BLOG_W("MQTT", "Broker refused topic alias %u", alias);
+            _aliases.limit(alias - 1);
+            alias = 0;
+            property.topic_alias = 0;
+            esp_mqtt5_client_set_publish_property(client, &property);
+        }
+        const bool elide = alias && established;
+        int msg_id = esp_mqtt_client_publish(client, elide ? "" : topic, data, static_cast<int>(len), qos, retain);
+        if (msg_id >= 0 && alias) _aliases.sent(alias, strlen(topic), elide);
+        xSemaphoreGive(_publishMutex);
+
+        if (property.user_property) esp_mqtt5_client_delete_user_property(property.user_property);
+        return msg_id;
+    }
+#endif
+    return esp_mqtt_client_publish(client, topic, data, static_cast<int>(len), qos, retain);
 }
 
 int MqttClient::subscribe(const std::string& topic, int qos) {
-    if (!_client) return -1;
-    return esp_mqtt_client_subscribe_single(_client, topic.c_str(), qos);
+    ClientRef client(*this);
+    if (!client.handle) return -1;
+    return esp_mqtt_client_subscribe_single(client.handle, topic.c_str(), qos);
 }
 
 int MqttClient::unsubscribe(const std::string& topic) {
-    if (!_client) return -1;
-    return esp_mqtt_client_unsubscribe(_client, topic.c_str());
+    ClientRef client(*this);
+    if (!client.handle) return -1;
+    return esp_mqtt_client_unsubscribe(client.handle, topic.c_str());
 }
 
 void MqttClient::setEventCallback(MqttEventCallback callback, void* user_data) {
@@ -151,16 +404,396 @@ void MqttClient::setEventCallback(MqttEventCallback callback, void* user_data) {
     _userData = user_data;
 }
 
+void MqttClient::setRouter(TopicRouter* router) {
+    _router = router;
+}
+
+TopicRouter* MqttClient::getRouter() const {
+    return _router;
+}
+
+void MqttClient::setAssembler(MessageAssembler* assembler) {
+    _assembler = assembler;
+}
+
+MessageAssembler* MqttClient::getAssembler() const {
+    return _assembler;
+}
+
+void MqttClient::setOfflineStore(OfflineStore* store) {
+    _store = store;
+}
+
+OfflineStore* MqttClient::getOfflineStore() const {
+    return _store;
+}
+
+bool MqttClient::setOutboxBudget(size_t budget, size_t high_water, size_t low_water) {
+    if (budget) {
+        if (!high_water) high_water = budget / 4 * 3;
+        if (!low_water) low_water = budget / 2;
+        if (low_water >= high_water || high_water > budget) return false;
+    } else {
+        high_water = 0;
+        low_water = 0;
+    }
+    portENTER_CRITICAL(&_outboxLock);
+    _outboxBudget = budget;
+    _outboxHigh = high_water;
+    _outboxLow = low_water;
+    bool changed = updateThrottle();
+    bool throttled = _throttled;
+    portEXIT_CRITICAL(&_outboxLock);
+    if (changed) notifyBackpressure(throttled);
+
+    // The esp-mqtt outbox limit follows without a reconnect
+    if (_configMutex) {
+        xSemaphoreTake(_configMutex, portMAX_DELAY);
+        applyConfig();
+        xSemaphoreGive(_configMutex);
+    }
+    return true;
+}
+
+void MqttClient::setBackpressureCallback(MqttBackpressureCallback callback, void* user_data) {
+    _backpressureCallback = callback;
+    _backpressureData = user_data;
+}
+
+bool MqttClient::isThrottled() const {
+    return _throttled;
+}
+
+MqttOutboxStats MqttClient::getOutboxStats() const {
+    MqttOutboxStats stats = {};
+    portENTER_CRITICAL(const_cast<portMUX_TYPE*>(&_outboxLock));
+    for (const OutboxEntry& entry : _outbox) {
+        if (entry.msg_id < 0) continue;
+        ++stats.inflight[entry.qos];
+        stats.inflight_bytes[entry.qos] += entry.bytes;
+    }
+    stats.bytes = _outboxBytes;
+    stats.peak_bytes = _outboxPeak;
+    stats.budget = _outboxBudget;
+    stats.rejected = _outboxRejected;
+    stats.untracked = _outboxUntracked;
+    stats.throttled = _throttled;
+    portEXIT_CRITICAL(const_cast<portMUX_TYPE*>(&_outboxLock));
+    return stats;
+}
+
+int MqttClient::addLatencyClass(std::string_view filter) {
+    if (_latencyClasses >= MQTT_LATENCY_CLASS_MAX || !TopicRouter::isValidFilter(filter)) return -1;
+    _latencyFilters[_latencyClasses] = std::string(filter);
+    return _latencyClasses++;
+}
+
+MqttLatencyStats MqttClient::getLatencyStats(int topic_class, int qos) const {
+    MqttLatencyStats stats = {};
+    if (topic_class < 0 || topic_class >= _latencyClasses || qos < 1 || qos > 2) return stats;
+    portENTER_CRITICAL(const_cast<portMUX_TYPE*>(&_outboxLock));
+    stats = _latency[topic_class][qos - 1];
+    portEXIT_CRITICAL(const_cast<portMUX_TYPE*>(&_outboxLock));
+    return stats;
+}
+
+void MqttClient::resetLatencyStats() {
+    portENTER_CRITICAL(&_outboxLock);
+    for (auto& topic_class : _latency) {
+        for (MqttLatencyStats& stats : topic_class) {
+            stats = MqttLatencyStats();
+        }
+    }
+    portEXIT_CRITICAL(&_outboxLock);
+}
+
+uint32_t MqttLatencyStats::percentile(unsigned percent) const {
+    if (!count) return 0;
+    if (percent > 100) percent = 100;
+    uint64_t rank = (static_cast<uint64_t>(count) * percent + 99) / 100;
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < MQTT_LATENCY_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            // The last bucket is open ended, the largest sample bounds it
+            const uint32_t bound = i + 1 < MQTT_LATENCY_BUCKETS ? (1u << i) : max_ms;
+            return bound < max_ms ? bound : max_ms;
+        }
+    }
+    return max_ms;
+}
+
 MqttStatus MqttClient::getStatus() const {
     return _status;
 }
 
 std::string MqttClient::getBrokerUri() const {
-    return _brokerUri;
+    if (!_configMutex) return _brokerUri;
+    xSemaphoreTake(_configMutex, portMAX_DELAY);
+    std::string uri = _brokerUri;
+    xSemaphoreGive(_configMutex);
+    return uri;
 }
 
 std::string MqttClient::getClientId() const {
-    return _clientId;
+    if (!_configMutex) return _clientId;
+    xSemaphoreTake(_configMutex, portMAX_DELAY);
+    std::string id = _clientId;
+    xSemaphoreGive(_configMutex);
+    return id;
+}
+
+// The count is raised before the handle is read, so retireClient() either
+// sees this call or this call sees the cleared handle
+MqttClient::ClientRef::ClientRef(MqttClient& owner)
+    : handle(nullptr),
+    _owner(owner)
+{
+    _owner._clientUsers.fetch_add(1);
+    handle = _owner._client.load();
+}
+
+MqttClient::ClientRef::~ClientRef() {
+    _owner._clientUsers.fetch_sub(1);
+}
+
+esp_mqtt_client_handle_t MqttClient::retireClient() {
+    esp_mqtt_client_handle_t client = _client.exchange(nullptr);
+    _status = MqttStatus::DISCONNECTED;
+    _reconnectPending = false;
+    if (client) {
+        // Publishers still inside esp-mqtt with the old handle
+        while (_clientUsers.load() != 0) {
+            vTaskDelay(1);
+        }
+    }
+    return client;
+}
+
+// Called with the config mutex held. Publishers see no client from here on,
+// the old one goes once they are done with it.
+bool MqttClient::createClient() {
+    esp_mqtt_client_handle_t old = retireClient();
+    if (old) {
+        esp_mqtt_client_stop(old);
+        esp_mqtt_client_destroy(old);
+    }
+    _started = false;
+
+    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&_config);
+    if (!client) {
+        _status = MqttStatus::ERROR;
+        return false;
+    }
+    applySession(client);
+
+    esp_mqtt_client_register_event(
+        client, 
+        MQTT_EVENT_ANY, 
+        &MqttClient::eventHandlerCb, 
+        this
+    );
+    resetOutbox();
+    _status = MqttStatus::DISCONNECTED;
+    _client.store(client);
+    return true;
+}
+
+// Returns the tracking slot, -1 to send untracked or -2 to refuse the publish
+int MqttClient::reserveOutbox(int qos, size_t bytes, uint8_t topic_class) {
+    int slot = -2;
+    portENTER_CRITICAL(&_outboxLock);
+    if (!_outboxBudget || _outboxBytes + bytes <= _outboxBudget) {
+        for (int i = 0; i < MQTT_OUTBOX_TRACK_MAX; ++i) {
+            if (_outbox[i].msg_id < 0) {
+                slot = i;
+                break;
+            }
+        }
+        // Without a budget a full table only costs the accounting, esp-mqtt
+        // still queues the message as it would without tracking
+        if (slot < 0 && !_outboxBudget) {
+            slot = -1;
+            ++_outboxUntracked;
+        }
+    }
+    bool changed = false;
+    if (slot >= 0) {
+        _outbox[slot].msg_id = 0;
+        _outbox[slot].qos = static_cast<uint8_t>(qos > 2 ? 2 : qos);
+        _outbox[slot].topic_class = topic_class;
+        _outbox[slot].resent = false;
+        _outbox[slot].sent_connected = false;
+        _outbox[slot].stored = false;
+        _outbox[slot].bytes = static_cast<uint32_t>(bytes);
+        _outbox[slot].sent_us = esp_timer_get_time();
+        _outboxBytes += bytes;
+        if (_outboxBytes > _outboxPeak) _outboxPeak = _outboxBytes;
+        changed = updateThrottle();
+    } else if (slot == -2) {
+        ++_outboxRejected;
+    }
+    bool throttled = _throttled;
+    portEXIT_CRITICAL(&_outboxLock);
+    if (changed) notifyBackpressure(throttled);
+    return slot;
+}
+
+void MqttClient::commitOutbox(int slot, int msg_id, bool sent_connected) {
+    portENTER_CRITICAL(&_outboxLock);
+    // The MQTT task may have seen the ack before the publish call returned
+    bool acked = false;
+    for (int& early : _earlyAcks) {
+        if (msg_id > 0 && early == msg_id) {
+            early = -1;
+            acked = true;
+        }
+    }
+    bool changed = false;
+    if (msg_id <= 0 || acked) {
+        if (acked) recordLatency(_outbox[slot], false);
+        _outboxBytes -= _outbox[slot].bytes;
+        _outbox[slot].msg_id = -1;
+        changed = updateThrottle();
+    } else {
+        _outbox[slot].msg_id = msg_id;
+        _outbox[slot].sent_connected = sent_connected;
+    }
+    bool throttled = _throttled;
+    portEXIT_CRITICAL(&_outboxLock);
+    if (changed) notifyBackpressure(throttled);
+}
+
+void MqttClient::releaseOutbox(int msg_id, bool expired) {
+    if (msg_id <= 0) return;
+    portENTER_CRITICAL(&_outboxLock);
+    bool found = false;
+    bool stored = false;
+    for (OutboxEntry& entry : _outbox) {
+        if (entry.msg_id == msg_id) {
+            recordLatency(entry, expired);
+            _outboxBytes -= entry.bytes;
+            entry.msg_id = -1;
+            found = true;
+            stored = entry.stored;
+            break;
+        }
+    }
+    if (!found) {
+        // Acks of untracked publishes land here too, keep pending early acks while there is room
+        const size_t count = sizeof(_earlyAcks) / sizeof(_earlyAcks[0]);
+        size_t index = _earlyAckNext;
+        for (size_t i = 0; i < count; ++i) {
+            if (_earlyAcks[i] < 0) {
+                index = i;
+                break;
+            }
+        }
+        _earlyAcks[index] = msg_id;
+        _earlyAckNext = (index + 1) % count;
+    }
+    bool changed = updateThrottle();
+    bool throttled = _throttled;
+    portEXIT_CRITICAL(&_outboxLock);
+    if (changed) notifyBackpressure(throttled);
+    if (stored && _store) _store->published(!expired);
+}
+
+bool MqttClient::watchOutbox(int msg_id) {
+    if (msg_id <= 0) return false;
+    bool found = false;
+    portENTER_CRITICAL(&_outboxLock);
+    for (OutboxEntry& entry : _outbox) {
+        if (entry.msg_id == msg_id) {
+            entry.stored = true;
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_outboxLock);
+    return found;
+}
+
+void MqttClient::resetOutbox() {
+    // A new esp-mqtt client starts with an empty outbox, a replayed message waiting there is gone
+    bool lost = false;
+    portENTER_CRITICAL(&_outboxLock);
+    for (OutboxEntry& entry : _outbox) {
+        if (_store && entry.msg_id > 0 && entry.stored) lost = true;
+        entry.msg_id = -1;
+    }
+    for (int& early : _earlyAcks) {
+        early = -1;
+    }
+    _outboxBytes = 0;
+    bool changed = updateThrottle();
+    portEXIT_CRITICAL(&_outboxLock);
+    if (changed) notifyBackpressure(false);
+    if (lost) _store->published(false);
+}
+
+// esp-mqtt sends everything still unacknowledged again after a reconnect.
+// Messages queued while offline go out for the first time here.
+void MqttClient::markOutboxResent() {
+    portENTER_CRITICAL(&_outboxLock);
+    for (OutboxEntry& entry : _outbox) {
+        if (entry.msg_id <= 0) continue;
+        if (entry.sent_connected) entry.resent = true;
+        entry.sent_connected = true;
+    }
+    portEXIT_CRITICAL(&_outboxLock);
+}
+
+uint8_t MqttClient::latencyClass(std::string_view topic) const {
+    for (int i = 1; i < _latencyClasses; ++i) {
+        if (TopicRouter::matches(_latencyFilters[i], topic)) return static_cast<uint8_t>(i);
+    }
+    return 0;
+}
+
+// Called with the outbox lock held
+void MqttClient::recordLatency(const OutboxEntry& entry, bool expired) {
+    if (entry.qos == 0) return;
+    MqttLatencyStats& stats = _latency[entry.topic_class][entry.qos - 1];
+    if (expired) {
+        ++stats.timeouts;
+        return;
+    }
+    const int64_t elapsed = (esp_timer_get_time() - entry.sent_us) / 1000;
+    const uint32_t ms = elapsed < 0 ? 0 : elapsed > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(elapsed);
+    size_t bucket = ms ? 32 - __builtin_clz(ms) : 0;
+    if (bucket >= MQTT_LATENCY_BUCKETS) bucket = MQTT_LATENCY_BUCKETS - 1;
+    ++stats.buckets[bucket];
+    if (!stats.count || ms < stats.min_ms) stats.min_ms = ms;
+    if (ms > stats.max_ms) stats.max_ms = ms;
+    stats.total_ms += ms;
+    ++stats.count;
+
+    // An ack slower than the retransmit timeout means esp-mqtt sent the message again.
+    // _config is rewritten under the config mutex, which this path does not hold.
+    const uint32_t retransmit_ms = _retransmitMs.load(std::memory_order_relaxed);
+    if (entry.resent || (retransmit_ms && ms >= retransmit_ms)) ++stats.retransmitted;
+}
+
+// Called with the outbox lock held, returns true when the state flipped
+bool MqttClient::updateThrottle() {
+    if (!_throttled && _outboxHigh && _outboxBytes >= _outboxHigh) {
+        _throttled = true;
+        return true;
+    }
+    if (_throttled && _outboxBytes <= _outboxLow) {
+        _throttled = false;
+        return true;
+    }
+    return false;
+}
+
+void MqttClient::notifyBackpressure(bool throttled) {
+    BLOG_W("MQTT", "Outbox %s, %u bytes held", throttled ? "above high watermark" : "drained", (unsigned)_outboxBytes);
+    if (_backpressureCallback) {
+        _backpressureCallback(throttled, _backpressureData);
+    }
 }
 
 // Internal MQTT event handler
@@ -174,37 +807,61 @@ void MqttClient::eventHandlerCb(
     esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(eventData);
     switch (eventId) {
         case MQTT_EVENT_BEFORE_CONNECT:
-            ESP_LOGI("MQTT", "Before Connect");
+            BLOG_I("MQTT", "Before Connect");
             self->_status = MqttStatus::CONNECTING;
             break;
         case MQTT_EVENT_CONNECTED:
-            ESP_LOGI("MQTT", "Connected");
+            BLOG_I("MQTT", "Connected");
             self->_status = MqttStatus::CONNECTED;
+            self->markOutboxResent();
+            self->_aliases.reconnected();
+            if (self->_router) self->_router->resubscribe();
+            if (self->_store) self->_store->notifyConnected();
             break;
         case MQTT_EVENT_DISCONNECTED:
-            ESP_LOGI("MQTT", "Disconnected");
+            BLOG_I("MQTT", "Disconnected");
             self->_status = MqttStatus::DISCONNECTED;
+            // The client is waiting to reconnect now, skip the wait for reconnect()
+            if (self->_reconnectPending.exchange(false)) {
+                esp_mqtt_client_reconnect(event->client);
+            }
             break;
         case MQTT_EVENT_SUBSCRIBED:
-            ESP_LOGI("MQTT", "Subscribed, msg_id=%d", event->msg_id);
+            BLOG_I("MQTT", "Subscribed, msg_id=%d", event->msg_id);
             break;
         case MQTT_EVENT_UNSUBSCRIBED:
-            ESP_LOGI("MQTT", "Unsubscribed, msg_id=%d", event->msg_id);
+            BLOG_I("MQTT", "Unsubscribed, msg_id=%d", event->msg_id);
             break;
         case MQTT_EVENT_PUBLISHED:
-            ESP_LOGI("MQTT", "Published, msg_id=%d", event->msg_id);
+            BLOG_I("MQTT", "Published, msg_id=%d", event->msg_id);
+            self->releaseOutbox(event->msg_id, false);
+            break;
+        case MQTT_EVENT_DELETED:
+            BLOG_W("MQTT", "Outbox message expired, msg_id=%d", event->msg_id);
+            self->releaseOutbox(event->msg_id, true);
             break;
         case MQTT_EVENT_DATA:
-            ESP_LOGI("MQTT", "Data received on topic %.*s: %.*s", 
-                     event->topic_len, event->topic, 
-                     event->data_len, event->data);
+            // Large messages arrive in several events, only the first has the topic
+            if (event->current_data_offset == 0) {
+                BLOG_I("MQTT", "Data received on topic %s, %d bytes",
+                       std::string_view(event->topic, event->topic_len), event->total_data_len);
+            }
+            if (self->_assembler) {
+                std::string_view topic;
+                std::span<const uint8_t> payload;
+                if (self->_assembler->feed(event, topic, payload) && self->_router) {
+                    self->_router->dispatch(topic, payload);
+                }
+            } else if (self->_router) {
+                self->_router->dispatch(event);
+            }
             break;
         case MQTT_EVENT_ERROR:
-            ESP_LOGE("MQTT", "Error");
+            BLOG_E("MQTT", "Error");
             self->_status = MqttStatus::ERROR;
             break;
         default:
-            ESP_LOGI("MQTT", "Other event id %d", event->event_id);
+            BLOG_I("MQTT", "Other event id %d", event->event_id);
             break;
     }
     if (self->_userCallback) {
@@ -219,6 +876,11 @@ int mqtt_init() {
     return ESP32_MQTT::MqttClient::getInstance().init() ? 1 : 0;
 }
 
+int mqtt_set_protocol(int version) {
+    ESP32_MQTT::MqttProtocol protocol = (version == 5) ? ESP32_MQTT::MqttProtocol::V5 : ESP32_MQTT::MqttProtocol::V3_1_1;
+    return ESP32_MQTT::MqttClient::getInstance().setProtocol(protocol) ? 1 : 0;
+}
+
 int mqtt_configure(const char* uri,
                    const char* client_id,
                    const char* username,
@@ -249,7 +911,7 @@ int mqtt_publish(const char* topic,
                  const char* payload,
                  int qos,
                  bool retain) {
-    return ESP32_MQTT::MqttClient::getInstance().publish(topic, payload, qos, retain);
+    return ESP32_MQTT::MqttClient::getInstance().publish(topic, payload, payload ? strlen(payload) : 0, qos, retain);
 }
 
 int mqtt_publish_binary(const char* topic,
@@ -257,7 +919,7 @@ int mqtt_publish_binary(const char* topic,
                          size_t len,
                          int qos,
                          bool retain) {
-    return ESP32_MQTT::MqttClient::getInstance().publish(topic, data, len, qos, retain);
+    return ESP32_MQTT::MqttClient::getInstance().publish(topic, reinterpret_cast<const char*>(data), len, qos, retain);
 }
 
 int mqtt_subscribe(const char* topic, int qos) {
@@ -272,12 +934,29 @@ int mqtt_get_status() {
     return static_cast<int>(ESP32_MQTT::MqttClient::getInstance().getStatus());
 }
 
+int mqtt_set_outbox_budget(size_t budget, size_t high_water, size_t low_water) {
+    return ESP32_MQTT::MqttClient::getInstance().setOutboxBudget(budget, high_water, low_water) ? 1 : 0;
+}
+
+int mqtt_is_throttled() {
+    return ESP32_MQTT::MqttClient::getInstance().isThrottled() ? 1 : 0;
+}
+
+// The returned strings are copies that stay valid until the next call
 const char* mqtt_get_broker_uri() {
-    return ESP32_MQTT::MqttClient::getInstance().getBrokerUri().c_str();
+    static std::string uri;
+    uri = ESP32_MQTT::MqttClient::getInstance().getBrokerUri();
+    return uri.c_str();
 }
 
 const char* mqtt_get_client_id() {
-    return ESP32_MQTT::MqttClient::getInstance().getClientId().c_str();
+    static std::string id;
+    id = ESP32_MQTT::MqttClient::getInstance().getClientId();
+    return id.c_str();
+}
+
+int mqtt_reconnect() {
+    return ESP32_MQTT::MqttClient::getInstance().reconnect() ? 1 : 0;
 }
 
 } // extern "C"
@@ -0,0 +1,188 @@
+// @file TopicAliasTable.cpp
+// @brief Implementation of the MQTT 5 topic alias table
+
+#include "../inc/mqtt_alias.hpp"
+#include <cstring>
+#include <new>
+
+namespace ESP32_MQTT {
+
+TopicAliasTable::TopicAliasTable()
+    : _aliases(nullptr),
+    _topics(nullptr),
+    _candidates(),
+    _max(0),
+    _limit(0),
+    _promoteAfter(1),
+    _lookups(0),
+    _connection(1),
+    _aliased(0),
+    _bytesSaved(0)
+{
+}
+
+TopicAliasTable::TopicAliasTable(uint16_t max_aliases, uint16_t promote_after)
+    : TopicAliasTable()
+{
+    resize(max_aliases, promote_after);
+}
+
+TopicAliasTable::~TopicAliasTable() {
+    delete[] _topics;
+    delete[] _aliases;
+}
+
+bool TopicAliasTable::resize(uint16_t max_aliases, uint16_t promote_after) {
+    if (max_aliases != _max || !valid()) {
+        delete[] _topics;
+        delete[] _aliases;
+        _aliases = nullptr;
+        _topics = nullptr;
+        _max = 0;
+        if (max_aliases) {
+            _aliases = new (std::nothrow) Alias[max_aliases];
+            _topics = new (std::nothrow) char[max_aliases * MQTT_TOPIC_ALIAS_LEN];
+            if (!valid()) {
+                delete[] _topics;
+                delete[] _aliases;
+                _aliases = nullptr;
+                _topics = nullptr;
+            } else {
+                _max = max_aliases;
+            }
+        }
+    }
+    _limit = _max;
+    _promoteAfter = promote_after ? promote_after : 1;
+    _lookups = 0;
+    _aliased = 0;
+    _bytesSaved = 0;
+    for (Candidate& c : _candidates) {
+        c = Candidate();
+    }
+    for (uint16_t i = 0; i < _max; ++i) {
+        _aliases[i].hash = 0;
+        _aliases[i].len = 0;
+        _aliases[i].uses = 0;
+        _aliases[i].connection = 0;
+        _aliases[i].topic = _topics + i * MQTT_TOPIC_ALIAS_LEN;
+    }
+    return valid();
+}
+
+bool TopicAliasTable::valid() const {
+    return _aliases && _topics;
+}
+
+uint16_t TopicAliasTable::lookup(std::string_view topic, bool& established) {
+    established = false;
+    if (!valid() || _limit == 0 || topic.empty() || topic.size() >= MQTT_TOPIC_ALIAS_LEN) return 0;
+    if (++_lookups % 256 == 0) decay();
+
+    const uint32_t h = hash(topic);
+    for (uint16_t i = 0; i < _limit; ++i) {
+        Alias& alias = _aliases[i];
+        if (alias.len == topic.size() && alias.hash == h && memcmp(alias.topic, topic.data(), topic.size()) == 0) {
+            if (alias.uses < UINT16_MAX) ++alias.uses;
+            established = alias.connection == _connection.load(std::memory_order_relaxed);
+            return i + 1;
+        }
+    }
+
+    // Not aliased yet, count it and promote it once it is hot
+    Candidate* coldest = &_candidates[0];
+    for (Candidate& c : _candidates) {
+        if (c.count && c.hash == h) {
+            if (c.count < UINT16_MAX) ++c.count;
+            if (c.count < _promoteAfter) return 0;
+            uint16_t count = c.count;
+            uint16_t alias = promote(topic, h, count);
+            if (alias) c = Candidate();
+            return alias;
+        }
+        if (c.count < coldest->count) coldest = &c;
+    }
+    coldest->hash = h;
+    coldest->count = 1;
+    return _promoteAfter <= 1 ? promote(topic, h, 1) : 0;
+}
+
+void TopicAliasTable::sent(uint16_t alias, size_t topic_len, bool elided) {
+    if (!valid() || alias == 0 || alias > _max) return;
+    if (elided) {
+        ++_aliased;
+        _bytesSaved += topic_len;
+    } else {
+        _aliases[alias - 1].connection = _connection.load(std::memory_order_relaxed);
+    }
+}
+
+void TopicAliasTable::reconnected() {
+    // Lock free, the MQTT task calls this while publishers may hold the client lock,
+    // and it touches nothing resize() frees
+    uint32_t next = _connection.load() + 1;
+    _connection.store(next ? next : 1);
+}
+
+void TopicAliasTable::limit(uint16_t max) {
+    if (max >= _limit) return;
+    _limit = max;
+    for (uint16_t i = max; i < _max; ++i) {
+        _aliases[i].len = 0;
+    }
+}
+
+MqttAliasStats TopicAliasTable::getStats() const {
+    MqttAliasStats stats = {};
+    if (!valid()) return stats;
+    for (uint16_t i = 0; i < _limit; ++i) {
+        if (_aliases[i].len) ++stats.assigned;
+    }
+    stats.limit = _limit;
+    stats.aliased = _aliased;
+    stats.bytes_saved = _bytesSaved;
+    return stats;
+}
+
+// FNV-1a
+uint32_t TopicAliasTable::hash(std::string_view topic) {
+    uint32_t h = 2166136261u;
+    for (char c : topic) {
+        h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return h;
+}
+
+uint16_t TopicAliasTable::promote(std::string_view topic, uint32_t h, uint16_t count) {
+    // A free alias, otherwise the least used one if this topic is hotter
+    Alias* victim = nullptr;
+    for (uint16_t i = 0; i < _limit; ++i) {
+        Alias& alias = _aliases[i];
+        if (alias.len == 0) {
+            victim = &alias;
+            break;
+        }
+        if (!victim || alias.uses < victim->uses) victim = &alias;
+    }
+    if (!victim || (victim->len && victim->uses >= count)) return 0;
+
+    memcpy(victim->topic, topic.data(), topic.size());
+    victim->hash = h;
+    victim->len = static_cast<uint16_t>(topic.size());
+    victim->uses = count;
+    // Remapped aliases must be sent with the new topic first
+    victim->connection = 0;
+    return static_cast<uint16_t>(victim - _aliases) + 1;
+}
+
+void TopicAliasTable::decay() {
+    for (uint16_t i = 0; i < _max; ++i) {
+        _aliases[i].uses >>= 1;
+    }
+    for (Candidate& c : _candidates) {
+        c.count >>= 1;
+    }
+}
+
+} // namespace ESP32_MQTT
+// End of TopicAliasTable.cpp
@@ -0,0 +1,237 @@
+// @file MessageAssembler.cpp
+// @brief Implementation of the fragmented MQTT message assembler
+
+#include "../inc/mqtt_assembler.hpp"
+#include <cstring>
+#include <new>
+#include "../inc/mqtt_router.hpp"
+
+namespace ESP32_MQTT {
+
+MessageAssembler::MessageAssembler()
+    : _config(),
+    _buffers(nullptr),
+    _pool(nullptr),
+    _mutex(xSemaphoreCreateMutex()),
+    _current(nullptr),
+    _total(0),
+    _filled(0),
+    _skipping(false),
+    _delivered(nullptr),
+    _inPlace(),
+    _whole(0),
+    _reassembled(0),
+    _oversize(0),
+    _noBuffer(0),
+    _incomplete(0)
+{
+}
+
+MessageAssembler::~MessageAssembler() {
+    MqttClient& client = MqttClient::getInstance();
+    if (client.getAssembler() == this) {
+        client.setAssembler(nullptr);
+    }
+    stop();
+    if (_mutex) vSemaphoreDelete(_mutex);
+}
+
+bool MessageAssembler::start(const AssemblerConfig& config) {
+    stop();
+    if (!_mutex || config.buffers == 0 || config.buffer_size < 2) {
+        ESP_LOGE("MQTT", "Invalid assembler configuration");
+        return false;
+    }
+    _config = config;
+
+    // One block for every buffer, nothing is allocated per message
+    _buffers = new (std::nothrow) Buffer[config.buffers];
+    _pool = new (std::nothrow) uint8_t[config.buffers * config.buffer_size];
+    if (!_buffers || !_pool) {
+        ESP_LOGE("MQTT", "Failed to allocate %u reassembly buffers", (unsigned)config.buffers);
+        stop();
+        return false;
+    }
+    for (size_t i = 0; i < config.buffers; ++i) {
+        _buffers[i].message = PooledMessage();
+        _buffers[i].data = _pool + i * config.buffer_size;
+        _buffers[i].busy = false;
+    }
+    _whole = 0;
+    _reassembled = 0;
+    _oversize = 0;
+    _noBuffer = 0;
+    _incomplete = 0;
+    return true;
+}
+
+void MessageAssembler::stop() {
+    delete[] _pool;
+    delete[] _buffers;
+    _pool = nullptr;
+    _buffers = nullptr;
+    _current = nullptr;
+    _delivered = nullptr;
+    _inPlace = PooledMessage();
+    _skipping = false;
+}
+
+bool MessageAssembler::setLimit(std::string_view filter, size_t max_len) {
+    if (!_mutex || !TopicRouter::isValidFilter(filter)) return false;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _limits.emplace_back(std::string(filter), max_len);
+    xSemaphoreGive(_mutex);
+    return true;
+}
+
+bool MessageAssembler::feed(esp_mqtt_event_handle_t event, std::string_view& topic, std::span<const uint8_t>& payload) {
+    if (!_buffers || !event || event->data_len < 0 || event->total_data_len < 0) return false;
+    const size_t offset = event->current_data_offset;
+    const size_t len = event->data_len;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(event->data);
+
+    if (offset == 0) {
+        // A new message ends whatever the previous one left behind
+        if (_current) {
+            ++_incomplete;
+            giveBack(_current);
+            _current = nullptr;
+        }
+        if (_delivered) {
+            giveBack(_delivered);
+            _delivered = nullptr;
+        }
+        _inPlace = PooledMessage();
+        _skipping = false;
+        if (!event->topic || event->topic_len <= 0) return false;
+
+        const std::string_view name(event->topic, event->topic_len);
+        const size_t total = event->total_data_len;
+        if (total > limitFor(name) || name.size() + total > _config.buffer_size) {
+            ESP_LOGW("MQTT", "Skipping %u byte message on %.*s", (unsigned)total, (int)name.size(), name.data());
+            ++_oversize;
+            _skipping = true;
+            return false;
+        }
+        if (len == total) {
+            // Whole message in one event, delivered without a copy
+            _inPlace.topic = name;
+            _inPlace.payload = std::span<const uint8_t>(data, len);
+            topic = _inPlace.topic;
+            payload = _inPlace.payload;
+            ++_whole;
+            return true;
+        }
+        _current = acquire();
+        if (!_current) {
+            ++_noBuffer;
+            _skipping = true;
+            return false;
+        }
+        // The topic is only sent with the first fragment, it goes in front of the payload
+        memcpy(_current->data, name.data(), name.size());
+        _current->message.topic = std::string_view(reinterpret_cast<const char*>(_current->data), name.size());
+        _total = total;
+        _filled = 0;
+    } else if (_skipping || !_current) {
+        return false;
+    }
+
+    if (offset != _filled || len > _total - _filled) {
+        // Fragments out of order, the rest of this message is dropped
+        ++_incomplete;
+        giveBack(_current);
+        _current = nullptr;
+        _skipping = true;
+        return false;
+    }
+    uint8_t* body = _current->data + _current->message.topic.size();
+    if (len) memcpy(body + _filled, data, len);
+    _filled += len;
+    if (_filled < _total) return false;
+
+    _current->message.payload = std::span<const uint8_t>(body, _total);
+    _delivered = _current;
+    _current = nullptr;
+    ++_reassembled;
+    topic = _delivered->message.topic;
+    payload = _delivered->message.payload;
+    return true;
+}
+
+const PooledMessage* MessageAssembler::keep() {
+    if (_delivered) {
+        Buffer* kept = _delivered;
+        _delivered = nullptr;
+        return &kept->message;
+    }
+    if (_inPlace.topic.empty()) return nullptr;
+
+    // Copied out of the event, which is gone once the handler returns
+    Buffer* buffer = acquire();
+    if (!buffer) return nullptr;
+    const size_t topic_len = _inPlace.topic.size();
+    memcpy(buffer->data, _inPlace.topic.data(), topic_len);
+    if (!_inPlace.payload.empty()) memcpy(buffer->data + topic_len, _inPlace.payload.data(), _inPlace.payload.size());
+    buffer->message.topic = std::string_view(reinterpret_cast<const char*>(buffer->data), topic_len);
+    buffer->message.payload = std::span<const uint8_t>(buffer->data + topic_len, _inPlace.payload.size());
+    _inPlace = PooledMessage();
+    return &buffer->message;
+}
+
+void MessageAssembler::release(const PooledMessage* message) {
+    if (!message || !_buffers) return;
+    for (size_t i = 0; i < _config.buffers; ++i) {
+        if (&_buffers[i].message == message) {
+            giveBack(&_buffers[i]);
+            return;
+        }
+    }
+}
+
+AssemblerStats MessageAssembler::getStats() const {
+    AssemblerStats stats;
+    stats.whole = _whole;
+    stats.reassembled = _reassembled;
+    stats.oversize = _oversize;
+    stats.no_buffer = _noBuffer;
+    stats.incomplete = _incomplete;
+    return stats;
+}
+
+MessageAssembler::Buffer* MessageAssembler::acquire() {
+    Buffer* found = nullptr;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (size_t i = 0; i < _config.buffers; ++i) {
+        if (!_buffers[i].busy) {
+            found = &_buffers[i];
+            found->busy = true;
+            break;
+        }
+    }
+    xSemaphoreGive(_mutex);
+    return found;
+}
+
+void MessageAssembler::giveBack(Buffer* buffer) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    buffer->message = PooledMessage();
+    buffer->busy = false;
+    xSemaphoreGive(_mutex);
+}
+
+size_t MessageAssembler::limitFor(std::string_view topic) {
+    size_t limit = _config.buffer_size;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (const auto& l : _limits) {
+        if (TopicRouter::matches(l.first, topic)) {
+            limit = l.second;
+            break;
+        }
+    }
+    xSemaphoreGive(_mutex);
+    return limit;
+}
+
+} // namespace ESP32_MQTT
+// End of MessageAssembler.cpp
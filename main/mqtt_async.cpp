@@ -0,0 +1,302 @@
+// @file AsyncPublisher.cpp
+// @brief Implementation of the asynchronous MQTT publish queue
+
+#include "../inc/mqtt_async.hpp"
+#include <cstring>
+#include <new>
+#include "esp_timer.h"
+
+namespace ESP32_MQTT {
+
+AsyncPublisher::AsyncPublisher()
+    : _config(),
+    _slots(nullptr),
+    _pool(nullptr),
+    _batch(nullptr),
+    _free(nullptr),
+    _ready(nullptr),
+    _task(nullptr),
+    _running(false),
+    _alive(false),
+    _producers(0),
+    _flushing(0),
+    _pending(0),
+    _peakDepth(0),
+    _enqueued(0),
+    _sent(0),
+    _failed(0),
+    _droppedFull(0),
+    _droppedExpired(0),
+    _oversize(0),
+    _batches(0),
+    _latencyMaxUs(0),
+    _latencyAvgUs(0)
+{
+}
+
+AsyncPublisher::~AsyncPublisher() {
+    stop();
+}
+
+bool AsyncPublisher::start(const AsyncPublisherConfig& config) {
+    stop();
+    if (config.slots == 0 || config.slots >= WAKE || config.batch_max == 0
+        || config.max_topic < 2 || config.max_payload > UINT16_MAX) {
+        ESP_LOGE("MQTT", "Invalid async publisher configuration");
+        return false;
+    }
+    _config = config;
+
+    // One block for all topics and payloads, nothing is allocated per message
+    const size_t stride = config.max_topic + config.max_payload;
+    _slots = new (std::nothrow) Slot[config.slots];
+    _pool = new (std::nothrow) uint8_t[config.slots * stride];
+    _batch = new (std::nothrow) uint16_t[config.batch_max];
+    _free = xQueueCreate(config.slots, sizeof(uint16_t));
+    // Room for a few wake tokens on top of every slot
+    _ready = xQueueCreate(config.slots + 4, sizeof(uint16_t));
+    if (!_slots || !_pool || !_batch || !_free || !_ready) {
+        ESP_LOGE("MQTT", "Failed to allocate %u publish slots", (unsigned)config.slots);
+        stop();
+        return false;
+    }
+    for (size_t i = 0; i < config.slots; ++i) {
+        _slots[i].topic = reinterpret_cast<char*>(_pool + i * stride);
+        _slots[i].payload = _pool + i * stride + config.max_topic;
+        uint16_t index = static_cast<uint16_t>(i);
+        xQueueSend(_free, &index, 0);
+    }
+
+    resetStats();
+    _pending.store(0);
+    _running.store(true);
+    _alive.store(true);
+    if (xTaskCreatePinnedToCore(&AsyncPublisher::senderTask, "mqtt_sender", config.task_stack, this,
+                                config.task_priority, &_task, config.task_core) != pdPASS) {
+        ESP_LOGE("MQTT", "Failed to create the sender task");
+        _task = nullptr;
+        _running.store(false);
+        _alive.store(false);
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void AsyncPublisher::stop() {
+    if (_task) {
+        _running.store(false);
+        uint16_t token = WAKE;
+        xQueueSend(_ready, &token, portMAX_DELAY);
+        // The sender may be inside a publish, let it leave on its own
+        while (_alive.load()) {
+            vTaskDelay(1);
+        }
+        _task = nullptr;
+    }
+    // Producers that entered before _running dropped may still hold or wait
+    // for a slot. Recycle what they queue so a blocked one can finish.
+    while (_producers.load() != 0) {
+        uint16_t index;
+        while (_ready && xQueueReceive(_ready, &index, 0) == pdTRUE) {
+            if (index != WAKE) xQueueSend(_free, &index, 0);
+        }
+        vTaskDelay(1);
+    }
+    if (_ready) {
+        vQueueDelete(_ready);
+        _ready = nullptr;
+    }
+    if (_free) {
+        vQueueDelete(_free);
+        _free = nullptr;
+    }
+    delete[] _batch;
+    delete[] _pool;
+    delete[] _slots;
+    _batch = nullptr;
+    _pool = nullptr;
+    _slots = nullptr;
+    _pending.store(0);
+}
+
+bool AsyncPublisher::publish(
+    const char* topic,
+    const void* data,
+    size_t len,
+    int qos,
+    bool retain,
+    uint32_t deadline_ms,
+    TickType_t wait
+) {
+    ProducerRef producer(*this);
+    if (!producer.active || !topic || (len && !data)) return false;
+    size_t topic_len = strlen(topic);
+    if (topic_len >= _config.max_topic || len > _config.max_payload) {
+        _oversize.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint16_t index;
+    if (xQueueReceive(_free, &index, wait) != pdTRUE) {
+        _droppedFull.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    Slot& slot = _slots[index];
+    memcpy(slot.topic, topic, topic_len + 1);
+    if (len) memcpy(slot.payload, data, len);
+    slot.len = static_cast<uint16_t>(len);
+    slot.qos = static_cast<int8_t>(qos);
+    slot.retain = retain;
+    slot.enqueued_us = esp_timer_get_time();
+    slot.deadline_us = deadline_ms ? slot.enqueued_us + deadline_ms * 1000LL : 0;
+
+    uint32_t depth = _pending.fetch_add(1) + 1;
+    uint32_t peak = _peakDepth.load(std::memory_order_relaxed);
+    while (depth > peak && !_peakDepth.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {
+    }
+    if (xQueueSend(_ready, &index, 0) != pdTRUE) {
+        // Only possible while wake tokens fill the headroom
+        _pending.fetch_sub(1);
+        xQueueSend(_free, &index, 0);
+        _droppedFull.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    _enqueued.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool AsyncPublisher::flush(TickType_t timeout) {
+    if (!_task) return _pending.load() == 0;
+    _flushing.fetch_add(1);
+    if (uxQueueMessagesWaiting(_ready) == 0) {
+        // Cut a linger wait short
+        uint16_t token = WAKE;
+        xQueueSend(_ready, &token, 0);
+    }
+    TickType_t start = xTaskGetTickCount();
+    bool drained = true;
+    while (_pending.load() != 0) {
+        if (xTaskGetTickCount() - start >= timeout) {
+            drained = false;
+            break;
+        }
+        vTaskDelay(1);
+    }
+    _flushing.fetch_sub(1);
+    return drained;
+}
+
+size_t AsyncPublisher::depth() const {
+    return _pending.load(std::memory_order_relaxed);
+}
+
+AsyncPublisherStats AsyncPublisher::getStats() const {
+    AsyncPublisherStats stats;
+    stats.depth = _pending.load(std::memory_order_relaxed);
+    stats.peak_depth = _peakDepth.load(std::memory_order_relaxed);
+    stats.enqueued = _enqueued.load(std::memory_order_relaxed);
+    stats.sent = _sent.load(std::memory_order_relaxed);
+    stats.failed = _failed.load(std::memory_order_relaxed);
+    stats.dropped_full = _droppedFull.load(std::memory_order_relaxed);
+    stats.dropped_expired = _droppedExpired.load(std::memory_order_relaxed);
+    stats.oversize = _oversize.load(std::memory_order_relaxed);
+    stats.batches = _batches.load(std::memory_order_relaxed);
+    stats.latency_avg_us = _latencyAvgUs.load(std::memory_order_relaxed);
+    stats.latency_max_us = _latencyMaxUs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void AsyncPublisher::resetStats() {
+    _peakDepth.store(0);
+    _enqueued.store(0);
+    _sent.store(0);
+    _failed.store(0);
+    _droppedFull.store(0);
+    _droppedExpired.store(0);
+    _oversize.store(0);
+    _batches.store(0);
+    _latencyMaxUs.store(0);
+    _latencyAvgUs.store(0);
+}
+
+// The count is raised before _running is read, so stop() either sees this
+// call or this call sees the publisher stopped
+AsyncPublisher::ProducerRef::ProducerRef(AsyncPublisher& owner)
+    : active(false),
+    _owner(owner)
+{
+    _owner._producers.fetch_add(1);
+    active = _owner._running.load();
+}
+
+AsyncPublisher::ProducerRef::~ProducerRef() {
+    _owner._producers.fetch_sub(1);
+}
+
+void AsyncPublisher::senderTask(void* arg) {
+    AsyncPublisher* self = static_cast<AsyncPublisher*>(arg);
+    self->run();
+    self->_alive.store(false);
+    vTaskDelete(nullptr);
+}
+
+void AsyncPublisher::run() {
+    const TickType_t linger = pdMS_TO_TICKS(_config.linger_ms);
+    while (_running.load()) {
+        uint16_t index;
+        if (xQueueReceive(_ready, &index, portMAX_DELAY) != pdTRUE) continue;
+        size_t count = 0;
+        if (index != WAKE) _batch[count++] = index;
+
+        // Collect until the batch is full or the linger time is up
+        TickType_t start = xTaskGetTickCount();
+        while (count < _config.batch_max && _running.load()) {
+            TickType_t waited = xTaskGetTickCount() - start;
+            TickType_t wait = (_flushing.load() || waited >= linger) ? 0 : linger - waited;
+            if (xQueueReceive(_ready, &index, wait) != pdTRUE) break;
+            if (index != WAKE) _batch[count++] = index;
+        }
+        if (!_running.load()) break;
+
+        for (size_t i = 0; i < count; ++i) {
+            send(_batch[i]);
+        }
+        if (count) _batches.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void AsyncPublisher::send(uint16_t index) {
+    const Slot& slot = _slots[index];
+    int64_t now = esp_timer_get_time();
+    if (slot.deadline_us && now > slot.deadline_us) {
+        _droppedExpired.fetch_add(1, std::memory_order_relaxed);
+        release(index);
+        return;
+    }
+
+    int msg_id = MqttClient::getInstance().publish(slot.topic, reinterpret_cast<const char*>(slot.payload), slot.len,
+                                                      slot.qos, slot.retain);
+    if (msg_id < 0) {
+        _failed.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        _sent.fetch_add(1, std::memory_order_relaxed);
+        uint32_t latency = static_cast<uint32_t>(esp_timer_get_time() - slot.enqueued_us);
+        if (latency > _latencyMaxUs.load(std::memory_order_relaxed)) {
+            _latencyMaxUs.store(latency, std::memory_order_relaxed);
+        }
+        // Exponential average over roughly the last 16 messages
+        int32_t avg = static_cast<int32_t>(_latencyAvgUs.load(std::memory_order_relaxed));
+        avg += (static_cast<int32_t>(latency) - avg) / 16;
+        _latencyAvgUs.store(static_cast<uint32_t>(avg), std::memory_order_relaxed);
+    }
+    release(index);
+}
+
+void AsyncPublisher::release(uint16_t index) {
+    xQueueSend(_free, &index, 0);
+    _pending.fetch_sub(1);
+}
+
+} // namespace ESP32_MQTT
+// End of AsyncPublisher.cpp
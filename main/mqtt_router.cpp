@@ -0,0 +1,238 @@
+// @file TopicRouter.cpp
+// @brief Implementation of the topic trie subscription router
+
+#include "../inc/mqtt_router.hpp"
+#include <algorithm>
+
+namespace ESP32_MQTT {
+
+TopicRouter::TopicRouter()
+    : _nextId(1),
+    _unmatched(0),
+    _mutex(xSemaphoreCreateMutex())
+{
+}
+
+TopicRouter::~TopicRouter() {
+    MqttClient& client = MqttClient::getInstance();
+    if (client.getRouter() == this) {
+        client.setRouter(nullptr);
+    }
+    for (Node* node : _root.children) destroy(node);
+    destroy(_root.plus);
+    destroy(_root.hash);
+    if (_mutex) vSemaphoreDelete(_mutex);
+}
+
+bool TopicRouter::isValidFilter(std::string_view filter) {
+    if (filter.empty()) return false;
+    size_t pos = 0;
+    while (true) {
+        size_t end = filter.find('/', pos);
+        std::string_view level = filter.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos);
+        if (level.find_first_of("+#") != std::string_view::npos && level.size() != 1) return false;
+        if (level == "#" && end != std::string_view::npos) return false;
+        if (end == std::string_view::npos) return true;
+        pos = end + 1;
+    }
+}
+
+bool TopicRouter::matches(std::string_view filter, std::string_view topic) {
+    if (topic.empty()) return false;
+    // Topics starting with '$' are not matched by a leading wildcard
+    if (topic[0] == '$' && !filter.empty() && (filter[0] == '+' || filter[0] == '#')) return false;
+    size_t f = 0;
+    size_t t = 0;
+    while (true) {
+        size_t fend = filter.find('/', f);
+        std::string_view level = filter.substr(f, fend == std::string_view::npos ? std::string_view::npos : fend - f);
+        if (level == "#") return true;
+        // Topic used up before the filter, "#" was handled above
+        if (t > topic.size()) return false;
+        size_t tend = topic.find('/', t);
+        if (tend == std::string_view::npos) tend = topic.size();
+        if (level != "+" && level != topic.substr(t, tend - t)) return false;
+        t = tend + 1;
+        if (fend == std::string_view::npos) return t > topic.size();
+        f = fend + 1;
+    }
+}
+
+int TopicRouter::add(std::string_view filter, MqttMessageHandler handler, int qos) {
+    if (!_mutex || !handler || !isValidFilter(filter) || qos < 0 || qos > 2) {
+        ESP_LOGE("MQTT", "Invalid subscription filter %.*s", (int)filter.size(), filter.data());
+        return -1;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    Node* node = &_root;
+    size_t pos = 0;
+    while (true) {
+        size_t end = filter.find('/', pos);
+        std::string_view level = filter.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos);
+        node = child(node, level, true);
+        if (end == std::string_view::npos) break;
+        pos = end + 1;
+    }
+
+    int id = _nextId++;
+    Entry entry;
+    entry.id = id;
+    entry.qos = qos;
+    entry.fn = std::move(handler);
+    node->entries.push_back(std::move(entry));
+    if (node->filter.empty()) node->filter.assign(filter);
+    _byId[id] = node;
+
+    // A stronger QoS than the broker currently grants needs a new SUBSCRIBE
+    bool subscribe = qos > node->qos;
+    if (subscribe) node->qos = qos;
+    std::string topic = subscribe ? node->filter : std::string();
+    xSemaphoreGive(_mutex);
+
+    // Outside the lock, the MQTT task holds the client lock while it dispatches
+    if (subscribe) MqttClient::getInstance().subscribe(topic, qos);
+    return id;
+}
+
+bool TopicRouter::remove(int id) {
+    if (!_mutex) return false;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    auto it = _byId.find(id);
+    if (it == _byId.end()) {
+        xSemaphoreGive(_mutex);
+        return false;
+    }
+    Node* node = it->second;
+    _byId.erase(it);
+    node->entries.erase(std::remove_if(node->entries.begin(), node->entries.end(),
+                                       [id](const Entry& e) { return e.id == id; }),
+                        node->entries.end());
+    std::string topic;
+    if (node->entries.empty()) {
+        topic.swap(node->filter);
+        node->qos = -1;
+        prune(node);
+    }
+    xSemaphoreGive(_mutex);
+
+    if (!topic.empty()) MqttClient::getInstance().unsubscribe(topic);
+    return true;
+}
+
+size_t TopicRouter::dispatch(esp_mqtt_event_handle_t event) {
+    if (!event || !event->topic || event->topic_len <= 0) return 0;
+    // Only whole messages are routed, a fragmented one has no topic after its first chunk
+    if (event->current_data_offset != 0 || event->data_len != event->total_data_len) return 0;
+    return dispatch(std::string_view(event->topic, event->topic_len),
+                    std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(event->data), event->data_len));
+}
+
+size_t TopicRouter::dispatch(std::string_view topic, std::span<const uint8_t> payload) {
+    if (!_mutex || topic.empty() || topic.find_first_of("+#") != std::string_view::npos) return 0;
+    size_t called = 0;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    collect(&_root, topic, 0, true, payload, called);
+    if (!called) ++_unmatched;
+    xSemaphoreGive(_mutex);
+    return called;
+}
+
+void TopicRouter::resubscribe() {
+    if (!_mutex) return;
+    // Filters are copied out first, subscribing under the lock could deadlock
+    std::vector<std::pair<std::string, int>> subscribed;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    filters(&_root, subscribed);
+    xSemaphoreGive(_mutex);
+    for (const auto& f : subscribed) {
+        MqttClient::getInstance().subscribe(f.first, f.second);
+    }
+}
+
+uint32_t TopicRouter::getUnmatched() const {
+    return _unmatched;
+}
+
+TopicRouter::Node* TopicRouter::child(Node* node, std::string_view level, bool create) {
+    if (level == "+" || level == "#") {
+        Node*& slot = (level == "+") ? node->plus : node->hash;
+        if (!slot && create) {
+            slot = new Node();
+            slot->level.assign(level);
+            slot->parent = node;
+        }
+        return slot;
+    }
+    auto it = std::lower_bound(node->children.begin(), node->children.end(), level,
+                               [](const Node* n, std::string_view l) { return std::string_view(n->level) < l; });
+    if (it != node->children.end() && (*it)->level == level) return *it;
+    if (!create) return nullptr;
+    Node* created = new Node();
+    created->level.assign(level);
+    created->parent = node;
+    node->children.insert(it, created);
+    return created;
+}
+
+void TopicRouter::prune(Node* node) {
+    while (node != &_root && node->entries.empty() && node->children.empty() && !node->plus && !node->hash) {
+        Node* parent = node->parent;
+        if (parent->plus == node) {
+            parent->plus = nullptr;
+        } else if (parent->hash == node) {
+            parent->hash = nullptr;
+        } else {
+            parent->children.erase(std::find(parent->children.begin(), parent->children.end(), node));
+        }
+        delete node;
+        node = parent;
+    }
+}
+
+void TopicRouter::filters(const Node* node, std::vector<std::pair<std::string, int>>& out) {
+    if (!node->entries.empty()) out.emplace_back(node->filter, node->qos);
+    for (const Node* c : node->children) filters(c, out);
+    if (node->plus) filters(node->plus, out);
+    if (node->hash) filters(node->hash, out);
+}
+
+void TopicRouter::destroy(Node* node) {
+    if (!node) return;
+    for (Node* c : node->children) destroy(c);
+    destroy(node->plus);
+    destroy(node->hash);
+    delete node;
+}
+
+// Walks one topic level per call. Literal, '+' and '#' children are tried
+// in turn, so the work is bounded by the topic depth.
+void TopicRouter::collect(Node* node, std::string_view topic, size_t pos, bool first,
+                          std::span<const uint8_t> payload, size_t& called) {
+    // Topics starting with '$' are not matched by a leading wildcard
+    const bool wildcards = !(first && topic[0] == '$');
+    if (pos > topic.size()) {
+        call(node, topic, payload, called);
+        // "a/#" also matches "a"
+        if (node->hash) call(node->hash, topic, payload, called);
+        return;
+    }
+    size_t end = topic.find('/', pos);
+    if (end == std::string_view::npos) end = topic.size();
+    std::string_view level = topic.substr(pos, end - pos);
+
+    if (wildcards && node->hash) call(node->hash, topic, payload, called);
+    if (wildcards && node->plus) collect(node->plus, topic, end + 1, false, payload, called);
+    Node* literal = child(node, level, false);
+    if (literal) collect(literal, topic, end + 1, false, payload, called);
+}
+
+void TopicRouter::call(Node* node, std::string_view topic, std::span<const uint8_t> payload, size_t& called) {
+    for (const Entry& entry : node->entries) {
+        entry.fn(topic, payload);
+        ++called;
+    }
+}
+
+} // namespace ESP32_MQTT
+// End of TopicRouter.cpp
@@ -0,0 +1,479 @@
+// @file OfflineStore.cpp
+// @brief Implementation of the flash ring log for offline MQTT publishes
+
+#include "../inc/mqtt_store.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include "esp_rom_crc.h"
+
+namespace ESP32_MQTT {
+
+static constexpr uint32_t SECTOR_MAGIC  = 0x474C514D;   // "MQLG"
+static constexpr uint16_t RECORD_MAGIC  = 0x5A52;
+static constexpr uint8_t  STATE_PENDING = 0xFF;
+static constexpr uint8_t  STATE_SENT    = 0x00;
+static constexpr uint8_t  INFLIGHT_NONE      = 0;
+static constexpr uint8_t  INFLIGHT_WAITING   = 1;
+static constexpr uint8_t  INFLIGHT_DELIVERED = 2;
+static constexpr uint8_t  INFLIGHT_LOST      = 3;
+static constexpr esp_partition_subtype_t STORE_SUBTYPE = static_cast<esp_partition_subtype_t>(0x40);
+
+static_assert(MQTT_STORE_MAX_RECORD <= UINT16_MAX, "Record length must fit the 16-bit header field");
+
+OfflineStore::OfflineStore()
+    : _config(),
+    _partition(nullptr),
+    _sectorSize(0),
+    _sectors(0),
+    _headSector(0),
+    _headOffset(0),
+    _headSeq(0),
+    _tailSector(0),
+    _tailOffset(0),
+    _epoch(0),
+    _buffer(nullptr),
+    _mutex(nullptr),
+    _task(nullptr),
+    _running(false),
+    _alive(false),
+    _inflight(INFLIGHT_NONE),
+    _pending(0),
+    _stored(0),
+    _replayed(0),
+    _overwritten(0),
+    _corrupt(0),
+    _rejected(0)
+{
+    static_assert(sizeof(RecordHeader) == 12, "Record header layout is stored in flash");
+}
+
+OfflineStore::~OfflineStore() {
+    MqttClient& client = MqttClient::getInstance();
+    if (client.getOfflineStore() == this) {
+        client.setOfflineStore(nullptr);
+    }
+    stop();
+    delete[] _buffer;
+    if (_mutex) vSemaphoreDelete(_mutex);
+}
+
+bool OfflineStore::start(const OfflineStoreConfig& config) {
+    stop();
+    if (!config.partition_label || config.replay_bytes_per_s == 0 || config.replay_msgs_per_s == 0) {
+        ESP_LOGE("MQTT", "Invalid offline store configuration");
+        return false;
+    }
+    _config = config;
+
+    const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, STORE_SUBTYPE,
+                                                                config.partition_label);
+    if (!partition) {
+        ESP_LOGE("MQTT", "Offline store partition %s not found", config.partition_label);
+        return false;
+    }
+    // Records are marked replayed by rewriting one byte, which encrypted flash cannot do
+    if (partition->encrypted) {
+        ESP_LOGE("MQTT", "Offline store partition %s must not be encrypted", config.partition_label);
+        return false;
+    }
+    if (partition->erase_size == 0 || partition->size / partition->erase_size < 2
+        || sizeof(SectorHeader) + recordSize(MQTT_STORE_MAX_RECORD) > partition->erase_size) {
+        ESP_LOGE("MQTT", "Offline store partition %s is too small", config.partition_label);
+        return false;
+    }
+
+    if (!_mutex) _mutex = xSemaphoreCreateMutex();
+    if (!_buffer) _buffer = new (std::nothrow) uint8_t[MQTT_STORE_MAX_RECORD];
+    if (!_mutex || !_buffer) {
+        ESP_LOGE("MQTT", "Failed to allocate the offline store");
+        return false;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _partition = partition;
+    _sectorSize = partition->erase_size;
+    _sectors = partition->size / partition->erase_size;
+    _stored = 0;
+    _replayed = 0;
+    _overwritten = 0;
+    _corrupt = 0;
+    _rejected = 0;
+    bool mounted = mount();
+    if (!mounted) _partition = nullptr;
+    uint32_t pending = _pending;
+    xSemaphoreGive(_mutex);
+    if (!mounted) {
+        ESP_LOGE("MQTT", "Failed to mount the offline store");
+        return false;
+    }
+
+    _running.store(true);
+    _alive.store(true);
+    if (xTaskCreate(&OfflineStore::replayTask, "mqtt_replay", config.task_stack, this,
+                    config.task_priority, &_task) != pdPASS) {
+        ESP_LOGE("MQTT", "Failed to create the replay task");
+        _task = nullptr;
+        _running.store(false);
+        _alive.store(false);
+        stop();
+        return false;
+    }
+    ESP_LOGI("MQTT", "Offline store mounted, %u sectors, %u records pending",
+             (unsigned)_sectors, (unsigned)pending);
+    if (MqttClient::getInstance().getStatus() == MqttStatus::CONNECTED) notifyConnected();
+    return true;
+}
+
+void OfflineStore::stop() {
+    if (_task) {
+        _running.store(false);
+        xTaskNotifyGive(_task);
+        // The replay task may be inside a publish, let it leave on its own
+        while (_alive.load()) {
+            vTaskDelay(1);
+        }
+        _task = nullptr;
+    }
+    if (_mutex) {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        _partition = nullptr;
+        xSemaphoreGive(_mutex);
+    }
+}
+
+bool OfflineStore::append(const char* topic, const char* data, size_t len, int qos, bool retain) {
+    if (!_mutex || !topic || (len && !data)) return false;
+    const size_t topic_len = strlen(topic);
+
+    RecordHeader header;
+    header.magic = RECORD_MAGIC;
+    header.len = static_cast<uint16_t>(topic_len + len);
+    header.topic_len = static_cast<uint8_t>(topic_len);
+    header.flags = static_cast<uint8_t>((qos & 0x03) | (retain ? 0x04 : 0));
+    header.state = STATE_PENDING;
+    header.reserved = 0xFF;
+    header.crc = recordCrc(header, topic, data, len);
+    const uint32_t size = recordSize(header.len);
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (!_partition) {
+        xSemaphoreGive(_mutex);
+        return false;
+    }
+    if (topic_len == 0 || topic_len > UINT8_MAX || topic_len + len > MQTT_STORE_MAX_RECORD) {
+        ++_rejected;
+        xSemaphoreGive(_mutex);
+        return false;
+    }
+    if (_headOffset + size > _sectorSize && !openSector((_headSector + 1) % _sectors)) {
+        xSemaphoreGive(_mutex);
+        return false;
+    }
+
+    // Body first, so a record with a valid header is always complete
+    const size_t base = _headSector * _sectorSize + _headOffset;
+    bool written = esp_partition_write(_partition, base + sizeof(RecordHeader), topic, topic_len) == ESP_OK
+        && (len == 0 || esp_partition_write(_partition, base + sizeof(RecordHeader) + topic_len, data, len) == ESP_OK)
+        && esp_partition_write(_partition, base, &header, sizeof(header)) == ESP_OK;
+    if (written) {
+        _headOffset += size;
+        ++_pending;
+        ++_stored;
+    } else {
+        // Bytes may be half programmed, the rest of this sector is not used again
+        _headOffset = _sectorSize;
+    }
+    xSemaphoreGive(_mutex);
+    return written;
+}
+
+void OfflineStore::notifyConnected() {
+    if (_task) xTaskNotifyGive(_task);
+}
+
+void OfflineStore::published(bool delivered) {
+    uint8_t waiting = INFLIGHT_WAITING;
+    if (_inflight.compare_exchange_strong(waiting, delivered ? INFLIGHT_DELIVERED : INFLIGHT_LOST) && _task) {
+        xTaskNotifyGive(_task);
+    }
+}
+
+bool OfflineStore::clear() {
+    if (!_mutex) return false;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    bool cleared = _partition != nullptr;
+    // Sector 0 is erased when it is reopened below
+    for (uint32_t s = 1; cleared && s < _sectors; ++s) {
+        cleared = esp_partition_erase_range(_partition, s * _sectorSize, _sectorSize) == ESP_OK;
+    }
+    if (cleared) {
+        _headSector = 0;
+        _tailSector = 0;
+        _tailOffset = sizeof(SectorHeader);
+        _pending = 0;
+        ++_epoch;
+        cleared = openSector(0);
+    }
+    xSemaphoreGive(_mutex);
+    return cleared;
+}
+
+OfflineStoreStats OfflineStore::getStats() const {
+    OfflineStoreStats stats = {};
+    if (!_mutex) return stats;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    stats.pending = _pending;
+    stats.stored = _stored;
+    stats.replayed = _replayed;
+    stats.overwritten = _overwritten;
+    stats.corrupt = _corrupt;
+    stats.rejected = _rejected;
+    stats.sectors = _sectors;
+    xSemaphoreGive(_mutex);
+    return stats;
+}
+
+void OfflineStore::replayTask(void* arg) {
+    OfflineStore* self = static_cast<OfflineStore*>(arg);
+    while (self->_running.load()) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!self->_running.load()) break;
+        self->replay();
+    }
+    self->_alive.store(false);
+    vTaskDelete(nullptr);
+}
+
+void OfflineStore::replay() {
+    MqttClient& client = MqttClient::getInstance();
+    const uint64_t tick_us = portTICK_PERIOD_MS * 1000ULL;
+    uint64_t debt_us = 0;
+    RecordHeader header;
+    uint32_t epoch;
+
+    while (_running.load() && client.getStatus() == MqttStatus::CONNECTED && nextRecord(header, epoch)) {
+        const char* body = reinterpret_cast<const char*>(_buffer);
+        // Should the link drop right here the client appends the message
+        // again, so it is replayed twice rather than lost
+        int msg_id = client.publish(std::string_view(body, header.topic_len),
+                                    std::string_view(body + header.topic_len, header.len - header.topic_len),
+                                    header.flags & 0x03, (header.flags & 0x04) != 0);
+        if (msg_id < 0) {
+            // Outbox full, the record stays pending and is tried again
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+            continue;
+        }
+        if (msg_id > 0) {
+            // QoS 1/2 is only cleared in flash on the broker's acknowledgement.
+            // esp-mqtt resends it across reconnects, the wait lasts until then.
+            _inflight.store(INFLIGHT_WAITING);
+            if (client.watchOutbox(msg_id)) {
+                while (_inflight.load() == INFLIGHT_WAITING && _running.load()) {
+                    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                }
+            } else {
+                // Acknowledged before it could be watched, or not tracked at all
+                _inflight.store(INFLIGHT_DELIVERED);
+            }
+            const uint8_t result = _inflight.exchange(INFLIGHT_NONE);
+            // Dropped by esp-mqtt, or the store is stopping: the record stays pending
+            if (result != INFLIGHT_DELIVERED) continue;
+        }
+        ackRecord(header, epoch);
+
+        // Sleep off whichever of the two rate caps is tighter
+        debt_us += std::max<uint64_t>(1000000ULL * header.len / _config.replay_bytes_per_s,
+                                      1000000ULL / _config.replay_msgs_per_s);
+        if (debt_us >= tick_us) {
+            TickType_t ticks = static_cast<TickType_t>(debt_us / tick_us);
+            debt_us -= ticks * tick_us;
+            ulTaskNotifyTake(pdTRUE, ticks);
+        }
+    }
+}
+
+bool OfflineStore::mount() {
+    _pending = 0;
+    bool found = false;
+    SectorHeader sector;
+    for (uint32_t s = 0; s < _sectors; ++s) {
+        if (!readSector(s, sector) || sector.magic != SECTOR_MAGIC) continue;
+        if (!found || static_cast<int32_t>(sector.seq - _headSeq) > 0) {
+            _headSector = s;
+            _headSeq = sector.seq;
+            found = true;
+        }
+    }
+    if (!found) {
+        // Blank or foreign partition, start a new log
+        _headSector = 0;
+        _headSeq = 0;
+        _tailSector = 0;
+        _tailOffset = sizeof(SectorHeader);
+        return openSector(0);
+    }
+
+    // Free space starts after the last complete record of the newest sector
+    uint32_t offset = sizeof(SectorHeader);
+    RecordHeader record;
+    while (offset + sizeof(RecordHeader) <= _sectorSize
+           && readRecord(_headSector, offset, record) && record.magic == RECORD_MAGIC) {
+        offset += recordSize(record.len);
+    }
+    // A write cut short by a reset leaves programmed bytes behind the last record
+    if (offset > _sectorSize || !sectorErased(_headSector, offset)) offset = _sectorSize;
+    _headOffset = offset;
+
+    // Sectors are used in turn, so the one after the head is the oldest
+    _tailSector = _headSector;
+    _tailOffset = _headOffset;
+    bool tail = false;
+    for (uint32_t i = 1; i <= _sectors; ++i) {
+        uint32_t s = (_headSector + i) % _sectors;
+        if (!readSector(s, sector) || sector.magic != SECTOR_MAGIC) continue;
+        uint32_t first;
+        uint32_t count = scanPending(s, &first);
+        if (count && !tail) {
+            _tailSector = s;
+            _tailOffset = first;
+            tail = true;
+        }
+        _pending += count;
+    }
+    return true;
+}
+
+bool OfflineStore::readSector(uint32_t sector, SectorHeader& header) const {
+    return esp_partition_read(_partition, sector * _sectorSize, &header, sizeof(header)) == ESP_OK;
+}
+
+bool OfflineStore::readRecord(uint32_t sector, uint32_t offset, RecordHeader& header) const {
+    return esp_partition_read(_partition, sector * _sectorSize + offset, &header, sizeof(header)) == ESP_OK;
+}
+
+uint32_t OfflineStore::scanPending(uint32_t sector, uint32_t* first) const {
+    uint32_t count = 0;
+    uint32_t offset = sizeof(SectorHeader);
+    RecordHeader record;
+    while (offset + sizeof(RecordHeader) <= _sectorSize
+           && readRecord(sector, offset, record) && record.magic == RECORD_MAGIC) {
+        if (record.state == STATE_PENDING) {
+            if (count == 0 && first) *first = offset;
+            ++count;
+        }
+        offset += recordSize(record.len);
+    }
+    return count;
+}
+
+bool OfflineStore::sectorErased(uint32_t sector, uint32_t offset) const {
+    uint32_t words[16];
+    while (offset < _sectorSize) {
+        size_t chunk = std::min<size_t>(sizeof(words), _sectorSize - offset);
+        if (esp_partition_read(_partition, sector * _sectorSize + offset, words, chunk) != ESP_OK) return false;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(words);
+        for (size_t i = 0; i < chunk; ++i) {
+            if (bytes[i] != 0xFF) return false;
+        }
+        offset += chunk;
+    }
+    return true;
+}
+
+bool OfflineStore::openSector(uint32_t sector) {
+    // The writer caught up with the reader, the oldest sector is given up
+    if (sector == _tailSector && sector != _headSector) {
+        uint32_t lost = scanPending(sector, nullptr);
+        _pending -= lost;
+        _overwritten += lost;
+        _tailSector = (sector + 1) % _sectors;
+        _tailOffset = sizeof(SectorHeader);
+        ++_epoch;
+        if (lost) ESP_LOGW("MQTT", "Offline store full, %u records overwritten", (unsigned)lost);
+    }
+    if (esp_partition_erase_range(_partition, sector * _sectorSize, _sectorSize) != ESP_OK) {
+        ESP_LOGE("MQTT", "Failed to erase offline store sector %u", (unsigned)sector);
+        return false;
+    }
+    SectorHeader header = {SECTOR_MAGIC, _headSeq + 1};
+    if (esp_partition_write(_partition, sector * _sectorSize, &header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    _headSector = sector;
+    _headSeq = header.seq;
+    _headOffset = sizeof(SectorHeader);
+    return true;
+}
+
+bool OfflineStore::nextRecord(RecordHeader& header, uint32_t& epoch) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    while (_partition && !(_tailSector == _headSector && _tailOffset >= _headOffset)) {
+        RecordHeader record;
+        if (_tailOffset + sizeof(RecordHeader) > _sectorSize
+            || !readRecord(_tailSector, _tailOffset, record) || record.magic != RECORD_MAGIC) {
+            // No more records in this sector
+            if (_tailSector == _headSector) {
+                _tailOffset = _headOffset;
+            } else {
+                _tailSector = (_tailSector + 1) % _sectors;
+                _tailOffset = sizeof(SectorHeader);
+            }
+            continue;
+        }
+        if (record.state != STATE_PENDING) {
+            _tailOffset += recordSize(record.len);
+            continue;
+        }
+
+        const size_t base = _tailSector * _sectorSize + _tailOffset;
+        bool valid = record.len <= MQTT_STORE_MAX_RECORD && record.topic_len != 0 && record.topic_len <= record.len
+            && esp_partition_read(_partition, base + sizeof(RecordHeader), _buffer, record.len) == ESP_OK
+            && recordCrc(record, _buffer, _buffer + record.topic_len, record.len - record.topic_len) == record.crc;
+        if (!valid) {
+            const uint8_t sent = STATE_SENT;
+            esp_partition_write(_partition, base + offsetof(RecordHeader, state), &sent, 1);
+            _tailOffset += recordSize(record.len);
+            --_pending;
+            ++_corrupt;
+            continue;
+        }
+        header = record;
+        epoch = _epoch;
+        xSemaphoreGive(_mutex);
+        return true;
+    }
+    xSemaphoreGive(_mutex);
+    return false;
+}
+
+void OfflineStore::ackRecord(const RecordHeader& header, uint32_t epoch) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    // Skipped if the record's sector was erased while it was being published
+    if (_partition && epoch == _epoch) {
+        // Clearing bits needs no erase
+        const uint8_t sent = STATE_SENT;
+        esp_partition_write(_partition, _tailSector * _sectorSize + _tailOffset + offsetof(RecordHeader, state), &sent, 1);
+        _tailOffset += recordSize(header.len);
+        --_pending;
+        ++_replayed;
+    }
+    xSemaphoreGive(_mutex);
+}
+
+uint32_t OfflineStore::recordSize(uint16_t len) {
+    // Records stay word aligned
+    return (sizeof(RecordHeader) + len + 3) & ~3u;
+}
+
+uint32_t OfflineStore::recordCrc(const RecordHeader& header, const void* topic, const void* data, size_t len) {
+    // The state byte changes after writing and is left out
+    uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&header), offsetof(RecordHeader, state));
+    crc = esp_rom_crc32_le(crc, static_cast<const uint8_t*>(topic), header.topic_len);
+    if (len) crc = esp_rom_crc32_le(crc, static_cast<const uint8_t*>(data), len);
+    return crc;
+}
+
+} // namespace ESP32_MQTT
+// End of OfflineStore.cpp
@@ -3,6 +3,7 @@
  * @brief Implementation of WiFi connection manager for ESP32
  */
 #include "../inc/wifi.hpp"
+#include "../inc/binary_log.hpp"
 #include <vector>
 #include "freertos/FreeRTOS.h"  // Used only for delay functions, not tasks
 #include "freertos/event_groups.h"
@@ -381,7 +382,7 @@ namespace ESP32_WIFI {
                 esp_wifi_connect();
                 xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
                 xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-                ESP_LOGI(TAG, "Retry connecting to AP");
+                BLOG_I(TAG, "Retry connecting to AP");
                 
                 // Notify callback if registered
                 if (self->_eventCallback) {
@@ -389,16 +390,16 @@ namespace ESP32_WIFI {
                 }
             } else if (eventId == WIFI_EVENT_AP_STACONNECTED) {
                 wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*)eventData;
-                ESP_LOGI(TAG, "Station " MACSTR " joined, AID=%d", 
+                BLOG_I(TAG, "Station " MACSTR " joined, AID=%d", 
                         MAC2STR(event->mac), event->aid);
             } else if (eventId == WIFI_EVENT_AP_STADISCONNECTED) {
                 wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*)eventData;
-                ESP_LOGI(TAG, "Station " MACSTR " left, AID=%d", 
+                BLOG_I(TAG, "Station " MACSTR " left, AID=%d", 
                         MAC2STR(event->mac), event->aid);
             }
         } else if (eventBase == IP_EVENT && eventId == IP_EVENT_STA_GOT_IP) {
             ip_event_got_ip_t* event = (ip_event_got_ip_t*)eventData;
-            ESP_LOGI(TAG, "Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
+            BLOG_I(TAG, "Got IP:" IPSTR, IP2STR(&event->ip_info.ip));
             self->_status = WiFiStatus::CONNECTED;
             xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
             